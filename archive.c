@@ -22,53 +22,119 @@
 #include "utils.h"
 #include "elf.h"
 
+#include "tar.h"
+
 #include "minizip/unzip.h"
 
-static int archive_path_start = 0;
-static unzFile uf = NULL;
-static FileList archive_list;
+#define MAX_ARCHIVE_FILES 16
+
+// Distance in uncompressed bytes between two inflate checkpoints
+#define ARCHIVE_CHECKPOINT_SPAN (4 * 1024 * 1024)
+#define ARCHIVE_WINDOW_SIZE 0x8000
+#define ARCHIVE_INPUT_SIZE (16 * 1024)
+
+// Stored entries are copied straight from the archive in bigger blocks
+#define ARCHIVE_STORED_TRANSFER_SIZE (1 * 1024 * 1024)
+
+typedef struct {
+	SceOff in;
+	SceOff out;
+	int bits;
+	uint8_t *window;
+} ArchiveCheckpoint;
+
+typedef struct ArchiveLevel ArchiveLevel;
+typedef struct ArchiveFile ArchiveFile;
+
+typedef struct {
+	int (* open)(ArchiveLevel *level);
+	void (* close)(ArchiveLevel *level);
+	int (* openFile)(ArchiveFile *file);
+	int (* readFile)(ArchiveFile *file, void *data, SceSize size);
+	int (* closeFile)(ArchiveFile *file);
+	int (* extract)(ArchiveLevel *level, char *src, char *dst, FileProcessParam *param); // Optional
+} ArchiveBackend;
+
+struct ArchiveLevel {
+	ArchiveLevel *parent;
+	const ArchiveBackend *backend;
+	unzFile uf;
+	TarArchive *tar;
+	FileList list;
+	int path_start;
+	char path[MAX_PATH_LENGTH];
+	SceUID parent_fd; // Handle inside the parent archive, -1 on the memory card
+	SceUID source_fd;
+	SceOff source_pos;
+	int depth;
+};
+
+struct ArchiveFile {
+	ArchiveLevel *level;
+	FileListEntry *entry;
+	SceUID fd;
+	int method;
+	int raw;
+	SceOff data_offset;
+	SceOff compressed_size;
+	SceOff uncompressed_size;
+	SceOff pos;
+	SceOff in_pos;
+	SceOff out_pos;
+	uint32_t crc;
+	uint32_t expected_crc;
+	int crc_valid;
+	int unz_opened;
+	z_stream stream;
+	int stream_initialised;
+	uint8_t *input;
+	uint8_t *window;
+	int window_pos;
+	ArchiveCheckpoint *checkpoints;
+	int n_checkpoints;
+};
+
+static ArchiveLevel *archive = NULL;
+
+static ArchiveFile *archive_files[MAX_ARCHIVE_FILES];
+
+static int archiveFileOpenEntry(FileListEntry *archive_entry);
+static int archiveFileIsStored(SceUID fd);
 
 int checkForUnsafeImports(void *buffer);
 char *uncompressBuffer(const Elf32_Ehdr *ehdr, const Elf32_Phdr *phdr, const segment_info *segment,
 		       const char *buffer);
 
 int archiveCheckFilesForUnsafeFself() {
-	if (!uf)
+	if (!archive)
 		return -1;
 
-	FileListEntry *archive_entry = archive_list.head;
+	FileListEntry *archive_entry = archive->list.head;
 
 	int i;
-	for (i = 0; i < archive_list.length; i++) {
-		// Set pos
-		unzGoToFilePos64(uf, (unz64_file_pos *)&archive_entry->reserved);
-
+	for (i = 0; i < archive->list.length; i++) {
 		// Open
-		if (unzOpenCurrentFile(uf) >= 0) {
+		SceUID fd = archiveFileOpenEntry(archive_entry);
+		if (fd >= 0) {
 			uint32_t magic = 0;
-			archiveFileRead(ARCHIVE_FD, &magic, sizeof(uint32_t));
+			archiveFileRead(fd, &magic, sizeof(uint32_t));
 
 			// SCE magic
 			if (magic == 0x00454353) {
 				char sce_header[0x84];
-				archiveFileRead(ARCHIVE_FD, sce_header, sizeof(sce_header));
+				archiveFileRead(fd, sce_header, sizeof(sce_header));
 
 				uint64_t elf1_offset = *(uint64_t *)(sce_header + 0x3C);
 				uint64_t phdr_offset = *(uint64_t *)(sce_header + 0x44);
 				uint64_t section_info_offset = *(uint64_t *)(sce_header + 0x54);
 
-				int i;
 				// jump to elf1
-				// Until here we have read 0x88 bytes
-				for (i = 0; i < elf1_offset - 0x88; i += sizeof(uint32_t)) {
-					uint32_t dummy = 0;
-					archiveFileRead(ARCHIVE_FD, &dummy, sizeof(uint32_t));
-				}
+				archiveFileLseek(fd, elf1_offset, SCE_SEEK_SET);
 
 				// Check imports
 				char *buffer = malloc(archive_entry->size);
 				if (buffer) {
-					int size = archiveFileRead(ARCHIVE_FD, buffer, archive_entry->size);
+					int size = archiveFileRead(fd, buffer, archive_entry->size);
 
 					Elf32_Ehdr *elf1 = (Elf32_Ehdr*)buffer;
 					Elf32_Phdr *phdr = (Elf32_Phdr*)buffer + phdr_offset - elf1_offset;
@@ -88,7 +154,7 @@ int archiveCheckFilesForUnsafeFself() {
 					free(buffer);
 
 					if (unsafe) {
-						archiveFileClose(ARCHIVE_FD);
+						archiveFileClose(fd);
 						return unsafe;
 					}
 				}
@@ -96,12 +162,12 @@ int archiveCheckFilesForUnsafeFself() {
 				// Check authid flag
 				uint64_t authid = *(uint64_t *)(sce_header + 0x7C);
 				if (authid != 0x2F00000000000002) {
-					archiveFileClose(ARCHIVE_FD);
+					archiveFileClose(fd);
 					return 1; // Unsafe
 				}
 			}
 
-			archiveFileClose(ARCHIVE_FD);
+			archiveFileClose(fd);
 		}
 
 		// Next
@@ -114,7 +180,7 @@ int archiveCheckFilesForUnsafeFself() {
 int fileListGetArchiveEntries(FileList *list, char *path, int sort) {
 	int res;
 
-	if (!uf)
+	if (!archive)
 		return -1;
 
 	FileListEntry *entry = malloc(sizeof(FileListEntry));
@@ -124,13 +190,13 @@ int fileListGetArchiveEntries(FileList *list, char *path, int sort) {
 	entry->type = FILE_TYPE_UNKNOWN;
 	fileListAddEntry(list, entry, sort);
 
-	char *archive_path = path + archive_path_start;
+	char *archive_path = path + archive->path_start;
 	int name_length = strlen(archive_path);
 
-	FileListEntry *archive_entry = archive_list.head;
+	FileListEntry *archive_entry = archive->list.head;
 
 	int i;
-	for (i = 0; i < archive_list.length; i++) {
+	for (i = 0; i < archive->list.length; i++) {
 		if (archive_entry->name_length >= name_length && strncasecmp(archive_entry->name, archive_path, name_length) == 0) { // Needs a / at end
 			char *p = strchr(archive_entry->name + name_length, '/'); // it's a sub-directory if it has got a slash
 
@@ -182,7 +248,7 @@ int fileListGetArchiveEntries(FileList *list, char *path, int sort) {
 }
 
 int getArchivePathInfo(char *path, uint64_t *size, uint32_t *folders, uint32_t *files) {
-	if (!uf)
+	if (!archive)
 		return -1;
 
 	SceIoStat stat;
@@ -222,9 +288,13 @@ int getArchivePathInfo(char *path, uint64_t *size, uint32_t *folders, uint32_t *
 }
 
 int extractArchivePath(char *src, char *dst, FileProcessParam *param) {
-	if (!uf)
+	if (!archive)
 		return -1;
 
+	// Streaming backends extract in a single pass
+	if (archive->backend->extract)
+		return archive->backend->extract(archive, src, dst, param);
+
 	SceIoStat stat;
 	memset(&stat, 0, sizeof(SceIoStat));
 	if (archiveFileGetstat(src, &stat) < 0) {
@@ -286,12 +356,22 @@ int extractArchivePath(char *src, char *dst, FileProcessParam *param) {
 			return fddst;
 		}
 
-		void *buf = malloc(TRANSFER_SIZE);
+		int transfer_size = TRANSFER_SIZE;
+
+		void *buf = NULL;
+		if (archiveFileIsStored(fdsrc)) {
+			buf = malloc(ARCHIVE_STORED_TRANSFER_SIZE);
+			if (buf)
+				transfer_size = ARCHIVE_STORED_TRANSFER_SIZE;
+		}
+
+		if (!buf)
+			buf = malloc(TRANSFER_SIZE);
 
 		uint64_t seek = 0;
 
 		while (1) {
-			int read = archiveFileRead(fdsrc, buf, TRANSFER_SIZE);
+			int read = archiveFileRead(fdsrc, buf, transfer_size);
 			if (read < 0) {
 				free(buf);
 
@@ -345,27 +425,31 @@ int extractArchivePath(char *src, char *dst, FileProcessParam *param) {
 		free(buf);
 
 		sceIoClose(fddst);
-		archiveFileClose(fdsrc);
+
+		// CRC is verified on close
+		int res = archiveFileClose(fdsrc);
+		if (res < 0)
+			return res;
 	}
 
 	return 1;
 }
 
 int archiveFileGetstat(const char *file, SceIoStat *stat) {
-	if (!uf)
+	if (!archive)
 		return -1;
 
-	const char *archive_path = file + archive_path_start;
+	const char *archive_path = file + archive->path_start;
 	int name_length = strlen(archive_path);
 
 	// Is directory
 	if (archive_path[name_length - 1] == '/')
 		return -1;
 
-	FileListEntry *archive_entry = archive_list.head;
+	FileListEntry *archive_entry = archive->list.head;
 
 	int i;
-	for (i = 0; i < archive_list.length; i++) {
+	for (i = 0; i < archive->list.length; i++) {
 		if (archive_entry->name_length == name_length && strcasecmp(archive_entry->name, archive_path) == 0) {
 			if (stat) {
 				// stat->st_mode = 
@@ -386,29 +470,435 @@ int archiveFileGetstat(const char *file, SceIoStat *stat) {
 	return -1;
 }
 
-int archiveFileOpen(const char *file, int flags, SceMode mode) {
+static ArchiveFile *archiveGetFile(SceUID fd) {
+	if (!archive || fd < ARCHIVE_FD || fd >= ARCHIVE_FD + MAX_ARCHIVE_FILES)
+		return NULL;
+
+	return archive_files[fd - ARCHIVE_FD];
+}
+
+static void archiveFreeFile(ArchiveFile *file) {
+	int i;
+	for (i = 0; i < file->n_checkpoints; i++) {
+		free(file->checkpoints[i].window);
+	}
+
+	if (file->stream_initialised)
+		inflateEnd(&file->stream);
+
+	if (file->fd >= 0)
+		sceIoClose(file->fd);
+
+	free(file->checkpoints);
+	free(file->input);
+	free(file->window);
+	free(file);
+}
+
+static void archiveCloseFiles(ArchiveLevel *level) {
+	int i;
+	for (i = 0; i < MAX_ARCHIVE_FILES; i++) {
+		if (archive_files[i] && archive_files[i]->level == level) {
+			level->backend->closeFile(archive_files[i]);
+
+			archiveFreeFile(archive_files[i]);
+			archive_files[i] = NULL;
+		}
+	}
+}
+
+static int archiveReadData(ArchiveFile *file, SceOff offset, void *buf, SceSize size) {
+	// Nested archive, read through the outer entry
+	if (file->level->parent_fd >= 0) {
+		SceOff res = archiveFileLseek(file->level->parent_fd, file->data_offset + offset, SCE_SEEK_SET);
+		if (res < 0)
+			return (int)res;
+
+		return archiveFileRead(file->level->parent_fd, buf, size);
+	}
+
+	SceOff res = sceIoLseek(file->fd, file->data_offset + offset, SCE_SEEK_SET);
+	if ((int)res == SCE_ERROR_ERRNO_ENODEV) {
+		file->fd = sceIoOpen(file->level->path, SCE_O_RDONLY, 0);
+		if (file->fd < 0)
+			return file->fd;
+
+		res = sceIoLseek(file->fd, file->data_offset + offset, SCE_SEEK_SET);
+	}
+
+	if (res < 0)
+		return (int)res;
+
+	int read = sceIoRead(file->fd, buf, size);
+	if (read == SCE_ERROR_ERRNO_ENODEV) {
+		file->fd = sceIoOpen(file->level->path, SCE_O_RDONLY, 0);
+		if (file->fd < 0)
+			return file->fd;
+
+		sceIoLseek(file->fd, file->data_offset + offset, SCE_SEEK_SET);
+		read = sceIoRead(file->fd, buf, size);
+	}
+
+	return read;
+}
+
+static void archiveAddCheckpoint(ArchiveFile *file) {
+	SceOff last = file->n_checkpoints > 0 ? file->checkpoints[file->n_checkpoints - 1].out : 0;
+	if (file->out_pos - last < ARCHIVE_CHECKPOINT_SPAN)
+		return;
+
+	ArchiveCheckpoint *checkpoints = realloc(file->checkpoints, (file->n_checkpoints + 1) * sizeof(ArchiveCheckpoint));
+	if (!checkpoints)
+		return;
+
+	file->checkpoints = checkpoints;
+
+	uint8_t *window = malloc(ARCHIVE_WINDOW_SIZE);
+	if (!window)
+		return;
+
+	// Unwrap the circular window, oldest byte first
+	int tail = ARCHIVE_WINDOW_SIZE - file->window_pos;
+	memcpy(window, file->window + file->window_pos, tail);
+	memcpy(window + tail, file->window, file->window_pos);
+
+	ArchiveCheckpoint *checkpoint = &file->checkpoints[file->n_checkpoints++];
+	checkpoint->in = file->in_pos - file->stream.avail_in;
+	checkpoint->out = file->out_pos;
+	checkpoint->bits = file->stream.data_type & 7;
+	checkpoint->window = window;
+}
+
+static int archiveInflateReset(ArchiveFile *file, ArchiveCheckpoint *checkpoint) {
+	int res = inflateReset(&file->stream);
+	if (res != Z_OK)
+		return res;
+
+	file->stream.avail_in = 0;
+	file->window_pos = 0;
+
+	if (!checkpoint) {
+		file->in_pos = 0;
+		file->out_pos = 0;
+		file->crc = 0;
+		file->crc_valid = 1;
+		return 0;
+	}
+
+	file->in_pos = checkpoint->in;
+	file->out_pos = checkpoint->out;
+	file->crc_valid = 0;
+
+	// The checkpoint starts in the middle of a byte
+	if (checkpoint->bits) {
+		uint8_t byte = 0;
+		res = archiveReadData(file, checkpoint->in - 1, &byte, 1);
+		if (res != 1)
+			return res < 0 ? res : UNZ_EOF;
+
+		inflatePrime(&file->stream, checkpoint->bits, byte >> (8 - checkpoint->bits));
+	}
+
+	memcpy(file->window, checkpoint->window, ARCHIVE_WINDOW_SIZE);
+	return inflateSetDictionary(&file->stream, checkpoint->window, ARCHIVE_WINDOW_SIZE);
+}
+
+// Inflate up to size bytes. Output goes through the window, data may be NULL to skip
+static int archiveInflate(ArchiveFile *file, uint8_t *data, SceSize size) {
+	SceSize done = 0;
+
+	while (done < size && file->out_pos < file->uncompressed_size) {
+		if (file->stream.avail_in == 0) {
+			SceOff remaining = file->compressed_size - file->in_pos;
+			if (remaining <= 0)
+				return UNZ_BADZIPFILE;
+
+			int read = archiveReadData(file, file->in_pos, file->input, MIN(remaining, ARCHIVE_INPUT_SIZE));
+			if (read <= 0)
+				return read < 0 ? read : UNZ_EOF;
+
+			file->in_pos += read;
+			file->stream.next_in = file->input;
+			file->stream.avail_in = read;
+		}
+
+		if (file->window_pos == ARCHIVE_WINDOW_SIZE)
+			file->window_pos = 0;
+
+		uint8_t *out = file->window + file->window_pos;
+		SceSize avail = MIN(ARCHIVE_WINDOW_SIZE - file->window_pos, size - done);
+
+		file->stream.next_out = out;
+		file->stream.avail_out = avail;
+
+		int res = inflate(&file->stream, Z_BLOCK);
+		if (res == Z_NEED_DICT)
+			res = Z_DATA_ERROR;
+
+		if (res < 0 && res != Z_BUF_ERROR)
+			return res;
+
+		SceSize produced = avail - file->stream.avail_out;
+
+		if (data)
+			memcpy(data + done, out, produced);
+
+		if (file->crc_valid)
+			file->crc = crc32(file->crc, out, produced);
+
+		file->window_pos += produced;
+		file->out_pos += produced;
+		done += produced;
+
+		// Block boundary
+		if ((file->stream.data_type & 128) && !(file->stream.data_type & 64))
+			archiveAddCheckpoint(file);
+
+		if (res == Z_STREAM_END)
+			break;
+	}
+
+	return done;
+}
+
+static int archiveInflateSeek(ArchiveFile *file, SceOff pos) {
 	int res;
 
-	if (!uf)
+	// Find the nearest checkpoint before pos
+	ArchiveCheckpoint *checkpoint = NULL;
+
+	int i;
+	for (i = file->n_checkpoints - 1; i >= 0; i--) {
+		if (file->checkpoints[i].out <= pos) {
+			checkpoint = &file->checkpoints[i];
+			break;
+		}
+	}
+
+	// Restart only if we cannot continue forward or the checkpoint is closer
+	if (pos < file->out_pos || (checkpoint && checkpoint->out > file->out_pos)) {
+		res = archiveInflateReset(file, checkpoint);
+		if (res < 0)
+			return res;
+	}
+
+	while (file->out_pos < pos) {
+		res = archiveInflate(file, NULL, MIN(pos - file->out_pos, TRANSFER_SIZE));
+		if (res <= 0)
+			return res < 0 ? res : UNZ_EOF;
+	}
+
+	return 0;
+}
+
+static int archiveUnzSeek(ArchiveFile *file, SceOff pos) {
+	int res;
+
+	unzFile uf = file->level->uf;
+
+	// unzip can only go forward, reopen to go back
+	if (pos < file->out_pos) {
+		unzCloseCurrentFile(uf);
+		unzGoToFilePos64(uf, (unz64_file_pos *)&file->entry->reserved);
+
+		res = unzOpenCurrentFile(uf);
+		if (res < 0)
+			return res;
+
+		file->out_pos = 0;
+	}
+
+	while (file->out_pos < pos) {
+		res = unzReadCurrentFile(uf, file->window, MIN(pos - file->out_pos, ARCHIVE_WINDOW_SIZE));
+		if (res <= 0)
+			return res < 0 ? res : UNZ_EOF;
+
+		file->out_pos += res;
+	}
+
+	return 0;
+}
+
+static int zipBackendOpenFile(ArchiveFile *file) {
+	int res;
+
+	ArchiveLevel *level = file->level;
+	unzFile uf = level->uf;
+
+	// unzip has only one current file. Opening an entry moves it, so no other
+	// entry can be opened while one is decoded by unzip
+	int i;
+	for (i = 0; i < MAX_ARCHIVE_FILES; i++) {
+		if (archive_files[i] && archive_files[i]->level == level && archive_files[i]->unz_opened)
+			return -1;
+	}
+
+	// Set pos
+	unzGoToFilePos64(uf, (unz64_file_pos *)&file->entry->reserved);
+
+	unz_file_info64 file_info;
+	res = unzGetCurrentFileInfo64(uf, &file_info, NULL, 0, NULL, 0, NULL, 0);
+	if (res < 0)
+		return res;
+
+	file->method = file_info.compression_method;
+	file->compressed_size = file_info.compressed_size;
+	file->uncompressed_size = file_info.uncompressed_size;
+	file->expected_crc = file_info.crc;
+	file->crc_valid = 1;
+
+	file->window = malloc(ARCHIVE_WINDOW_SIZE);
+	if (!file->window)
 		return -1;
 
-	const char *archive_path = file + archive_path_start;	
-	int name_length = strlen(archive_path);
+	// Unencrypted stored and deflated entries are read straight from the archive
+	if ((file->method == 0 || file->method == Z_DEFLATED) && !(file_info.flag & 1) && file_info.disk_num_start == 0) {
+		if (unzOpenCurrentFile2(uf, NULL, NULL, 1) >= 0) {
+			file->data_offset = unzGetCurrentFileZStreamPos64(uf);
+			unzCloseCurrentFile(uf);
+
+			if (level->parent_fd >= 0) {
+				file->raw = 1;
+			} else {
+				file->fd = sceIoOpen(level->path, SCE_O_RDONLY, 0);
+				if (file->fd >= 0)
+					file->raw = 1;
+			}
+		}
+	}
+
+	if (file->raw && file->method == Z_DEFLATED) {
+		file->input = malloc(ARCHIVE_INPUT_SIZE);
+		if (!file->input)
+			return -1;
+
+		res = inflateInit2(&file->stream, -MAX_WBITS);
+		if (res != Z_OK)
+			return res;
+
+		file->stream_initialised = 1;
+	}
+
+	// Encrypted, bzip2, lzma and zstd entries are decoded by unzip
+	if (!file->raw) {
+		res = unzOpenCurrentFile(uf);
+		if (res < 0)
+			return res;
+
+		file->unz_opened = 1;
+	}
+
+	return 0;
+}
 
-	FileListEntry *archive_entry = archive_list.head;
+static int zipBackendReadFile(ArchiveFile *file, void *data, SceSize size) {
+	int res;
+
+	if (!file->raw) {
+		res = archiveUnzSeek(file, file->pos);
+		if (res < 0)
+			return res;
+
+		res = unzReadCurrentFile(file->level->uf, data, size);
+		if (res > 0)
+			file->out_pos += res;
+	} else if (file->method == Z_DEFLATED) {
+		res = archiveInflateSeek(file, file->pos);
+		if (res < 0)
+			return res;
+
+		res = archiveInflate(file, data, size);
+	} else {
+		res = archiveReadData(file, file->pos, data, size);
+		if (res > 0) {
+			// CRC can only be verified on sequential reads
+			if (file->pos != file->out_pos)
+				file->crc_valid = 0;
+
+			if (file->crc_valid)
+				file->crc = crc32(file->crc, data, res);
+
+			file->out_pos = file->pos + res;
+		}
+	}
+
+	return res;
+}
+
+static int zipBackendCloseFile(ArchiveFile *file) {
+	if (file->unz_opened)
+		return unzCloseCurrentFile(file->level->uf);
+
+	if (file->raw && file->crc_valid && file->out_pos == file->uncompressed_size && file->crc != file->expected_crc)
+		return UNZ_CRCERROR;
+
+	return 0;
+}
+
+static int tarBackendOpenFile(ArchiveFile *file) {
+	file->data_offset = *(SceOff *)&file->entry->reserved;
+	return 0;
+}
+
+static int tarBackendReadFile(ArchiveFile *file, void *data, SceSize size) {
+	return tarRead(file->level->tar, file->data_offset + file->pos, data, size);
+}
+
+static int tarBackendCloseFile(ArchiveFile *file) {
+	return 0;
+}
+
+static int archiveFileOpenEntry(FileListEntry *archive_entry) {
+	int res;
 
 	int i;
-	for (i = 0; i < archive_list.length; i++) {
-		if (archive_entry->name_length == name_length && strcasecmp(archive_entry->name, archive_path) == 0) {
-			// Set pos
-			unzGoToFilePos64(uf, (unz64_file_pos *)&archive_entry->reserved);
+	for (i = 0; i < MAX_ARCHIVE_FILES; i++) {
+		if (!archive_files[i])
+			break;
+	}
+
+	if (i == MAX_ARCHIVE_FILES)
+		return -1;
+
+	ArchiveFile *file = malloc(sizeof(ArchiveFile));
+	if (!file)
+		return -1;
+
+	memset(file, 0, sizeof(ArchiveFile));
+	file->level = archive;
+	file->entry = archive_entry;
+	file->fd = -1;
+	file->uncompressed_size = archive_entry->size;
+
+	res = archive->backend->openFile(file);
+	if (res < 0) {
+		archiveFreeFile(file);
+		return res;
+	}
+
+	archive_files[i] = file;
+
+	return ARCHIVE_FD + i;
+}
+
+static int archiveFileIsStored(SceUID fd) {
+	ArchiveFile *file = archiveGetFile(fd);
+	return file && file->raw && file->method == 0;
+}
+
+int archiveFileOpen(const char *file, int flags, SceMode mode) {
+	if (!archive)
+		return -1;
+
+	const char *archive_path = file + archive->path_start;	
+	int name_length = strlen(archive_path);
 
-			// Open
-			res = unzOpenCurrentFile(uf);
-			if (res < 0)
-				return res;
+	FileListEntry *archive_entry = archive->list.head;
 
-			return ARCHIVE_FD;
+	int i;
+	for (i = 0; i < archive->list.length; i++) {
+		if (archive_entry->name_length == name_length && strcasecmp(archive_entry->name, archive_path) == 0) {
+			return archiveFileOpenEntry(archive_entry);
 		}
 
 		// Next
@@ -419,17 +909,69 @@ int archiveFileOpen(const char *file, int flags, SceMode mode) {
 }
 
 int archiveFileRead(SceUID fd, void *data, SceSize size) {
-	if (!uf || fd != ARCHIVE_FD)
+	int res;
+
+	ArchiveFile *file = archiveGetFile(fd);
+	if (!file)
 		return -1;
 
-	return unzReadCurrentFile(uf, data, size);
+	if (file->pos >= file->uncompressed_size)
+		return 0;
+
+	if (size > file->uncompressed_size - file->pos)
+		size = file->uncompressed_size - file->pos;
+
+	res = file->level->backend->readFile(file, data, size);
+	if (res > 0)
+		file->pos += res;
+
+	return res;
+}
+
+SceOff archiveFileLseek(SceUID fd, SceOff offset, int whence) {
+	ArchiveFile *file = archiveGetFile(fd);
+	if (!file)
+		return -1;
+
+	SceOff pos;
+
+	switch (whence) {
+		case SCE_SEEK_SET:
+			pos = offset;
+			break;
+			
+		case SCE_SEEK_CUR:
+			pos = file->pos + offset;
+			break;
+			
+		case SCE_SEEK_END:
+			pos = file->uncompressed_size + offset;
+			break;
+			
+		default:
+			return -1;
+	}
+
+	if (pos < 0)
+		return -1;
+
+	// Seeking is deferred to the next read
+	file->pos = pos;
+
+	return pos;
 }
 
 int archiveFileClose(SceUID fd) {
-	if (!uf || fd != ARCHIVE_FD)
+	ArchiveFile *file = archiveGetFile(fd);
+	if (!file)
 		return -1;
 
-	return unzCloseCurrentFile(uf);
+	int res = file->level->backend->closeFile(file);
+
+	archiveFreeFile(file);
+	archive_files[fd - ARCHIVE_FD] = NULL;
+
+	return res;
 }
 
 int ReadArchiveFile(char *file, void *buf, int size) {
@@ -437,45 +979,161 @@ int ReadArchiveFile(char *file, void *buf, int size) {
 	if (fd < 0)
 		return fd;
 
-	int read = archiveFileRead(fd, buf, size);
+	// Reads may return less than asked for
+	int read = 0;
+	while (read < size) {
+		int res = archiveFileRead(fd, (char *)buf + read, size - read);
+		if (res < 0) {
+			archiveFileClose(fd);
+			return res;
+		}
+
+		if (res == 0)
+			break;
+
+		read += res;
+	}
+
 	archiveFileClose(fd);
 	return read;
 }
 
-int archiveClose() {
-	if (!uf)
-		return -1;
+static int archiveSourceRead(void *opaque, void *buf, SceSize size) {
+	ArchiveLevel *level = (ArchiveLevel *)opaque;
+
+	int read;
+
+	if (level->parent_fd >= 0) {
+		SceOff res = archiveFileLseek(level->parent_fd, level->source_pos, SCE_SEEK_SET);
+		if (res < 0)
+			return (int)res;
+
+		read = archiveFileRead(level->parent_fd, buf, size);
+	} else {
+		read = sceIoRead(level->source_fd, buf, size);
+		if (read == SCE_ERROR_ERRNO_ENODEV) {
+			level->source_fd = sceIoOpen(level->path, SCE_O_RDONLY, 0);
+			if (level->source_fd < 0)
+				return level->source_fd;
+
+			sceIoLseek(level->source_fd, level->source_pos, SCE_SEEK_SET);
+			read = sceIoRead(level->source_fd, buf, size);
+		}
+	}
+
+	if (read > 0)
+		level->source_pos += read;
+
+	return read;
+}
 
-	fileListEmpty(&archive_list);
+static int archiveSourceRewind(void *opaque) {
+	ArchiveLevel *level = (ArchiveLevel *)opaque;
 
-	unzClose(uf);
-	uf = NULL;
+	level->source_pos = 0;
+
+	if (level->parent_fd < 0) {
+		SceOff res = sceIoLseek(level->source_fd, 0, SCE_SEEK_SET);
+		if (res < 0)
+			return (int)res;
+	}
 
 	return 0;
 }
 
-int archiveOpen(char *file) {
-	// Start position of the archive path
-	archive_path_start = strlen(file) + 1;
+static voidpf ZCALLBACK nested_open_file_func(voidpf opaque, const void *filename, int mode) {
+	ArchiveLevel *level = (ArchiveLevel *)opaque;
 
-	// Close previous zip file first
-	if (uf)
-		unzClose(uf);
+	if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ)
+		return NULL;
 
-	// Open zip file
-	uf = unzOpen64(file);
-	if (!uf)
+	level->source_pos = 0;
+	return level;
+}
+
+static voidpf ZCALLBACK nested_opendisk_file_func(voidpf opaque, voidpf stream, int number_disk, int mode) {
+	return NULL;
+}
+
+static uLong ZCALLBACK nested_read_file_func(voidpf opaque, voidpf stream, void *buf, uLong size) {
+	int read = archiveSourceRead(stream, buf, size);
+	return read < 0 ? 0 : read;
+}
+
+static uLong ZCALLBACK nested_write_file_func(voidpf opaque, voidpf stream, const void *buf, uLong size) {
+	return 0;
+}
+
+static ZPOS64_T ZCALLBACK nested_tell_file_func(voidpf opaque, voidpf stream) {
+	ArchiveLevel *level = (ArchiveLevel *)stream;
+	return level->source_pos;
+}
+
+static long ZCALLBACK nested_seek_file_func(voidpf opaque, voidpf stream, ZPOS64_T offset, int origin) {
+	ArchiveLevel *level = (ArchiveLevel *)stream;
+
+	SceOff pos;
+
+	switch (origin) {
+		case ZLIB_FILEFUNC_SEEK_SET:
+			pos = offset;
+			break;
+			
+		case ZLIB_FILEFUNC_SEEK_CUR:
+			pos = level->source_pos + offset;
+			break;
+			
+		case ZLIB_FILEFUNC_SEEK_END:
+			pos = archiveFileLseek(level->parent_fd, offset, SCE_SEEK_END);
+			break;
+			
+		default:
+			return -1;
+	}
+
+	if (pos < 0)
 		return -1;
 
-	// Clear archive list
-	memset(&archive_list, 0, sizeof(FileList));
+	level->source_pos = pos;
+	return 0;
+}
 
-	// Go through all files
+static int ZCALLBACK nested_close_file_func(voidpf opaque, voidpf stream) {
+	return 0;
+}
+
+static int ZCALLBACK nested_error_file_func(voidpf opaque, voidpf stream) {
+	return 0;
+}
+
+static int zipBackendOpen(ArchiveLevel *level) {
 	int res;
 	char name[MAX_PATH_LENGTH];
 	unz_file_info64 file_info;
 
-	res = unzGoToFirstFile2(uf, &file_info, name, MAX_PATH_LENGTH, NULL, 0, NULL, 0);
+	// Open zip file
+	if (level->parent_fd >= 0) {
+		zlib_filefunc64_def filefunc;
+		filefunc.zopen64_file = nested_open_file_func;
+		filefunc.zopendisk64_file = nested_opendisk_file_func;
+		filefunc.zread_file = nested_read_file_func;
+		filefunc.zwrite_file = nested_write_file_func;
+		filefunc.ztell64_file = nested_tell_file_func;
+		filefunc.zseek64_file = nested_seek_file_func;
+		filefunc.zclose_file = nested_close_file_func;
+		filefunc.zerror_file = nested_error_file_func;
+		filefunc.opaque = level;
+
+		level->uf = unzOpen2_64(level->path, &filefunc);
+	} else {
+		level->uf = unzOpen64(level->path);
+	}
+
+	if (!level->uf)
+		return -1;
+
+	// Go through all files
+	res = unzGoToFirstFile2(level->uf, &file_info, name, MAX_PATH_LENGTH, NULL, 0, NULL, 0);
 	if (res < 0)
 		return res;
 
@@ -499,13 +1157,216 @@ int archiveOpen(char *file) {
 		memcpy(&entry->atime, &time, sizeof(SceDateTime));
 
 		// Get pos
-		unzGetFilePos64(uf, (unz64_file_pos *)&entry->reserved);
+		unzGetFilePos64(level->uf, (unz64_file_pos *)&entry->reserved);
 
 		// Add entry
-		fileListAddEntry(&archive_list, entry, SORT_BY_NAME);
+		fileListAddEntry(&level->list, entry, SORT_BY_NAME);
 
 		// Next
-		res = unzGoToNextFile2(uf, &file_info, name, MAX_PATH_LENGTH, NULL, 0, NULL, 0);
+		res = unzGoToNextFile2(level->uf, &file_info, name, MAX_PATH_LENGTH, NULL, 0, NULL, 0);
+	}
+
+	return 0;
+}
+
+static void zipBackendClose(ArchiveLevel *level) {
+	if (level->uf)
+		unzClose(level->uf);
+}
+
+static int tarBackendOpen(ArchiveLevel *level) {
+	if (level->parent_fd < 0) {
+		level->source_fd = sceIoOpen(level->path, SCE_O_RDONLY, 0);
+		if (level->source_fd < 0)
+			return level->source_fd;
+	}
+
+	TarInput input;
+	input.read = archiveSourceRead;
+	input.rewind = archiveSourceRewind;
+	input.opaque = level;
+
+	level->tar = tarOpen(&input);
+	if (!level->tar)
+		return -1;
+
+	return tarGetEntries(level->tar, &level->list);
+}
+
+static void tarBackendClose(ArchiveLevel *level) {
+	tarClose(level->tar);
+
+	if (level->source_fd >= 0)
+		sceIoClose(level->source_fd);
+}
+
+static int tarBackendExtract(ArchiveLevel *level, char *src, char *dst, FileProcessParam *param) {
+	return tarExtract(level->tar, src + level->path_start, dst, param);
+}
+
+static const ArchiveBackend zip_backend = {
+	zipBackendOpen,
+	zipBackendClose,
+	zipBackendOpenFile,
+	zipBackendReadFile,
+	zipBackendCloseFile,
+	NULL,
+};
+
+static const ArchiveBackend tar_backend = {
+	tarBackendOpen,
+	tarBackendClose,
+	tarBackendOpenFile,
+	tarBackendReadFile,
+	tarBackendCloseFile,
+	tarBackendExtract,
+};
+
+// Open file as a new innermost level. If an archive is already open, file is an entry of it
+static int archivePushLevel(const char *file) {
+	int res;
+
+	if (archive && archive->depth >= MAX_ARCHIVE_LEVELS)
+		return -1;
+
+	ArchiveLevel *level = malloc(sizeof(ArchiveLevel));
+	if (!level)
+		return -1;
+
+	memset(level, 0, sizeof(ArchiveLevel));
+	level->parent = archive;
+	level->parent_fd = -1;
+	level->source_fd = -1;
+	level->depth = archive ? archive->depth + 1 : 1;
+	level->backend = getFileType((char *)file) == FILE_TYPE_TAR ? &tar_backend : &zip_backend;
+
+	// Start position of the archive path
+	strncpy(level->path, file, MAX_PATH_LENGTH - 1);
+	level->path_start = strlen(level->path) + 1;
+
+	if (archive) {
+		level->parent_fd = archiveFileOpen(file, SCE_O_RDONLY, 0);
+		if (level->parent_fd < 0) {
+			res = level->parent_fd;
+			free(level);
+			return res;
+		}
+	}
+
+	res = level->backend->open(level);
+	if (res < 0) {
+		fileListEmpty(&level->list);
+		level->backend->close(level);
+
+		if (level->parent_fd >= 0)
+			archiveFileClose(level->parent_fd);
+
+		free(level);
+		return res;
+	}
+
+	archive = level;
+
+	return 0;
+}
+
+int archiveCloseLevel() {
+	if (!archive)
+		return -1;
+
+	ArchiveLevel *level = archive;
+
+	archiveCloseFiles(level);
+
+	fileListEmpty(&level->list);
+
+	level->backend->close(level);
+
+	archive = level->parent;
+
+	if (level->parent_fd >= 0)
+		archiveFileClose(level->parent_fd);
+
+	free(level);
+
+	return 0;
+}
+
+int archiveClose() {
+	if (!archive)
+		return -1;
+
+	while (archive) {
+		archiveCloseLevel();
+	}
+
+	return 0;
+}
+
+int archiveOpen(char *file) {
+	int res;
+
+	// Archive inside the currently opened one
+	if (archive) {
+		int length = strlen(archive->path);
+		if (strncasecmp(file, archive->path, length) == 0 && file[length] == '/' && archiveFileGetstat(file, NULL) >= 0)
+			return archivePushLevel(file);
+	}
+
+	// Close previous zip file first
+	archiveClose();
+
+	// Find the outermost archive on the memory card
+	char path[MAX_PATH_LENGTH];
+	strncpy(path, file, MAX_PATH_LENGTH - 1);
+	path[MAX_PATH_LENGTH - 1] = '\0';
+
+	while (1) {
+		SceIoStat stat;
+		memset(&stat, 0, sizeof(SceIoStat));
+		if (sceIoGetstat(path, &stat) >= 0 && !SCE_S_ISDIR(stat.st_mode))
+			break;
+
+		char *p = strrchr(path, '/');
+		if (!p)
+			return -1;
+
+		*p = '\0';
+	}
+
+	res = archivePushLevel(path);
+	if (res < 0)
+		return res;
+
+	// Go through the nested archives
+	int length = strlen(file);
+
+	while (strlen(path) < length) {
+		char *p = file + strlen(path) + 1;
+
+		while (1) {
+			p = strchr(p, '/');
+
+			int name_length = p ? (p - file) : length;
+			strncpy(path, file, name_length);
+			path[name_length] = '\0';
+
+			if (archiveFileGetstat(path, NULL) >= 0)
+				break;
+
+			if (!p) {
+				archiveClose();
+				return -1;
+			}
+
+			p++;
+		}
+
+		res = archivePushLevel(path);
+		if (res < 0) {
+			archiveClose();
+			return res;
+		}
 	}
 
 	return 0;
@@ -23,6 +23,8 @@
 
 #define ARCHIVE_FD 0x12345678
 
+#define MAX_ARCHIVE_LEVELS 4
+
 int fileListGetArchiveEntries(FileList *list, char *path, int sort);
 
 int getArchivePathInfo(char *path, uint64_t *size, uint32_t *folders, uint32_t *files);
@@ -31,10 +33,12 @@ int extractArchivePath(char *src, char *dst, FileProcessParam *param);
 int archiveFileGetstat(const char *file, SceIoStat *stat);
 int archiveFileOpen(const char *file, int flags, SceMode mode);
 int archiveFileRead(SceUID fd, void *data, SceSize size);
+SceOff archiveFileLseek(SceUID fd, SceOff offset, int whence);
 int archiveFileClose(SceUID fd);
 
 int ReadArchiveFile(char *file, void *buf, int size);
 
+int archiveCloseLevel();
 int archiveClose();
 int archiveOpen(char *file);
 
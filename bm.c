@@ -1,68 +1,92 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <limits.h>
+#include <stdint.h>
 #include <ctype.h>
 
-const char * boyer_moore(const char *haystack, const char *needle) {
-    size_t plen = strlen(needle), slen = strlen(haystack);
+#include "bm.h"
 
-    if (plen > slen) {
-        return NULL;
+#define ONES 0x01010101
+#define HIGHS 0x80808080
+#define HAS_ZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+
+int string_search_init(StringSearch *search, const char *needle) {
+    size_t i;
+
+    search->length = strlen(needle);
+    search->needle = malloc(search->length + 1);
+    if (!search->needle) {
+        return -1;
+    }
+
+    for (i = 0; i <= UINT8_MAX; i++) {
+        search->lower[i] = tolower(i);
+    }
+
+    /* keep the needle lowercase so matching needs one table lookup per byte */
+    for (i = 0; i < search->length; i++) {
+        search->needle[i] = search->lower[(unsigned char)needle[i]];
     }
 
-    int skip[UCHAR_MAX+1];
-    int i, j, k, * next;
+    search->needle[search->length] = '\0';
+
+    search->first_lower = search->needle[0];
+    search->first_upper = toupper(search->needle[0]);
+
+    return 0;
+}
 
-    /* calc skip table („bad rule“) */
-    for (i = 0; i <= UCHAR_MAX; i++) {
-         skip[i] = plen;
+void string_search_free(StringSearch *search) {
+    free(search->needle);
+    search->needle = NULL;
+}
+
+char * string_search_find(StringSearch *search, const char *haystack, size_t size) {
+    const unsigned char *h = (const unsigned char *)haystack;
+    size_t length = search->length, i = 0, j;
+
+    if (length == 0) {
+        return (char *)haystack;
     }
 
-    for (i = 0; i < plen; i++) {
-         skip[tolower((unsigned char)needle[i])] = plen - i - 1;
+    if (length > size) {
+        return NULL;
     }
 
+    size_t last = size - length; /* last possible start of a match */
+    uint32_t lower = ONES * search->first_lower, upper = ONES * search->first_upper;
 
-    /* calc next table („good rule“) */
-    next = (int*)malloc((plen+1) * sizeof(int));
+    while (i <= last) {
+        /* skip whole words containing neither case of the first byte */
+        while (((uintptr_t)(h + i) & 3) == 0 && i + 3 <= last) {
+            uint32_t word;
+            memcpy(&word, h + i, 4);
 
-    for (j = 0; j <= plen; j++) {
-        for (i = plen - 1; i >= 1; i--) {
-            for (k = 1; k <= j; k++) {
-                if (i - k < 0) {
+            if (HAS_ZERO(word ^ lower) || HAS_ZERO(word ^ upper)) {
+                break;
+            }
+
+            i += 4;
+        }
+
+        if (i > last) {
+            break;
+        }
+
+        if (search->lower[h[i]] == search->first_lower) {
+            for (j = 1; j < length; j++) {
+                if (search->lower[h[i + j]] != search->needle[j]) {
                     break;
                 }
-                if (tolower((unsigned char)needle[plen - k]) != tolower((unsigned char)needle[i - k])) {
-                    goto nexttry;
-                }
             }
-            goto matched;
-nexttry:
-            ;
-        }
-matched:
-        next[j] = plen - i;
-    }
 
-    plen--;
-    i = plen; /* position of last p letter in s */
-
-    while (i < slen) {
-        j = 0; /* matched letter count */
-        while (j <= plen) {
-            if (tolower((unsigned char)haystack[i - j]) == tolower((unsigned char)needle[plen - j])) {
-                j++;
-            } else {
-                i += skip[tolower((unsigned char)haystack[i - j])] > next[j] ? skip[tolower((unsigned char)haystack[i - j])] - j : next[j];
-                goto newi;
+            if (j == length) {
+                return (char *)haystack + i;
             }
         }
-        free(next);
-        return haystack + i - plen;
-newi:
-        ;
+
+        i++;
     }
-    free(next);
+
     return NULL;
-}
\ No newline at end of file
+}
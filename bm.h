@@ -1,6 +1,19 @@
 #ifndef __BM_H__
 #define __BM_H__
 
-char * boyer_moore(const char *haystack, const char *needle);
+#include <stddef.h>
 
-#endif
\ No newline at end of file
+// Case-insensitive substring search, prepared once per needle
+typedef struct {
+    unsigned char lower[256];
+    unsigned char *needle;
+    size_t length;
+    unsigned char first_lower;
+    unsigned char first_upper;
+} StringSearch;
+
+int string_search_init(StringSearch *search, const char *needle);
+void string_search_free(StringSearch *search);
+char * string_search_find(StringSearch *search, const char *haystack, size_t size);
+
+#endif
@@ -0,0 +1,265 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "encoding.h"
+
+#define WORD_HIGHS 0x80808080
+
+// Length of the UTF-8 sequence at text and its code point, 0 if it is
+// invalid or cut off
+int utf8Decode(const char *text, int size, unsigned int *code) {
+	const unsigned char *p = (const unsigned char *)text;
+	if (size <= 0)
+		return 0;
+
+	if (p[0] < 0x80) {
+		*code = p[0];
+		return 1;
+	}
+
+	int length;
+	unsigned int min;
+	if ((p[0] & 0xE0) == 0xC0) {
+		length = 2;
+		min = 0x80;
+		*code = p[0] & 0x1F;
+	} else if ((p[0] & 0xF0) == 0xE0) {
+		length = 3;
+		min = 0x800;
+		*code = p[0] & 0x0F;
+	} else if ((p[0] & 0xF8) == 0xF0) {
+		length = 4;
+		min = 0x10000;
+		*code = p[0] & 0x07;
+	} else {
+		return 0;
+	}
+
+	if (size < length)
+		return 0;
+
+	int i;
+	for (i = 1; i < length; i++) {
+		if ((p[i] & 0xC0) != 0x80)
+			return 0;
+
+		*code = (*code << 6) | (p[i] & 0x3F);
+	}
+
+	// Overlong forms, surrogates and beyond Unicode
+	if (*code < min || (*code >= 0xD800 && *code <= 0xDFFF) || *code > 0x10FFFF)
+		return 0;
+
+	return length;
+}
+
+int utf8Encode(unsigned int code, char *out) {
+	unsigned char *p = (unsigned char *)out;
+
+	if (code < 0x80) {
+		p[0] = code;
+		return 1;
+	} else if (code < 0x800) {
+		p[0] = 0xC0 | (code >> 6);
+		p[1] = 0x80 | (code & 0x3F);
+		return 2;
+	} else if (code < 0x10000) {
+		p[0] = 0xE0 | (code >> 12);
+		p[1] = 0x80 | ((code >> 6) & 0x3F);
+		p[2] = 0x80 | (code & 0x3F);
+		return 3;
+	}
+
+	p[0] = 0xF0 | (code >> 18);
+	p[1] = 0x80 | ((code >> 12) & 0x3F);
+	p[2] = 0x80 | ((code >> 6) & 0x3F);
+	p[3] = 0x80 | (code & 0x3F);
+	return 4;
+}
+
+// Offset of the first non-ASCII byte from offset on, checked a word at a time
+int skipAscii(const char *buffer, int offset, int size) {
+	while (offset + 4 <= size) {
+		uint32_t word;
+		memcpy(&word, buffer + offset, 4);
+		if (word & WORD_HIGHS)
+			break;
+
+		offset += 4;
+	}
+
+	while (offset < size && !((unsigned char)buffer[offset] & 0x80))
+		offset++;
+
+	return offset;
+}
+
+// UTF-16 text without a BOM has zero high bytes for all its ASCII
+static int detectUtf16(const char *buffer, int size) {
+	const unsigned char *p = (const unsigned char *)buffer;
+	int n = MIN(size, ENCODING_SAMPLE_SIZE) / 2;
+	if (n == 0)
+		return -1;
+
+	int zero_even = 0, zero_odd = 0;
+
+	int i;
+	for (i = 0; i < n; i++) {
+		zero_even += p[2 * i] == 0;
+		zero_odd += p[2 * i + 1] == 0;
+	}
+
+	// Zero high bytes of ASCII on one side only
+	if (zero_odd > n / 4 && zero_even * 8 < zero_odd)
+		return ENCODING_UTF16LE;
+
+	if (zero_even > n / 4 && zero_odd * 8 < zero_even)
+		return ENCODING_UTF16BE;
+
+	return -1;
+}
+
+int detectEncoding(const char *buffer, int size, int *bom_length) {
+	const unsigned char *p = (const unsigned char *)buffer;
+
+	*bom_length = 0;
+
+	if (size >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF) {
+		*bom_length = 3;
+		return ENCODING_UTF8;
+	}
+
+	if (size >= 2 && p[0] == 0xFF && p[1] == 0xFE) {
+		*bom_length = 2;
+		return ENCODING_UTF16LE;
+	}
+
+	if (size >= 2 && p[0] == 0xFE && p[1] == 0xFF) {
+		*bom_length = 2;
+		return ENCODING_UTF16BE;
+	}
+
+	int utf16 = detectUtf16(buffer, size);
+	if (utf16 >= 0)
+		return utf16;
+
+	// UTF-8 unless invalid sequences are more than a stray few
+	int valid = 0, invalid = 0;
+	int offset = skipAscii(buffer, 0, size);
+
+	while (offset < size) {
+		unsigned int code;
+		int length = utf8Decode(buffer + offset, size - offset, &code);
+		if (length > 0) {
+			valid++;
+			offset += length;
+		} else {
+			invalid++;
+			offset++;
+		}
+
+		offset = skipAscii(buffer, offset, size);
+	}
+
+	if (invalid > valid / 8)
+		return ENCODING_LATIN1;
+
+	return ENCODING_UTF8;
+}
+
+static int transcodeUtf16(const char *in, int size, char *out, int big_endian) {
+	const unsigned char *p = (const unsigned char *)in;
+	int low = big_endian ? 1 : 0;
+	int high = 1 - low;
+	int length = 0;
+	int i = 0;
+
+	while (i + 1 < size) {
+		// Two ASCII units at once
+		if (i + 4 <= size) {
+			uint32_t word;
+			memcpy(&word, p + i, 4);
+
+			uint32_t mask = big_endian ? 0x80FF80FF : 0xFF80FF80;
+			if ((word & mask) == 0) {
+				out[length++] = p[i + low];
+				out[length++] = p[i + 2 + low];
+				i += 4;
+				continue;
+			}
+		}
+
+		unsigned int code = p[i + low] | (p[i + high] << 8);
+		i += 2;
+
+		if (code >= 0xD800 && code <= 0xDBFF && i + 1 < size) {
+			unsigned int next = p[i + low] | (p[i + high] << 8);
+			if (next >= 0xDC00 && next <= 0xDFFF) {
+				code = 0x10000 + ((code - 0xD800) << 10) + (next - 0xDC00);
+				i += 2;
+			}
+		}
+
+		// Unpaired surrogates
+		if (code >= 0xD800 && code <= 0xDFFF)
+			code = 0xFFFD;
+
+		length += utf8Encode(code, out + length);
+	}
+
+	// Odd trailing byte
+	if (i < size)
+		length += utf8Encode(0xFFFD, out + length);
+
+	return length;
+}
+
+static int transcodeLatin1(const char *in, int size, char *out) {
+	int length = 0;
+	int i = 0;
+
+	while (i < size) {
+		int ascii = skipAscii(in, i, size);
+		memcpy(out + length, in + i, ascii - i);
+		length += ascii - i;
+		i = ascii;
+
+		if (i < size)
+			length += utf8Encode((unsigned char)in[i++], out + length);
+	}
+
+	return length;
+}
+
+// Convert to UTF-8, out must hold TRANSCODE_MAX_SIZE(size) bytes
+int transcodeToUtf8(int encoding, const char *in, int size, char *out) {
+	switch (encoding) {
+		case ENCODING_UTF16LE:
+			return transcodeUtf16(in, size, out, 0);
+
+		case ENCODING_UTF16BE:
+			return transcodeUtf16(in, size, out, 1);
+
+		case ENCODING_LATIN1:
+			return transcodeLatin1(in, size, out);
+	}
+
+	memcpy(out, in, size);
+	return size;
+}
@@ -0,0 +1,43 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ENCODING_H__
+#define __ENCODING_H__
+
+#define ENCODING_SAMPLE_SIZE 4 * 1024
+
+#define UTF8_MAX_LENGTH 4
+
+// Largest UTF-8 output for size bytes of any supported encoding
+#define TRANSCODE_MAX_SIZE(size) (2 * (size) + 3)
+
+enum Encodings {
+	ENCODING_UTF8,
+	ENCODING_UTF16LE,
+	ENCODING_UTF16BE,
+	ENCODING_LATIN1,
+};
+
+int utf8Decode(const char *text, int size, unsigned int *code);
+int utf8Encode(unsigned int code, char *out);
+int skipAscii(const char *buffer, int offset, int size);
+
+int detectEncoding(const char *buffer, int size, int *bom_length);
+int transcodeToUtf8(int encoding, const char *in, int size, char *out);
+
+#endif
@@ -20,7 +20,6 @@
 #include "archive.h"
 #include "file.h"
 #include "utils.h"
-#include "sha1.h"
 
 static char *devices[] = {
 	// "app0:",
@@ -82,101 +81,97 @@ int WriteFile(char *file, void *buf, int size) {
 	return written;
 }
 
-int getFileSize(char *pInputFileName)
-{
-	SceUID fd = sceIoOpen(pInputFileName, SCE_O_RDONLY, 0);
+// Write ranges of a file that keeps its size, the rest isn't touched
+int writeFileRanges(char *file, FileRange *ranges, int n_ranges) {
+	SceUID fd = sceIoOpen(file, SCE_O_WRONLY, 0777);
 	if (fd < 0)
 		return fd;
 
-	int fileSize = sceIoLseek(fd, 0, SCE_SEEK_END);
-	
-	sceIoClose(fd);
-	return fileSize;
-}
+	int res = 0;
 
-int changePathPermissions(char *path, int perms) {
-	SceIoStat stat;
-	memset(&stat, 0, sizeof(SceIoStat));
-	int res = sceIoGetstat(path, &stat);
-	if (res < 0)
-		return res;
+	int i;
+	for (i = 0; i < n_ranges; i++) {
+		SceOff offset = sceIoLseek(fd, ranges[i].offset, SCE_SEEK_SET);
+		if (offset < 0) {
+			res = (int)offset;
+			break;
+		}
 
-	stat.st_mode |= perms;
+		res = sceIoWrite(fd, ranges[i].data, ranges[i].size);
+		if (res < 0)
+			break;
+	}
 
-	return sceIoChstat(path, &stat, 1);	
+	sceIoClose(fd);
+	return res < 0 ? res : 0;
 }
 
-int getFileSha1(char *pInputFileName, uint8_t *pSha1Out, FileProcessParam *param) {
-	// Set up SHA1 context
-	SHA1_CTX ctx;
-	sha1_init(&ctx);
+// Replace file by what write produces. It goes to a temporary file first, the
+// old file is only moved away once that is complete and kept if backup is set
+int writeFileAtomic(char *file, int (* write)(SceUID fd, void *context), void *context, int backup) {
+	char temp_path[MAX_PATH_LENGTH], old_path[MAX_PATH_LENGTH];
+	snprintf(temp_path, MAX_PATH_LENGTH, "%s%s", file, SAVE_TEMP_SUFFIX);
+	snprintf(old_path, MAX_PATH_LENGTH, "%s%s", file, backup ? SAVE_BACKUP_SUFFIX : SAVE_OLD_SUFFIX);
 
-	// Open the file to read, else return the error
-	SceUID fd = sceIoOpen(pInputFileName, SCE_O_RDONLY, 0);
+	SceUID fd = sceIoOpen(temp_path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
 	if (fd < 0)
 		return fd;
 
-	// Open up the buffer for copying data into
-	void *buf = malloc(TRANSFER_SIZE);
+	int res = write(fd, context);
 
-	uint64_t seek = 0;
-
-	// Actually take the SHA1 sum
-	while (1) {
-		int read = sceIoRead(fd, buf, TRANSFER_SIZE);
-		if (read == SCE_ERROR_ERRNO_ENODEV) {
-			fd = sceIoOpen(pInputFileName, SCE_O_RDONLY, 0);
-			if (fd >= 0) {
-				sceIoLseek(fd, seek, SCE_SEEK_SET);
-				read = sceIoRead(fd, buf, TRANSFER_SIZE);
-			}
-		}
+	int close_res = sceIoClose(fd);
+	if (res >= 0)
+		res = close_res;
 
-		if (read < 0) {
-			free(buf);
-			sceIoClose(fd);
-			return read;
-		}
+	if (res < 0) {
+		sceIoRemove(temp_path);
+		return res;
+	}
 
-		if (read == 0)
-			break;
+	// Renaming doesn't replace files
+	sceIoRemove(old_path);
 
-		sha1_update(&ctx, buf, read);
+	res = sceIoRename(file, old_path);
+	if (res < 0) {
+		sceIoRemove(temp_path);
+		return res;
+	}
 
-		seek += read;
+	res = sceIoRename(temp_path, file);
+	if (res < 0) {
+		sceIoRename(old_path, file);
+		sceIoRemove(temp_path);
+		return res;
+	}
 
-		if (param) {
-			// Defined in io_process.c, check to make sure pointer isn't null before incrementing
-			if (param->value)
-				(*param->value)++; // Note: Max value is filesize/TRANSFER_SIZE
+	if (!backup)
+		sceIoRemove(old_path);
 
-			if (param->SetProgress)
-				param->SetProgress(param->value ? *param->value : 0, param->max);
+	return 0;
+}
 
-			// Check to see if param->cancelHandler exists, if so call it and free memory if cancelled
-			if (param->cancelHandler && param->cancelHandler()) {
-				free(buf);
-				sceIoClose(fd);
-				return 0;
-			}
+int getFileSize(char *pInputFileName)
+{
+	SceUID fd = sceIoOpen(pInputFileName, SCE_O_RDONLY, 0);
+	if (fd < 0)
+		return fd;
 
-			// This is CPU intensive so the progress bar won't refresh unless we sleep
-			// DIALOG_WAIT seemed too long for this application
-			// so I set it to 1/2 of a second every 8192 TRANSFER_SIZE blocks
-			if ((*param->value) % 8192 == 0)
-				sceKernelDelayThread(500000);
-		}
-	}
+	int fileSize = sceIoLseek(fd, 0, SCE_SEEK_END);
+	
+	sceIoClose(fd);
+	return fileSize;
+}
 
-	// Final iteration of SHA1 sum, dump final value into pSha1Out buffer
-	sha1_final(&ctx, pSha1Out);
+int changePathPermissions(char *path, int perms) {
+	SceIoStat stat;
+	memset(&stat, 0, sizeof(SceIoStat));
+	int res = sceIoGetstat(path, &stat);
+	if (res < 0)
+		return res;
 
-	// Free up file buffer
-	free(buf);
+	stat.st_mode |= perms;
 
-	// Close file proper
-	sceIoClose(fd);
-	return 1;
+	return sceIoChstat(path, &stat, 1);	
 }
 
 int getPathInfo(char *path, uint64_t *size, uint32_t *folders, uint32_t *files, int (* handler)(char *path)) {
@@ -607,16 +602,34 @@ static ExtensionType extension_types[] = {
 	{ ".OGG",  FILE_TYPE_OGG },
 	{ ".PNG",  FILE_TYPE_PNG },
 	{ ".SFO",  FILE_TYPE_SFO },
+	{ ".TAR",  FILE_TYPE_TAR },
+	{ ".TGZ",  FILE_TYPE_TAR },
 	{ ".TXT",  FILE_TYPE_TXT },
+	{ ".TZST", FILE_TYPE_TAR },
 	{ ".VPK",  FILE_TYPE_VPK },
 	{ ".XML",  FILE_TYPE_XML },
 	{ ".ZIP",  FILE_TYPE_ZIP },
 };
 
+// Only compressed tarballs, a plain .gz or .zst file is no archive
+static ExtensionType double_extension_types[] = {
+	{ ".TAR.GZ",  FILE_TYPE_TAR },
+	{ ".TAR.ZST", FILE_TYPE_TAR },
+};
+
 int getFileType(char *file) {
+	int length = strlen(file);
+
+	int i;
+	for (i = 0; i < (sizeof(double_extension_types) / sizeof(ExtensionType)); i++) {
+		int extension_length = strlen(double_extension_types[i].extension);
+		if (length >= extension_length && strcasecmp(file + length - extension_length, double_extension_types[i].extension) == 0) {
+			return double_extension_types[i].type;
+		}
+	}
+
 	char *p = strrchr(file, '.');
 	if (p) {
-		int i;
 		for (i = 0; i < (sizeof(extension_types) / sizeof(ExtensionType)); i++) {
 			if (strcasecmp(p, extension_types[i].extension) == 0) {
 				return extension_types[i].type;
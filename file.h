@@ -24,6 +24,10 @@
 
 #define MAX_PATH_LENGTH 1024
 #define MAX_NAME_LENGTH 256
+
+#define SAVE_TEMP_SUFFIX "~new"
+#define SAVE_OLD_SUFFIX "~old"
+#define SAVE_BACKUP_SUFFIX ".bak"
 #define MAX_SHORT_NAME_LENGTH 64
 
 #define DIRECTORY_SIZE (4 * 1024)
@@ -41,6 +45,7 @@ enum FileTypes {
 	FILE_TYPE_OGG,
 	FILE_TYPE_PNG,
 	FILE_TYPE_SFO,
+	FILE_TYPE_TAR,
 	FILE_TYPE_TXT,
 	FILE_TYPE_VPK,
 	FILE_TYPE_XML,
@@ -73,6 +78,12 @@ typedef struct {
 	int (* cancelHandler)();
 } FileProcessParam;
 
+typedef struct {
+	SceOff offset;
+	void *data;
+	int size;
+} FileRange;
+
 typedef struct FileListEntry {
 	struct FileListEntry *next;
 	struct FileListEntry *previous;
@@ -100,9 +111,10 @@ typedef struct {
 int allocateReadFile(char *file, void **buffer);
 int ReadFile(char *file, void *buf, int size);
 int WriteFile(char *file, void *buf, int size);
+int writeFileRanges(char *file, FileRange *ranges, int n_ranges);
+int writeFileAtomic(char *file, int (* write)(SceUID fd, void *context), void *context, int backup);
 
 int getFileSize(char *pInputFileName);
-int getFileSha1(char *pInputFileName, uint8_t *pSha1Out, FileProcessParam *param);
 int getPathInfo(char *path, uint64_t *size, uint32_t *folders, uint32_t *files, int (* handler)(char *path));
 int removePath(char *path, FileProcessParam *param);
 int copyFile(char *src_path, char *dst_path, FileProcessParam *param);
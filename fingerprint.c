@@ -0,0 +1,520 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "file.h"
+#include "hash.h"
+#include "fingerprint.h"
+#include "language.h"
+#include "utils.h"
+
+// A fingerprint is the SHA1 of a file, or for a folder the SHA1 over the sorted
+// names, sizes and fingerprints of its children. File digests are cached by
+// path, size and modification date, so only changed files are read again
+#define FINGERPRINT_CACHE_PATH "ux0:VitaShell/internal/fingerprints.bin"
+#define FINGERPRINT_MAGIC 0x50465356 // VSFP
+#define FINGERPRINT_VERSION 1
+#define FINGERPRINT_BUCKETS 4096
+
+typedef struct FingerprintNode {
+	struct FingerprintNode *next;
+	char *path;
+	int is_folder;
+	uint64_t size;
+	uint32_t files;
+	uint32_t folders;
+	SceDateTime mtime;
+	uint8_t digest[SHA1_BLOCK_SIZE];
+	int visited;
+} FingerprintNode;
+
+typedef struct {
+	char *name;
+	SceIoStat stat;
+	FingerprintNode *node;
+} FingerprintChild;
+
+static FingerprintNode *fingerprint_cache[FINGERPRINT_BUCKETS];
+static int fingerprint_cache_length = 0;
+static int fingerprint_cache_loaded = 0;
+
+static uint32_t fingerprintHashPath(char *path) {
+	uint32_t hash = 5381;
+
+	while (*path)
+		hash = hash * 33 + (uint8_t)(*path++);
+
+	return hash % FINGERPRINT_BUCKETS;
+}
+
+static FingerprintNode *fingerprintLookup(char *path) {
+	FingerprintNode *node = fingerprint_cache[fingerprintHashPath(path)];
+
+	while (node) {
+		if (strcmp(node->path, path) == 0)
+			return node;
+
+		node = node->next;
+	}
+
+	return NULL;
+}
+
+static FingerprintNode *fingerprintInsert(char *path) {
+	FingerprintNode *node = fingerprintLookup(path);
+	if (node)
+		return node;
+
+	node = malloc(sizeof(FingerprintNode));
+	if (!node)
+		return NULL;
+
+	memset(node, 0, sizeof(FingerprintNode));
+
+	node->path = malloc(strlen(path) + 1);
+	if (!node->path) {
+		free(node);
+		return NULL;
+	}
+
+	strcpy(node->path, path);
+
+	uint32_t bucket = fingerprintHashPath(path);
+	node->next = fingerprint_cache[bucket];
+	fingerprint_cache[bucket] = node;
+	fingerprint_cache_length++;
+
+	return node;
+}
+
+void loadFingerprintCache() {
+	if (fingerprint_cache_loaded)
+		return;
+
+	fingerprint_cache_loaded = 1;
+
+	uint8_t *buffer = NULL;
+	int size = allocateReadFile(FINGERPRINT_CACHE_PATH, (void **)&buffer);
+	if (size < 0)
+		return;
+
+	uint32_t *header = (uint32_t *)buffer;
+	if (size < 8 || header[0] != FINGERPRINT_MAGIC || header[1] != FINGERPRINT_VERSION) {
+		free(buffer);
+		return;
+	}
+
+	// Records are the node without the list pointer, followed by the path
+	int offset = 8;
+	while (offset + 2 <= size) {
+		uint16_t path_length;
+		memcpy(&path_length, buffer + offset, sizeof(uint16_t));
+		offset += sizeof(uint16_t);
+
+		int record_size = path_length + sizeof(uint8_t) + sizeof(uint64_t) + 2 * sizeof(uint32_t) + sizeof(SceDateTime) + SHA1_BLOCK_SIZE;
+		if (path_length >= MAX_PATH_LENGTH || offset + record_size > size)
+			break;
+
+		char path[MAX_PATH_LENGTH];
+		memcpy(path, buffer + offset, path_length);
+		path[path_length] = '\0';
+		offset += path_length;
+
+		FingerprintNode *node = fingerprintInsert(path);
+		if (!node)
+			break;
+
+		node->is_folder = buffer[offset];
+		offset += sizeof(uint8_t);
+		memcpy(&node->size, buffer + offset, sizeof(uint64_t));
+		offset += sizeof(uint64_t);
+		memcpy(&node->files, buffer + offset, sizeof(uint32_t));
+		offset += sizeof(uint32_t);
+		memcpy(&node->folders, buffer + offset, sizeof(uint32_t));
+		offset += sizeof(uint32_t);
+		memcpy(&node->mtime, buffer + offset, sizeof(SceDateTime));
+		offset += sizeof(SceDateTime);
+		memcpy(node->digest, buffer + offset, SHA1_BLOCK_SIZE);
+		offset += SHA1_BLOCK_SIZE;
+	}
+
+	free(buffer);
+}
+
+// Drop the nodes the last pass didn't visit. Their files were removed,
+// or belong to folders that weren't compared this time
+static void pruneFingerprintCache() {
+	int i;
+	for (i = 0; i < FINGERPRINT_BUCKETS; i++) {
+		FingerprintNode **link = &fingerprint_cache[i];
+		while (*link) {
+			FingerprintNode *node = *link;
+
+			if (!node->visited) {
+				*link = node->next;
+				free(node->path);
+				free(node);
+				fingerprint_cache_length--;
+			} else {
+				node->visited = 0;
+				link = &node->next;
+			}
+		}
+	}
+}
+
+void saveFingerprintCache() {
+	int size = 8;
+	int i;
+
+	pruneFingerprintCache();
+
+	for (i = 0; i < FINGERPRINT_BUCKETS; i++) {
+		FingerprintNode *node;
+		for (node = fingerprint_cache[i]; node; node = node->next)
+			size += sizeof(uint16_t) + strlen(node->path) + sizeof(uint8_t) + sizeof(uint64_t) + 2 * sizeof(uint32_t) + sizeof(SceDateTime) + SHA1_BLOCK_SIZE;
+	}
+
+	uint8_t *buffer = malloc(size);
+	if (!buffer)
+		return;
+
+	uint32_t header[2] = { FINGERPRINT_MAGIC, FINGERPRINT_VERSION };
+	memcpy(buffer, header, sizeof(header));
+
+	int offset = 8;
+	for (i = 0; i < FINGERPRINT_BUCKETS; i++) {
+		FingerprintNode *node;
+		for (node = fingerprint_cache[i]; node; node = node->next) {
+			uint16_t path_length = strlen(node->path);
+			memcpy(buffer + offset, &path_length, sizeof(uint16_t));
+			offset += sizeof(uint16_t);
+			memcpy(buffer + offset, node->path, path_length);
+			offset += path_length;
+
+			buffer[offset] = node->is_folder;
+			offset += sizeof(uint8_t);
+			memcpy(buffer + offset, &node->size, sizeof(uint64_t));
+			offset += sizeof(uint64_t);
+			memcpy(buffer + offset, &node->files, sizeof(uint32_t));
+			offset += sizeof(uint32_t);
+			memcpy(buffer + offset, &node->folders, sizeof(uint32_t));
+			offset += sizeof(uint32_t);
+			memcpy(buffer + offset, &node->mtime, sizeof(SceDateTime));
+			offset += sizeof(SceDateTime);
+			memcpy(buffer + offset, node->digest, SHA1_BLOCK_SIZE);
+			offset += SHA1_BLOCK_SIZE;
+		}
+	}
+
+	WriteFile(FINGERPRINT_CACHE_PATH, buffer, size);
+	free(buffer);
+}
+
+static int compareChildren(const void *a, const void *b) {
+	return strcmp(((FingerprintChild *)a)->name, ((FingerprintChild *)b)->name);
+}
+
+static void freeChildren(FingerprintChild *children, int n_children) {
+	int i;
+	for (i = 0; i < n_children; i++)
+		free(children[i].name);
+
+	if (children)
+		free(children);
+}
+
+// List the children of a folder sorted by name
+static int getChildren(char *path, FingerprintChild **children, int *n_children) {
+	*children = NULL;
+	*n_children = 0;
+
+	SceUID dfd = sceIoDopen(path);
+	if (dfd < 0)
+		return dfd;
+
+	int size = 0;
+	int res = 0;
+
+	do {
+		SceIoDirent dir;
+		memset(&dir, 0, sizeof(SceIoDirent));
+
+		res = sceIoDread(dfd, &dir);
+		if (res > 0) {
+			if (*n_children == size) {
+				size = size ? size * 2 : 32;
+				FingerprintChild *new_children = realloc(*children, size * sizeof(FingerprintChild));
+				if (!new_children) {
+					res = -1;
+					break;
+				}
+
+				*children = new_children;
+			}
+
+			FingerprintChild *child = &(*children)[*n_children];
+			child->name = malloc(strlen(dir.d_name) + 1);
+			if (!child->name) {
+				res = -1;
+				break;
+			}
+
+			strcpy(child->name, dir.d_name);
+			memcpy(&child->stat, &dir.d_stat, sizeof(SceIoStat));
+			child->node = NULL;
+			(*n_children)++;
+		}
+	} while (res > 0);
+
+	sceIoDclose(dfd);
+
+	if (res < 0) {
+		freeChildren(*children, *n_children);
+		*children = NULL;
+		*n_children = 0;
+		return res;
+	}
+
+	qsort(*children, *n_children, sizeof(FingerprintChild), compareChildren);
+
+	return 1;
+}
+
+static int fingerprintPath(char *path, SceIoStat *stat, FingerprintNode **out, FileProcessParam *param) {
+	FingerprintNode *node = fingerprintLookup(path);
+
+	if (!SCE_S_ISDIR(stat->st_mode)) {
+		// Unchanged files keep their digest
+		if (node && !node->is_folder && node->size == stat->st_size && memcmp(&node->mtime, &stat->st_mtime, sizeof(SceDateTime)) == 0) {
+			if (param && param->value)
+				(*param->value) += stat->st_size / TRANSFER_SIZE;
+
+			node->visited = 1;
+
+			*out = node;
+			return 1;
+		}
+
+		HashResult result;
+		int res = getFileHashes(path, HASH_SHA1, &result, param);
+		if (res <= 0)
+			return res;
+
+		node = fingerprintInsert(path);
+		if (!node)
+			return -1;
+
+		node->is_folder = 0;
+		node->size = stat->st_size;
+		node->files = 1;
+		node->folders = 0;
+		memcpy(&node->mtime, &stat->st_mtime, sizeof(SceDateTime));
+		memcpy(node->digest, result.sha1, SHA1_BLOCK_SIZE);
+		node->visited = 1;
+
+		*out = node;
+		return 1;
+	}
+
+	FingerprintChild *children = NULL;
+	int n_children = 0;
+	int res = getChildren(path, &children, &n_children);
+	if (res < 0)
+		return res;
+
+	SHA1_CTX ctx;
+	sha1_init(&ctx);
+
+	uint64_t size = 0;
+	uint32_t files = 0, folders = 1;
+
+	int i;
+	for (i = 0; i < n_children; i++) {
+		FingerprintChild *child = &children[i];
+
+		int new_path_size = strlen(path) + strlen(child->name) + 2;
+		char *new_path = malloc(new_path_size);
+		if (!new_path) {
+			res = -1;
+			break;
+		}
+
+		snprintf(new_path, new_path_size, "%s%s%s", path, hasEndSlash(path) ? "" : "/", child->name);
+
+		res = fingerprintPath(new_path, &child->stat, &child->node, param);
+
+		free(new_path);
+
+		if (res <= 0)
+			break;
+
+		// Name, type, size and fingerprint of every child
+		uint8_t is_folder = child->node->is_folder;
+		sha1_update(&ctx, (BYTE *)child->name, strlen(child->name) + 1);
+		sha1_update(&ctx, &is_folder, sizeof(uint8_t));
+		sha1_update(&ctx, (BYTE *)&child->node->size, sizeof(uint64_t));
+		sha1_update(&ctx, child->node->digest, SHA1_BLOCK_SIZE);
+
+		size += child->node->size;
+		files += child->node->files;
+		folders += child->node->folders;
+
+		if (param && param->cancelHandler && param->cancelHandler()) {
+			res = 0;
+			break;
+		}
+	}
+
+	freeChildren(children, n_children);
+
+	if (res <= 0)
+		return res;
+
+	node = fingerprintInsert(path);
+	if (!node)
+		return -1;
+
+	node->is_folder = 1;
+	node->size = size;
+	node->files = files;
+	node->folders = folders;
+	memcpy(&node->mtime, &stat->st_mtime, sizeof(SceDateTime));
+	sha1_final(&ctx, node->digest);
+	node->visited = 1;
+
+	*out = node;
+	return 1;
+}
+
+int getPathFingerprint(char *path, uint8_t *digest, FileProcessParam *param) {
+	loadFingerprintCache();
+
+	SceIoStat stat;
+	memset(&stat, 0, sizeof(SceIoStat));
+	int res = sceIoGetstat(path, &stat);
+	if (res < 0)
+		return res;
+
+	FingerprintNode *node = NULL;
+	res = fingerprintPath(path, &stat, &node, param);
+	if (res <= 0)
+		return res;
+
+	memcpy(digest, node->digest, SHA1_BLOCK_SIZE);
+
+	return 1;
+}
+
+static void appendDifference(FingerprintCompareResult *result, char *format, char *name) {
+	result->differences++;
+
+	char line[MAX_PATH_LENGTH + 32];
+	line[0] = '\n';
+	snprintf(line + 1, sizeof(line) - 1, format, name);
+
+	int len = strlen(result->report);
+	if (len + strlen(line) < sizeof(result->report))
+		strcpy(result->report + len, line);
+}
+
+// Walk both trees top-down and only descend into folders whose fingerprints differ
+static void compareNodes(char *path_a, char *path_b, char *name, FingerprintCompareResult *result) {
+	FingerprintNode *node_a = fingerprintLookup(path_a);
+	FingerprintNode *node_b = fingerprintLookup(path_b);
+
+	if (node_a && node_b && memcmp(node_a->digest, node_b->digest, SHA1_BLOCK_SIZE) == 0)
+		return;
+
+	if (!node_a || !node_b || !node_a->is_folder || !node_b->is_folder) {
+		appendDifference(result, language_container[COMPARE_DIFFERENT], name);
+		return;
+	}
+
+	FingerprintChild *children_a = NULL, *children_b = NULL;
+	int n_children_a = 0, n_children_b = 0;
+	getChildren(path_a, &children_a, &n_children_a);
+	getChildren(path_b, &children_b, &n_children_b);
+
+	int i = 0, j = 0;
+	while (i < n_children_a || j < n_children_b) {
+		int cmp;
+		if (i == n_children_a) {
+			cmp = 1;
+		} else if (j == n_children_b) {
+			cmp = -1;
+		} else {
+			cmp = strcmp(children_a[i].name, children_b[j].name);
+		}
+
+		char *child_name = cmp <= 0 ? children_a[i].name : children_b[j].name;
+
+		char new_name[MAX_PATH_LENGTH];
+		snprintf(new_name, MAX_PATH_LENGTH, "%s%s%s", name, name[0] ? "/" : "", child_name);
+
+		if (cmp < 0) {
+			appendDifference(result, language_container[COMPARE_ONLY_IN_FIRST], new_name);
+			i++;
+		} else if (cmp > 0) {
+			appendDifference(result, language_container[COMPARE_ONLY_IN_SECOND], new_name);
+			j++;
+		} else {
+			int new_path_a_size = strlen(path_a) + strlen(child_name) + 2;
+			int new_path_b_size = strlen(path_b) + strlen(child_name) + 2;
+			char *new_path_a = malloc(new_path_a_size);
+			char *new_path_b = malloc(new_path_b_size);
+
+			if (new_path_a && new_path_b) {
+				snprintf(new_path_a, new_path_a_size, "%s%s%s", path_a, hasEndSlash(path_a) ? "" : "/", child_name);
+				snprintf(new_path_b, new_path_b_size, "%s%s%s", path_b, hasEndSlash(path_b) ? "" : "/", child_name);
+				compareNodes(new_path_a, new_path_b, new_name, result);
+			}
+
+			if (new_path_a)
+				free(new_path_a);
+			if (new_path_b)
+				free(new_path_b);
+
+			i++;
+			j++;
+		}
+	}
+
+	freeChildren(children_a, n_children_a);
+	freeChildren(children_b, n_children_b);
+}
+
+int compareFingerprints(char *path_a, char *path_b, FingerprintCompareResult *result, FileProcessParam *param) {
+	memset(result, 0, sizeof(FingerprintCompareResult));
+
+	uint8_t digest_a[SHA1_BLOCK_SIZE], digest_b[SHA1_BLOCK_SIZE];
+
+	int res = getPathFingerprint(path_a, digest_a, param);
+	if (res <= 0)
+		return res;
+
+	res = getPathFingerprint(path_b, digest_b, param);
+	if (res <= 0)
+		return res;
+
+	saveFingerprintCache();
+
+	compareNodes(path_a, path_b, "", result);
+
+	return 1;
+}
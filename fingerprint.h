@@ -0,0 +1,36 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FINGERPRINT_H__
+#define __FINGERPRINT_H__
+
+#include "file.h"
+#include "sha1.h"
+
+typedef struct {
+	int differences;
+	char report[384];
+} FingerprintCompareResult;
+
+int getPathFingerprint(char *path, uint8_t *digest, FileProcessParam *param);
+int compareFingerprints(char *path_a, char *path_b, FingerprintCompareResult *result, FileProcessParam *param);
+
+void loadFingerprintCache();
+void saveFingerprintCache();
+
+#endif
@@ -0,0 +1,736 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "file.h"
+#include "hash.h"
+#include "language.h"
+#include "utils.h"
+
+#include <zlib.h>
+
+void hashInit(HashContext *ctx, int algorithms) {
+	ctx->algorithms = algorithms;
+
+	if (algorithms & HASH_CRC32)
+		ctx->crc32 = crc32(0, Z_NULL, 0);
+
+	if (algorithms & HASH_MD5)
+		md5_init(&ctx->md5);
+
+	if (algorithms & HASH_SHA1)
+		sha1_init(&ctx->sha1);
+
+	if (algorithms & HASH_SHA256)
+		sha256_init(&ctx->sha256);
+}
+
+void hashUpdate(HashContext *ctx, const void *data, SceSize size) {
+	if (ctx->algorithms & HASH_CRC32)
+		ctx->crc32 = crc32(ctx->crc32, data, size);
+
+	if (ctx->algorithms & HASH_MD5)
+		md5_update(&ctx->md5, data, size);
+
+	if (ctx->algorithms & HASH_SHA1)
+		sha1_update(&ctx->sha1, data, size);
+
+	if (ctx->algorithms & HASH_SHA256)
+		sha256_update(&ctx->sha256, data, size);
+}
+
+void hashFinal(HashContext *ctx, HashResult *result) {
+	memset(result, 0, sizeof(HashResult));
+	result->algorithms = ctx->algorithms;
+
+	if (ctx->algorithms & HASH_CRC32)
+		result->crc32 = ctx->crc32;
+
+	if (ctx->algorithms & HASH_MD5)
+		md5_final(&ctx->md5, result->md5);
+
+	if (ctx->algorithms & HASH_SHA1)
+		sha1_final(&ctx->sha1, result->sha1);
+
+	if (ctx->algorithms & HASH_SHA256)
+		sha256_final(&ctx->sha256, result->sha256);
+}
+
+int getFileHashes(char *path, int algorithms, HashResult *result, FileProcessParam *param) {
+	HashContext ctx;
+	hashInit(&ctx, algorithms);
+
+	SceUID fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+	if (fd < 0)
+		return fd;
+
+	void *buf = malloc(TRANSFER_SIZE);
+
+	uint64_t seek = 0;
+
+	YieldState yield;
+	initYield(&yield, 1);
+
+	while (1) {
+		int read = sceIoRead(fd, buf, TRANSFER_SIZE);
+		if (read == SCE_ERROR_ERRNO_ENODEV) {
+			fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+			if (fd >= 0) {
+				sceIoLseek(fd, seek, SCE_SEEK_SET);
+				read = sceIoRead(fd, buf, TRANSFER_SIZE);
+			}
+		}
+
+		if (read < 0) {
+			free(buf);
+			sceIoClose(fd);
+			return read;
+		}
+
+		if (read == 0)
+			break;
+
+		hashUpdate(&ctx, buf, read);
+
+		seek += read;
+
+		if (param) {
+			// Progress is counted in TRANSFER_SIZE blocks
+			if (param->value)
+				(*param->value)++;
+
+			if (param->SetProgress)
+				param->SetProgress(param->value ? *param->value : 0, param->max);
+
+			if (param->cancelHandler && param->cancelHandler()) {
+				free(buf);
+				sceIoClose(fd);
+				return 0;
+			}
+
+		}
+
+		// This is CPU intensive so the progress bar won't refresh unless we yield
+		yieldIfNeeded(&yield);
+	}
+
+	hashFinal(&ctx, result);
+
+	free(buf);
+	sceIoClose(fd);
+
+	return 1;
+}
+
+static void hexToString(uint8_t *data, int size, char *string) {
+	int i;
+	for (i = 0; i < size; i++)
+		sprintf(string + i * 2, "%02x", data[i]);
+}
+
+static int writeHashFile(char *path, char *ext, char *line) {
+	char hash_path[MAX_PATH_LENGTH];
+	snprintf(hash_path, MAX_PATH_LENGTH, "%s.%s", path, ext);
+	return WriteFile(hash_path, line, strlen(line));
+}
+
+// Write .sfv, .md5, .sha1 and .sha256 files next to the file, in the format
+// of cksfv and md5sum/sha1sum/sha256sum
+int writeHashFiles(char *path, HashResult *result) {
+	char line[MAX_PATH_LENGTH + 2 * SHA256_BLOCK_SIZE + 8];
+	char hex[2 * SHA256_BLOCK_SIZE + 1];
+	int res;
+
+	char *name = strrchr(path, '/');
+	if (!name)
+		name = strchr(path, ':');
+	name = name ? name + 1 : path;
+
+	if (result->algorithms & HASH_CRC32) {
+		snprintf(line, sizeof(line), "%s %08X\n", name, (unsigned int)result->crc32);
+		res = writeHashFile(path, "sfv", line);
+		if (res < 0)
+			return res;
+	}
+
+	if (result->algorithms & HASH_MD5) {
+		hexToString(result->md5, MD5_BLOCK_SIZE, hex);
+		snprintf(line, sizeof(line), "%s *%s\n", hex, name);
+		res = writeHashFile(path, "md5", line);
+		if (res < 0)
+			return res;
+	}
+
+	if (result->algorithms & HASH_SHA1) {
+		hexToString(result->sha1, SHA1_BLOCK_SIZE, hex);
+		snprintf(line, sizeof(line), "%s *%s\n", hex, name);
+		res = writeHashFile(path, "sha1", line);
+		if (res < 0)
+			return res;
+	}
+
+	if (result->algorithms & HASH_SHA256) {
+		hexToString(result->sha256, SHA256_BLOCK_SIZE, hex);
+		snprintf(line, sizeof(line), "%s *%s\n", hex, name);
+		res = writeHashFile(path, "sha256", line);
+		if (res < 0)
+			return res;
+	}
+
+	return 1;
+}
+
+// Long digests are split into lines of 32 characters to fit into the dialog
+static void appendHash(char *string, int size, char *name, uint8_t *data, int data_size) {
+	char hex[2 * SHA256_BLOCK_SIZE + 1];
+	int len = strlen(string);
+	int i;
+
+	for (i = 0; i < data_size; i++)
+		sprintf(hex + i * 2, "%02X", data[i]);
+
+	len += snprintf(string + len, size - len, "%s%s: %.32s", len > 0 ? "\n" : "", name, hex);
+
+	for (i = 32; i < 2 * data_size && len < size; i += 32)
+		len += snprintf(string + len, size - len, "\n%.32s", hex + i);
+}
+
+void hashToString(HashResult *result, char *string, int size) {
+	string[0] = '\0';
+
+	if (result->algorithms & HASH_CRC32) {
+		uint8_t crc[4];
+		crc[0] = result->crc32 >> 24;
+		crc[1] = result->crc32 >> 16;
+		crc[2] = result->crc32 >> 8;
+		crc[3] = result->crc32;
+		appendHash(string, size, "CRC32", crc, sizeof(crc));
+	}
+
+	if (result->algorithms & HASH_MD5)
+		appendHash(string, size, "MD5", result->md5, MD5_BLOCK_SIZE);
+
+	if (result->algorithms & HASH_SHA1)
+		appendHash(string, size, "SHA1", result->sha1, SHA1_BLOCK_SIZE);
+
+	if (result->algorithms & HASH_SHA256)
+		appendHash(string, size, "SHA256", result->sha256, SHA256_BLOCK_SIZE);
+}
+
+// Batch hashing reads on its own thread, so the reads of the next blocks
+// and files overlap the digest of the current one
+#define HASH_BLOCK_SIZE (128 * 1024)
+#define HASH_N_BLOCKS 4
+
+typedef struct {
+	int file;
+	int size;
+	int last;
+	uint8_t *data;
+} HashBlock;
+
+typedef struct {
+	HashPathList *list;
+	HashBlock blocks[HASH_N_BLOCKS];
+	SceUID free_sema;
+	SceUID full_sema;
+	volatile int quit;
+} HashReader;
+
+static int hashReadBlock(SceUID *fd, char *path, uint64_t seek, HashBlock *block) {
+	int read = sceIoRead(*fd, block->data, HASH_BLOCK_SIZE);
+	if (read == SCE_ERROR_ERRNO_ENODEV) {
+		*fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+		if (*fd < 0)
+			return *fd;
+
+		sceIoLseek(*fd, seek, SCE_SEEK_SET);
+		read = sceIoRead(*fd, block->data, HASH_BLOCK_SIZE);
+	}
+
+	return read;
+}
+
+static int hash_read_thread(SceSize args, void *argp) {
+	HashReader *reader = *(HashReader **)argp;
+	int n_blocks = 0;
+
+	int i;
+	for (i = 0; i < reader->list->length; i++) {
+		char *path = reader->list->paths[i];
+		SceUID fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+		uint64_t seek = 0;
+
+		// A failed open is passed on as a last block carrying the error
+		int last = 0;
+		while (!last) {
+			sceKernelWaitSema(reader->free_sema, 1, NULL);
+			if (reader->quit)
+				break;
+
+			HashBlock *block = &reader->blocks[n_blocks++ % HASH_N_BLOCKS];
+			block->file = i;
+			block->size = fd < 0 ? fd : hashReadBlock(&fd, path, seek, block);
+			block->last = last = (block->size <= 0);
+
+			if (block->size > 0)
+				seek += block->size;
+
+			sceKernelSignalSema(reader->full_sema, 1);
+		}
+
+		if (fd >= 0)
+			sceIoClose(fd);
+
+		if (reader->quit)
+			break;
+	}
+
+	return sceKernelExitDeleteThread(0);
+}
+
+static void hashReaderClose(HashReader *reader, SceUID thid) {
+	int i;
+
+	if (thid >= 0) {
+		reader->quit = 1;
+		sceKernelSignalSema(reader->free_sema, 1);
+		sceKernelWaitThreadEnd(thid, NULL, NULL);
+	}
+
+	for (i = 0; i < HASH_N_BLOCKS; i++) {
+		if (reader->blocks[i].data)
+			free(reader->blocks[i].data);
+	}
+
+	if (reader->free_sema >= 0)
+		sceKernelDeleteSema(reader->free_sema);
+	if (reader->full_sema >= 0)
+		sceKernelDeleteSema(reader->full_sema);
+
+	free(reader);
+}
+
+// Hash every file of the list. Read errors are stored per file in errors
+int hashPathList(HashPathList *list, int algorithms, HashResult *results, int *errors, FileProcessParam *param) {
+	HashReader *reader = malloc(sizeof(HashReader));
+	if (!reader)
+		return -1;
+
+	memset(reader, 0, sizeof(HashReader));
+	reader->list = list;
+	reader->free_sema = sceKernelCreateSema("hash_free_sema", 0, HASH_N_BLOCKS, HASH_N_BLOCKS + 1, NULL);
+	reader->full_sema = sceKernelCreateSema("hash_full_sema", 0, 0, HASH_N_BLOCKS, NULL);
+
+	int i;
+	for (i = 0; i < HASH_N_BLOCKS; i++) {
+		reader->blocks[i].data = malloc(HASH_BLOCK_SIZE);
+		if (!reader->blocks[i].data) {
+			hashReaderClose(reader, -1);
+			return -1;
+		}
+	}
+
+	if (reader->free_sema < 0 || reader->full_sema < 0) {
+		hashReaderClose(reader, -1);
+		return -1;
+	}
+
+	SceUID thid = sceKernelCreateThread("hash_read_thread", (SceKernelThreadEntry)hash_read_thread, 0x40, 0x4000, 0, 0, NULL);
+	if (thid < 0) {
+		hashReaderClose(reader, -1);
+		return thid;
+	}
+
+	sceKernelStartThread(thid, sizeof(HashReader *), &reader);
+
+	HashContext ctx;
+	int file = -1, n_blocks = 0, done = 0, res = 1;
+
+	YieldState yield;
+	initYield(&yield, 1);
+
+	while (done < list->length) {
+		sceKernelWaitSema(reader->full_sema, 1, NULL);
+		HashBlock *block = &reader->blocks[n_blocks++ % HASH_N_BLOCKS];
+
+		if (block->file != file) {
+			file = block->file;
+			hashInit(&ctx, algorithms);
+		}
+
+		if (block->size > 0) {
+			hashUpdate(&ctx, block->data, block->size);
+
+			if (param && param->value)
+				(*param->value) += block->size;
+		}
+
+		if (block->last) {
+			errors[file] = block->size < 0 ? block->size : 0;
+			hashFinal(&ctx, &results[file]);
+			file = -1;
+			done++;
+		}
+
+		sceKernelSignalSema(reader->free_sema, 1);
+
+		if (param) {
+			if (param->SetProgress)
+				param->SetProgress(param->value ? *param->value : 0, param->max);
+
+			if (param->cancelHandler && param->cancelHandler()) {
+				res = 0;
+				break;
+			}
+		}
+
+		yieldIfNeeded(&yield);
+	}
+
+	hashReaderClose(reader, thid);
+
+	return res;
+}
+
+int hashPathListAdd(HashPathList *list, char *path) {
+	if (list->length == list->size) {
+		int size = list->size ? list->size * 2 : 64;
+		char **paths = realloc(list->paths, size * sizeof(char *));
+		if (!paths)
+			return -1;
+
+		list->paths = paths;
+		list->size = size;
+	}
+
+	list->paths[list->length] = malloc(strlen(path) + 1);
+	if (!list->paths[list->length])
+		return -1;
+
+	strcpy(list->paths[list->length++], path);
+
+	return 1;
+}
+
+// Add a file or all files of a folder
+int hashPathListAddPath(HashPathList *list, char *path) {
+	SceUID dfd = sceIoDopen(path);
+	if (dfd < 0)
+		return hashPathListAdd(list, path);
+
+	int res = 0;
+
+	do {
+		SceIoDirent dir;
+		memset(&dir, 0, sizeof(SceIoDirent));
+
+		res = sceIoDread(dfd, &dir);
+		if (res > 0) {
+			char *new_path = malloc(strlen(path) + strlen(dir.d_name) + 2);
+			snprintf(new_path, MAX_PATH_LENGTH, "%s%s%s", path, hasEndSlash(path) ? "" : "/", dir.d_name);
+
+			int ret;
+			if (SCE_S_ISDIR(dir.d_stat.st_mode)) {
+				ret = hashPathListAddPath(list, new_path);
+			} else {
+				ret = hashPathListAdd(list, new_path);
+			}
+
+			free(new_path);
+
+			if (ret < 0) {
+				sceIoDclose(dfd);
+				return ret;
+			}
+		}
+	} while (res > 0);
+
+	sceIoDclose(dfd);
+
+	return 1;
+}
+
+void hashPathListFree(HashPathList *list) {
+	int i;
+	for (i = 0; i < list->length; i++)
+		free(list->paths[i]);
+
+	if (list->paths)
+		free(list->paths);
+
+	memset(list, 0, sizeof(HashPathList));
+}
+
+// Write a sha1sum manifest of all files in the list. Names are stored relative
+// to the folder of the manifest
+// Failed files are listed one per line as long as they fit
+static void appendReport(char *report, int size, char *format, char *name) {
+	char line[MAX_PATH_LENGTH + 32];
+	line[0] = '\n';
+	snprintf(line + 1, sizeof(line) - 1, format, name);
+
+	int len = strlen(report);
+	if (len + strlen(line) < size)
+		strcpy(report + len, line);
+}
+
+int writeHashManifest(char *manifest_path, HashPathList *list, HashManifestResult *result, FileProcessParam *param) {
+	memset(result, 0, sizeof(HashManifestResult));
+
+	int res = 0;
+
+	HashResult *results = malloc(list->length * sizeof(HashResult));
+	int *errors = malloc(list->length * sizeof(int));
+	if (!results || !errors) {
+		res = -1;
+		goto EXIT;
+	}
+
+	res = hashPathList(list, HASH_SHA1, results, errors, param);
+	if (res <= 0)
+		goto EXIT;
+
+	SceUID fd = sceIoOpen(manifest_path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+	if (fd < 0) {
+		res = fd;
+		goto EXIT;
+	}
+
+	char *name_start = strrchr(manifest_path, '/');
+	int base_length = name_start ? (name_start - manifest_path + 1) : 0;
+
+	res = 1;
+
+	int i;
+	for (i = 0; i < list->length; i++) {
+		// Unreadable files are left out and reported
+		if (errors[i] < 0) {
+			result->skipped++;
+			appendReport(result->report, sizeof(result->report), language_container[HASH_MANIFEST_UNREADABLE], list->paths[i] + base_length);
+			continue;
+		}
+
+		char hex[2 * SHA1_BLOCK_SIZE + 1];
+		hexToString(results[i].sha1, SHA1_BLOCK_SIZE, hex);
+
+		char line[MAX_PATH_LENGTH + 2 * SHA1_BLOCK_SIZE + 4];
+		snprintf(line, sizeof(line), "%s *%s\n", hex, list->paths[i] + base_length);
+
+		res = sceIoWrite(fd, line, strlen(line));
+		if (res < 0)
+			break;
+
+		result->written++;
+		res = 1;
+	}
+
+	sceIoClose(fd);
+
+EXIT:
+	if (errors)
+		free(errors);
+	if (results)
+		free(results);
+
+	return res;
+}
+
+static int hexDigit(char c) {
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static int getHashAlgorithm(int length) {
+	switch (length) {
+		case 2 * MD5_BLOCK_SIZE:
+			return HASH_MD5;
+		case 2 * SHA1_BLOCK_SIZE:
+			return HASH_SHA1;
+		case 2 * SHA256_BLOCK_SIZE:
+			return HASH_SHA256;
+	}
+
+	return 0;
+}
+
+static int getHashSize(int algorithm) {
+	switch (algorithm) {
+		case HASH_MD5:
+			return MD5_BLOCK_SIZE;
+		case HASH_SHA1:
+			return SHA1_BLOCK_SIZE;
+		case HASH_SHA256:
+			return SHA256_BLOCK_SIZE;
+	}
+
+	return 0;
+}
+
+static uint8_t *getHashDigest(HashResult *result, int algorithm) {
+	switch (algorithm) {
+		case HASH_MD5:
+			return result->md5;
+		case HASH_SHA1:
+			return result->sha1;
+		case HASH_SHA256:
+			return result->sha256;
+	}
+
+	return NULL;
+}
+
+
+// Read the files and digests of a md5sum, sha1sum or sha256sum manifest
+int readHashManifest(char *manifest_path, HashManifest *manifest) {
+	memset(manifest, 0, sizeof(HashManifest));
+
+	char *buffer = NULL;
+	int size = allocateReadFile(manifest_path, (void **)&buffer);
+	if (size < 0)
+		return size;
+
+	char *name_start = strrchr(manifest_path, '/');
+	manifest->base_length = name_start ? (name_start - manifest_path + 1) : 0;
+
+	int res = 1;
+
+	// Lines are '<hex> *<name>' or '<hex>  <name>'
+	char *line = buffer, *end = buffer + size;
+	while (line < end) {
+		char *next = memchr(line, '\n', end - line);
+		if (!next)
+			next = end;
+
+		int length = next - line;
+		if (length > 0 && line[length - 1] == '\r')
+			length--;
+
+		int hex_length = 0;
+		while (hex_length < length && hexDigit(line[hex_length]) >= 0)
+			hex_length++;
+
+		int algorithm = getHashAlgorithm(hex_length);
+		if (algorithm && hex_length + 2 < length && line[hex_length] == ' ') {
+			if (manifest->list.length == manifest->list.size) {
+				int new_size = manifest->list.size ? manifest->list.size * 2 : 64;
+
+				void *digests = realloc(manifest->digests, new_size * sizeof(*manifest->digests));
+				if (digests)
+					manifest->digests = digests;
+
+				void *algorithms = realloc(manifest->algorithms, new_size * sizeof(int));
+				if (algorithms)
+					manifest->algorithms = algorithms;
+
+				if (!digests || !algorithms) {
+					res = -1;
+					break;
+				}
+			}
+
+			int n = manifest->list.length;
+
+			int i;
+			for (i = 0; i < hex_length / 2; i++)
+				manifest->digests[n][i] = (hexDigit(line[i * 2]) << 4) | hexDigit(line[i * 2 + 1]);
+
+			manifest->algorithms[n] = algorithm;
+			manifest->all_algorithms |= algorithm;
+
+			char path[MAX_PATH_LENGTH];
+			char *name = line + hex_length + 2;
+			snprintf(path, MAX_PATH_LENGTH, "%.*s%.*s", manifest->base_length, manifest_path, (int)(line + length - name), name);
+
+			res = hashPathListAdd(&manifest->list, path);
+			if (res < 0)
+				break;
+		}
+
+		line = next + 1;
+	}
+
+	free(buffer);
+
+	if (res < 0)
+		freeHashManifest(manifest);
+
+	return res;
+}
+
+void freeHashManifest(HashManifest *manifest) {
+	hashPathListFree(&manifest->list);
+
+	if (manifest->algorithms)
+		free(manifest->algorithms);
+	if (manifest->digests)
+		free(manifest->digests);
+
+	memset(manifest, 0, sizeof(HashManifest));
+}
+
+// Hash the files of a manifest and compare them to the stored digests
+int verifyHashManifest(HashManifest *manifest, HashVerifyResult *result, FileProcessParam *param) {
+	memset(result, 0, sizeof(HashVerifyResult));
+
+	HashPathList *list = &manifest->list;
+	if (list->length == 0)
+		return 1;
+
+	int res = 0;
+
+	HashResult *results = malloc(list->length * sizeof(HashResult));
+	int *errors = malloc(list->length * sizeof(int));
+	if (!results || !errors) {
+		res = -1;
+		goto EXIT;
+	}
+
+	res = hashPathList(list, manifest->all_algorithms, results, errors, param);
+	if (res <= 0)
+		goto EXIT;
+
+	int i;
+	for (i = 0; i < list->length; i++) {
+		char *name = list->paths[i] + manifest->base_length;
+		int algorithm = manifest->algorithms[i];
+
+		if (errors[i] < 0) {
+			result->missing++;
+			appendReport(result->report, sizeof(result->report), language_container[HASH_VERIFY_MISSING], name);
+		} else if (memcmp(getHashDigest(&results[i], algorithm), manifest->digests[i], getHashSize(algorithm)) != 0) {
+			result->mismatched++;
+			appendReport(result->report, sizeof(result->report), language_container[HASH_VERIFY_FAILED], name);
+		} else {
+			result->ok++;
+		}
+	}
+
+EXIT:
+	if (errors)
+		free(errors);
+	if (results)
+		free(results);
+
+	return res;
+}
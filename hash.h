@@ -0,0 +1,97 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include "file.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+
+enum HashAlgorithms {
+	HASH_CRC32  = 0x1,
+	HASH_MD5    = 0x2,
+	HASH_SHA1   = 0x4,
+	HASH_SHA256 = 0x8,
+};
+
+// All selected digests are fed from the same buffer, so the file is only read once
+typedef struct {
+	int algorithms;
+	uint32_t crc32;
+	MD5_CTX md5;
+	SHA1_CTX sha1;
+	SHA256_CTX sha256;
+} HashContext;
+
+typedef struct {
+	int algorithms;
+	uint32_t crc32;
+	uint8_t md5[MD5_BLOCK_SIZE];
+	uint8_t sha1[SHA1_BLOCK_SIZE];
+	uint8_t sha256[SHA256_BLOCK_SIZE];
+} HashResult;
+
+void hashInit(HashContext *ctx, int algorithms);
+void hashUpdate(HashContext *ctx, const void *data, SceSize size);
+void hashFinal(HashContext *ctx, HashResult *result);
+
+typedef struct {
+	char **paths;
+	int length;
+	int size;
+} HashPathList;
+
+typedef struct {
+	HashPathList list;
+	uint8_t (*digests)[SHA256_BLOCK_SIZE];
+	int *algorithms;
+	int all_algorithms;
+	int base_length;
+} HashManifest;
+
+typedef struct {
+	int ok;
+	int mismatched;
+	int missing;
+	char report[384];
+} HashVerifyResult;
+
+typedef struct {
+	int written;
+	int skipped;
+	char report[384];
+} HashManifestResult;
+
+int getFileHashes(char *path, int algorithms, HashResult *result, FileProcessParam *param);
+int writeHashFiles(char *path, HashResult *result);
+void hashToString(HashResult *result, char *string, int size);
+
+int hashPathListAdd(HashPathList *list, char *path);
+int hashPathListAddPath(HashPathList *list, char *path);
+void hashPathListFree(HashPathList *list);
+
+int hashPathList(HashPathList *list, int algorithms, HashResult *results, int *errors, FileProcessParam *param);
+int writeHashManifest(char *manifest_path, HashPathList *list, HashManifestResult *result, FileProcessParam *param);
+
+int readHashManifest(char *manifest_path, HashManifest *manifest);
+void freeHashManifest(HashManifest *manifest);
+int verifyHashManifest(HashManifest *manifest, HashVerifyResult *result, FileProcessParam *param);
+
+#endif
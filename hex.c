@@ -25,6 +25,7 @@
 #include "theme.h"
 #include "language.h"
 #include "utils.h"
+#include "ime_dialog.h"
 
 void hexListAddEntry(HexList *list, HexListEntry *entry) {
 	entry->next = NULL;
@@ -71,24 +72,230 @@ HexListEntry *hexListGetNthEntry(HexList *list, int n) {
 	return entry;
 }
 
-int hexViewer(char *file) {
-	int text_viewer = 0;
+static int hexOpenFile(HexFile *hex, char *file) {
+	memset(hex, 0, sizeof(HexFile));
+	hex->in_archive = isInArchive();
+
+	SceIoStat stat;
+	memset(&stat, 0, sizeof(SceIoStat));
+
+	int res = hex->in_archive ? archiveFileGetstat(file, &stat) : sceIoGetstat(file, &stat);
+	if (res < 0)
+		return res;
+
+	hex->fd = hex->in_archive ? archiveFileOpen(file, SCE_O_RDONLY, 0) : sceIoOpen(file, SCE_O_RDONLY, 0);
+	if (hex->fd < 0)
+		return hex->fd;
+
+	hex->size = stat.st_size;
+
+	return 0;
+}
+
+static void hexCloseFile(HexFile *hex) {
+	if (hex->in_archive)
+		archiveFileClose(hex->fd);
+	else
+		sceIoClose(hex->fd);
+
+	int i;
+	for (i = 0; i < HEX_CACHE_PAGES; i++)
+		free(hex->pages[i].data);
+
+	free(hex->edits);
+}
+
+// Cached page containing offset, read from the file if it isn't there
+static HexPage *hexGetPage(HexFile *hex, SceOff offset) {
+	SceOff page_offset = offset - offset % HEX_PAGE_SIZE;
+	HexPage *page = &hex->pages[0];
+
+	int i;
+	for (i = 0; i < HEX_CACHE_PAGES; i++) {
+		HexPage *current = &hex->pages[i];
+
+		if (current->size > 0 && current->offset == page_offset) {
+			page = current;
+			break;
+		}
+
+		// An unused or the least recently used one is replaced
+		if (page->size > 0 && (current->size == 0 || current->last_use < page->last_use))
+			page = current;
+	}
+
+	if (i == HEX_CACHE_PAGES) {
+		page->size = 0;
+
+		if (!page->data) {
+			page->data = malloc(HEX_PAGE_SIZE);
+			if (!page->data)
+				return NULL;
+		}
+
+		SceOff pos = hex->in_archive ? archiveFileLseek(hex->fd, page_offset, SCE_SEEK_SET) : sceIoLseek(hex->fd, page_offset, SCE_SEEK_SET);
+		if (pos < 0)
+			return NULL;
+
+		// Archive reads may return less than asked for
+		int size = 0;
+		while (size < HEX_PAGE_SIZE) {
+			int read = hex->in_archive ? archiveFileRead(hex->fd, page->data + size, HEX_PAGE_SIZE - size) : sceIoRead(hex->fd, page->data + size, HEX_PAGE_SIZE - size);
+			if (read <= 0)
+				break;
+
+			size += read;
+		}
+
+		if (size == 0)
+			return NULL;
+
+		page->offset = page_offset;
+		page->size = size;
+	}
+
+	page->last_use = ++hex->page_clock;
+
+	return page;
+}
+
+// Load the page the view moves into next before it gets there
+static void hexReadAhead(HexFile *hex, SceOff offset, int direction) {
+	SceOff next = offset - offset % HEX_PAGE_SIZE + direction * HEX_PAGE_SIZE;
+
+	if (next >= 0 && next < hex->size)
+		hexGetPage(hex, next);
+}
+
+// First edit at or after offset
+static int hexFindEdit(HexFile *hex, SceOff offset) {
+	int low = 0, high = hex->n_edits;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+
+		if (hex->edits[mid].offset < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static int hexSetByte(HexFile *hex, SceOff offset, uint8_t value) {
+	int i = hexFindEdit(hex, offset);
+
+	if (i < hex->n_edits && hex->edits[i].offset == offset) {
+		hex->edits[i].value = value;
+		return 0;
+	}
+
+	if (hex->n_edits == hex->max_edits) {
+		int max_edits = hex->max_edits + HEX_EDITS_CHUNK;
+		HexEdit *edits = realloc(hex->edits, max_edits * sizeof(HexEdit));
+		if (!edits)
+			return -1;
+
+		hex->edits = edits;
+		hex->max_edits = max_edits;
+	}
+
+	memmove(&hex->edits[i + 1], &hex->edits[i], (hex->n_edits - i) * sizeof(HexEdit));
+	hex->n_edits++;
+
+	hex->edits[i].offset = offset;
+	hex->edits[i].value = value;
+
+	return 0;
+}
+
+// Row of 0x10 bytes at offset with the edits on top, zeros behind the end
+static void hexReadRow(HexFile *hex, SceOff offset, uint8_t *data) {
+	memset(data, 0, 0x10);
 
-	uint8_t *buffer = malloc(BIG_BUFFER_SIZE);
-	if (!buffer)
+	HexPage *page = hexGetPage(hex, offset);
+	if (page) {
+		int rel = (int)(offset - page->offset);
+		memcpy(data, page->data + rel, MIN(0x10, MAX(page->size - rel, 0)));
+	}
+
+	int i;
+	for (i = hexFindEdit(hex, offset); i < hex->n_edits && hex->edits[i].offset < offset + 0x10; i++)
+		data[hex->edits[i].offset - offset] = hex->edits[i].value;
+}
+
+static void hexReadRows(HexFile *hex, HexList *list, SceOff offset) {
+	HexListEntry *entry = list->head;
+
+	int i;
+	for (i = 0; i < 0x10; i++) {
+		hexReadRow(hex, offset + i * 0x10, entry->data);
+		entry = entry->next;
+	}
+}
+
+// Write the edited bytes into the file, after copying it to a backup if set
+static int hexSave(char *file, HexFile *hex) {
+	if (hex->n_edits == 0)
+		return 0;
+
+	if (vitashell_config.editor_backup) {
+		char backup_path[MAX_PATH_LENGTH];
+		snprintf(backup_path, MAX_PATH_LENGTH, "%s%s", file, SAVE_BACKUP_SUFFIX);
+
+		int res = copyFile(file, backup_path, NULL);
+		if (res < 0)
+			return res;
+	}
+
+	FileRange *ranges = malloc(hex->n_edits * sizeof(FileRange));
+	uint8_t *values = malloc(hex->n_edits);
+	if (!ranges || !values) {
+		free(values);
+		free(ranges);
 		return -1;
+	}
 
-	int size = 0;
+	// Neighbouring bytes are written at once
+	int n_ranges = 0;
 
-	if (isInArchive()) {
-		size = ReadArchiveFile(file, buffer, BIG_BUFFER_SIZE);
-	} else {
-		size = ReadFile(file, buffer, BIG_BUFFER_SIZE);
+	int i;
+	for (i = 0; i < hex->n_edits; i++) {
+		values[i] = hex->edits[i].value;
+
+		if (n_ranges > 0 && ranges[n_ranges - 1].offset + ranges[n_ranges - 1].size == hex->edits[i].offset) {
+			ranges[n_ranges - 1].size++;
+		} else {
+			ranges[n_ranges].offset = hex->edits[i].offset;
+			ranges[n_ranges].data = values + i;
+			ranges[n_ranges].size = 1;
+			n_ranges++;
+		}
 	}
 
+	int res = writeFileRanges(file, ranges, n_ranges);
+
+	free(values);
+	free(ranges);
+
+	return res;
+}
+
+int hexViewer(char *file) {
+	int text_viewer = 0;
+
+	// Pages of the file are read as they are shown
+	HexFile hex;
+	int res = hexOpenFile(&hex, file);
+	if (res < 0)
+		return res;
+
+	SceOff size = hex.size;
+
 	if (size <= 0) {
-		free(buffer);
-		return size;
+		hexCloseFile(&hex);
+		return 0;
 	}
 
 	int modify_allowed = 1;
@@ -99,8 +306,11 @@ int hexViewer(char *file) {
 
 	int changed = 0;
 	int save_question = 0;
+	int save_res = 0;
+	int offset_input = 0;
 
-	int base_pos = 0, rel_pos = 0;
+	SceOff base_pos = 0;
+	int rel_pos = 0;
 	uint8_t nibble_pos = 0;
 
 	HexList list;
@@ -109,10 +319,11 @@ int hexViewer(char *file) {
 	int i;
 	for (i = 0; i < 0x10; i++) {
 		HexListEntry *entry = malloc(sizeof(HexListEntry));
-		memcpy(entry->data, buffer + i * 0x10, 0x10);
 		hexListAddEntry(&list, entry);
 	}
 
+	hexReadRows(&hex, &list, base_pos);
+
 	while (1) {
 		readPad();
 
@@ -137,7 +348,8 @@ int hexViewer(char *file) {
 						list.head->previous = NULL;
 
 						// Read
-						memcpy(list.head->data, buffer + base_pos, 0x10);
+						hexReadRow(&hex, base_pos, list.head->data);
+						hexReadAhead(&hex, base_pos, -1);
 					}
 				}
 			} else if (hold_buttons & SCE_CTRL_DOWN || hold2_buttons & SCE_CTRL_LEFT_ANALOG_DOWN) {
@@ -161,7 +373,8 @@ int hexViewer(char *file) {
 							list.tail->next = NULL;
 
 							// Read
-							memcpy(list.tail->data, buffer + base_pos + (0x10 - 1) * 0x10, 0x10);
+							hexReadRow(&hex, base_pos + (0x10 - 1) * 0x10, list.tail->data);
+							hexReadAhead(&hex, base_pos + 0x10 * 0x10, 1);
 						}
 					}
 				}
@@ -177,13 +390,8 @@ int hexViewer(char *file) {
 						rel_pos = 0;
 					}
 
-					HexListEntry *entry = list.head;
-
-					int i;
-					for (i = 0; i < 0x10; i++) {
-						memcpy(entry->data, buffer + base_pos + i * 0x10, 0x10);
-						entry = entry->next;
-					}
+					hexReadRows(&hex, &list, base_pos);
+					hexReadAhead(&hex, base_pos, -1);
 				}
 			}
 
@@ -196,13 +404,40 @@ int hexViewer(char *file) {
 						rel_pos = 0xE0;
 					}
 
-					HexListEntry *entry = list.head;
+					hexReadRows(&hex, &list, base_pos);
+					hexReadAhead(&hex, base_pos + 0x10 * 0x10, 1);
+				}
+			}
+
+			// Go to offset
+			if (pressed_buttons & SCE_CTRL_TRIANGLE) {
+				initImeDialog(language_container[ENTER_OFFSET], "", 16, SCE_IME_TYPE_BASIC_LATIN, 0);
+				offset_input = 1;
+			}
+
+			if (offset_input) {
+				int ime_result = updateImeDialog();
+
+				if (ime_result == IME_DIALOG_RESULT_FINISHED) {
+					char *end;
+					char *input = (char *)getImeDialogInputTextUTF8();
+					SceOff offset = (SceOff)strtoull(input, &end, 16);
 
-					int i;
-					for (i = 0; i < 0x10; i++) {
-						memcpy(entry->data, buffer + base_pos + i * 0x10, 0x10);
-						entry = entry->next;
+					if (end != input) {
+						offset = MIN(offset, size - 1);
+
+						// The row goes to the top unless the view would pass the end
+						SceOff row = offset - offset % 0x10;
+						base_pos = MIN(row, MAX(ALIGN(size, 0x10) - 0xF0, 0));
+						rel_pos = (int)(row - base_pos);
+						nibble_pos = 2 * (offset % 0x10);
+
+						hexReadRows(&hex, &list, base_pos);
 					}
+
+					offset_input = 0;
+				} else if (ime_result == IME_DIALOG_RESULT_CANCELED) {
+					offset_input = 0;
 				}
 			}
 
@@ -248,10 +483,11 @@ int hexViewer(char *file) {
 
 			// Increase nibble
 			if (modify_allowed && hold_buttons & SCE_CTRL_ENTER) {
-				changed = 1;
-				int cur_pos = rel_pos + base_pos + nibble_pos / 2;
+				SceOff cur_pos = rel_pos + base_pos + nibble_pos / 2;
 
-				uint8_t ch = buffer[cur_pos];
+				HexListEntry *entry = hexListGetNthEntry(&list, rel_pos / 0x10);
+
+				uint8_t ch = entry->data[nibble_pos / 2];
 				uint8_t high_nibble = (ch >> 4) & 0xF;
 				uint8_t low_nibble = ch & 0xF;
 
@@ -264,27 +500,18 @@ int hexViewer(char *file) {
 					nibble = 0;
 				}
 
-				HexListEntry *entry = hexListGetNthEntry(&list, rel_pos / 0x10);
+				uint8_t byte = low ? ((high_nibble << 4) | nibble) : ((nibble << 4) | low_nibble);
 
-				if (low) {
-					uint8_t byte = (high_nibble << 4) | nibble;
-					buffer[cur_pos] = byte;
-					entry->data[nibble_pos / 2] = byte;
-				} else {
-					uint8_t byte = (nibble << 4) | low_nibble;
-					buffer[cur_pos] = byte;
+				// Edits are kept apart from the cached pages
+				if (hexSetByte(&hex, cur_pos, byte) >= 0) {
 					entry->data[nibble_pos / 2] = byte;
+					changed = 1;
 				}
 			}
 		} else {
 			int msg_result = updateMessageDialog();
 			if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
-				SceUID fd = sceIoOpen(file, SCE_O_WRONLY, 0777);
-				if (fd >= 0) {
-					sceIoWrite(fd, buffer, size);
-					sceIoClose(fd);
-				}
-
+				save_res = hexSave(file, &hex);
 				break;
 			} else if (msg_result == MESSAGE_DIALOG_RESULT_NO) {
 				break;
@@ -298,12 +525,19 @@ int hexViewer(char *file) {
 		drawShellInfo(file);
 
 		// Draw scroll bar
-		int pos = (base_pos - (base_pos % 0x10)) / 0x10 + ((base_pos % 0x10) ? 1 : 0);
-		int n_lines = (size - (size % 0x10)) / 0x10 + ((size % 0x10) ? 1 : 0);
-		drawScrollBar(pos, n_lines);
+		SceOff pos = (base_pos - (base_pos % 0x10)) / 0x10 + ((base_pos % 0x10) ? 1 : 0);
+		SceOff n_lines = (size - (size % 0x10)) / 0x10 + ((size % 0x10) ? 1 : 0);
+
+		// Scaled down to fit into an int
+		while (n_lines > 0x7FFFFFFF) {
+			pos >>= 1;
+			n_lines >>= 1;
+		}
+
+		drawScrollBar((int)pos, (int)n_lines);
 
 		// Offset/size
-		pgf_draw_textf(HEX_CHAR_X, START_Y, HEX_OFFSET_COLOR, FONT_SIZE, "%08X/%08X", rel_pos + base_pos, size);
+		pgf_draw_textf(HEX_CHAR_X, START_Y, HEX_OFFSET_COLOR, FONT_SIZE, "%08llX/%08llX", (unsigned long long)(rel_pos + base_pos), (unsigned long long)size);
 
 		// Offset x
 		pgf_draw_text(SHELL_MARGIN_X, START_Y, HEX_OFFSET_COLOR, FONT_SIZE, language_container[OFFSET]);
@@ -323,7 +557,7 @@ int hexViewer(char *file) {
 
 				uint8_t ch = entry->data[x];
 
-				uint32_t offset = base_pos + x + y * 0x10;
+				SceOff offset = base_pos + x + y * 0x10;
 				if (offset >= size)
 					break;
 
@@ -350,7 +584,7 @@ int hexViewer(char *file) {
 
 			// Offset y
 			if (x > 0)
-				pgf_draw_textf(SHELL_MARGIN_X, START_Y + ((y + 1) * FONT_Y_SPACE), HEX_OFFSET_COLOR, FONT_SIZE, "%08X", base_pos + (y * 0x10));
+				pgf_draw_textf(SHELL_MARGIN_X, START_Y + ((y + 1) * FONT_Y_SPACE), HEX_OFFSET_COLOR, FONT_SIZE, "%08llX", (unsigned long long)(base_pos + (y * 0x10)));
 
 			// It's the end, break
 			if (x < 0x10)
@@ -366,7 +600,10 @@ int hexViewer(char *file) {
 
 	hexListEmpty(&list);
 
-	free(buffer);
+	hexCloseFile(&hex);
+
+	if (save_res < 0)
+		return save_res;
 
 	if (text_viewer)
 		textViewer(file);
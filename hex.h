@@ -26,6 +26,11 @@ enum GroupSizes {
 	GROUP_SIZE_4_BYTE,
 };
 
+// Files are read through a cache of pages
+#define HEX_PAGE_SIZE 0x10000
+#define HEX_CACHE_PAGES 32
+#define HEX_EDITS_CHUNK 256
+
 typedef struct HexListEntry {
 	struct HexListEntry *next;
 	struct HexListEntry *previous;
@@ -38,6 +43,29 @@ typedef struct {
 	int length;
 } HexList;
 
+typedef struct {
+	SceOff offset;
+	int size; // 0 if unused
+	int last_use;
+	uint8_t *data;
+} HexPage;
+
+typedef struct {
+	SceOff offset;
+	uint8_t value;
+} HexEdit;
+
+typedef struct {
+	SceUID fd;
+	int in_archive;
+	SceOff size;
+	HexPage pages[HEX_CACHE_PAGES];
+	int page_clock;
+	HexEdit *edits; // Sorted by offset
+	int n_edits;
+	int max_edits;
+} HexFile;
+
 int hexViewer(char *file);
 
 #endif
\ No newline at end of file
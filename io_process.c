@@ -20,6 +20,8 @@
 #include "io_process.h"
 #include "archive.h"
 #include "file.h"
+#include "hash.h"
+#include "fingerprint.h"
 #include "message_dialog.h"
 #include "language.h"
 #include "utils.h"
@@ -581,7 +583,208 @@ EXIT:
 	return sceKernelExitDeleteThread(0);
 }
 
+static int hashSingleFile(char *path, char *msg, int msg_size) {
+	uint64_t max = (uint64_t) (getFileSize(path)/(TRANSFER_SIZE));
+
+	// Spin off a thread to update the progress dialog
+	SceUID thid = createStartUpdateThread(max);
+
+	uint64_t value = 0;
+
+	FileProcessParam param;
+	param.value = &value;
+	param.max = max;
+	param.SetProgress = SetProgress;
+	param.cancelHandler = cancelHandler;
+
+	// SHA1 is always calculated, the others are selected in the settings
+	int algorithms = HASH_SHA1;
+	if (vitashell_config.hash_crc32)
+		algorithms |= HASH_CRC32;
+	if (vitashell_config.hash_md5)
+		algorithms |= HASH_MD5;
+	if (vitashell_config.hash_sha256)
+		algorithms |= HASH_SHA256;
+
+	HashResult result;
+	int res = getFileHashes(path, algorithms, &result, &param);
+	if (res > 0 && vitashell_config.hash_export)
+		res = writeHashFiles(path, &result);
+
+	if (res > 0)
+		hashToString(&result, msg, msg_size);
+
+	// Ensure the update thread ends gracefully
+	if (thid >= 0)
+		sceKernelWaitThreadEnd(thid, NULL, NULL);
+
+	return res;
+}
+
+static int hashBatch(HashArguments *args, FileListEntry *head, int count, char *msg, int msg_size) {
+	char manifest_path[MAX_PATH_LENGTH];
+	char path[MAX_PATH_LENGTH];
+
+	// A single entry gets a manifest next to it, marked entries a common one
+	if (count == 1) {
+		snprintf(path, MAX_PATH_LENGTH, "%s%s", args->file_list->path, head->name);
+		removeEndSlash(path);
+		snprintf(manifest_path, MAX_PATH_LENGTH, "%s.sha1", path);
+	} else {
+		snprintf(manifest_path, MAX_PATH_LENGTH, "%schecksums.sha1", args->file_list->path);
+	}
+
+	HashPathList list;
+	memset(&list, 0, sizeof(HashPathList));
+
+	HashManifestResult result;
+
+	uint64_t size = 0;
+	int res = 1;
+
+	FileListEntry *mark_entry = head;
+
+	int i;
+	for (i = 0; i < count && res > 0; i++) {
+		snprintf(path, MAX_PATH_LENGTH, "%s%s", args->file_list->path, mark_entry->name);
+		removeEndSlash(path);
+
+		if (strcmp(path, manifest_path) != 0) {
+			getPathInfo(path, &size, NULL, NULL, NULL);
+			res = hashPathListAddPath(&list, path);
+		}
+
+		mark_entry = mark_entry->next;
+	}
+
+	if (res > 0) {
+		SceUID thid = createStartUpdateThread(size);
+
+		uint64_t value = 0;
+
+		FileProcessParam param;
+		param.value = &value;
+		param.max = size;
+		param.SetProgress = SetProgress;
+		param.cancelHandler = cancelHandler;
+
+		res = writeHashManifest(manifest_path, &list, &result, &param);
+
+		if (thid >= 0)
+			sceKernelWaitThreadEnd(thid, NULL, NULL);
+	}
+
+	if (res > 0) {
+		int len = snprintf(msg, msg_size, language_container[HASH_MANIFEST_WRITTEN], result.written, manifest_path + strlen(args->file_list->path));
+		if (len < msg_size && result.skipped > 0)
+			len += snprintf(msg + len, msg_size - len, language_container[HASH_MANIFEST_SKIPPED], result.skipped);
+		if (len < msg_size)
+			snprintf(msg + len, msg_size - len, "%s", result.report);
+	}
+
+	hashPathListFree(&list);
+
+	return res;
+}
+
+static int hashVerify(char *path, char *msg, int msg_size) {
+	HashManifest manifest;
+	int res = readHashManifest(path, &manifest);
+	if (res < 0)
+		return res;
+
+	// Missing files do not count
+	uint64_t size = 0;
+
+	int i;
+	for (i = 0; i < manifest.list.length; i++) {
+		SceIoStat stat;
+		memset(&stat, 0, sizeof(SceIoStat));
+		if (sceIoGetstat(manifest.list.paths[i], &stat) >= 0)
+			size += stat.st_size;
+	}
+
+	SceUID thid = createStartUpdateThread(size);
+
+	uint64_t value = 0;
+
+	FileProcessParam param;
+	param.value = &value;
+	param.max = size;
+	param.SetProgress = SetProgress;
+	param.cancelHandler = cancelHandler;
+
+	HashVerifyResult result;
+	res = verifyHashManifest(&manifest, &result, &param);
+
+	if (thid >= 0)
+		sceKernelWaitThreadEnd(thid, NULL, NULL);
+
+	if (res > 0) {
+		int len = snprintf(msg, msg_size, language_container[HASH_VERIFY_RESULT], result.ok, result.mismatched, result.missing);
+		if (len < msg_size)
+			snprintf(msg + len, msg_size - len, "%s", result.report);
+	}
+
+	freeHashManifest(&manifest);
+
+	return res;
+}
+
 int hash_thread(SceSize args_size, HashArguments *args) {
+	// Lock power timers
+	powerLock();
+
+	// Set progress to 0%
+	sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 0);
+	sceKernelDelayThread(DIALOG_WAIT); // Needed to see the percentage
+
+	FileListEntry *file_entry = fileListGetNthEntry(args->file_list, args->index);
+
+	char path[MAX_PATH_LENGTH];
+	snprintf(path, MAX_PATH_LENGTH, "%s%s", args->file_list->path, file_entry->name);
+
+	char msg[512];
+	msg[0] = '\0';
+
+	int res;
+	if (args->verify) {
+		res = hashVerify(path, msg, sizeof(msg));
+	} else if (fileListFindEntry(args->mark_list, file_entry->name)) { // On marked entry
+		res = hashBatch(args, args->mark_list->head, args->mark_list->length, msg, sizeof(msg));
+	} else if (file_entry->is_folder) {
+		res = hashBatch(args, file_entry, 1, msg, sizeof(msg));
+	} else {
+		res = hashSingleFile(path, msg, sizeof(msg));
+	}
+
+	if (res <= 0) {
+		// Hashing didn't complete successfully, or was cancelled
+		closeWaitDialog();
+		dialog_step = DIALOG_STEP_CANCELLED;
+		errorDialog(res);
+		goto EXIT;
+	}
+
+	// Since we hit here, we're done. Set progress to 100%
+	sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 100);
+	sceKernelDelayThread(COUNTUP_WAIT);
+
+	// Close
+	closeWaitDialog();
+
+	// Refresh afterwards, hash files may have been written
+	initMessageDialog(SCE_MSG_DIALOG_BUTTON_TYPE_OK, "%s", msg);
+	dialog_step = DIALOG_STEP_HASHED;
+
+EXIT:
+	powerUnlock();
+
+	// Kill current thread
+	return sceKernelExitDeleteThread(0);
+}
+
+int compare_thread(SceSize args_size, CompareArguments *args) {
 	SceUID thid = -1;
 
 	// Lock power timers
@@ -591,63 +794,57 @@ int hash_thread(SceSize args_size, HashArguments *args) {
 	sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 0);
 	sceKernelDelayThread(DIALOG_WAIT); // Needed to see the percentage
 
-	uint64_t max = (uint64_t) (getFileSize(args->file_path)/(TRANSFER_SIZE));
+	// Get paths info
+	uint64_t size = 0;
+	getPathInfo(args->path_a, &size, NULL, NULL, NULL);
+	getPathInfo(args->path_b, &size, NULL, NULL, NULL);
 
-	// SHA1 process
-	uint64_t value = 0;
+	uint64_t max = size / TRANSFER_SIZE;
 
-	// Spin off a thread to update the progress dialog 
+	// Update thread
 	thid = createStartUpdateThread(max);
 
+	uint64_t value = 0;
+
 	FileProcessParam param;
 	param.value = &value;
 	param.max = max;
 	param.SetProgress = SetProgress;
 	param.cancelHandler = cancelHandler;
 
-	uint8_t sha1out[20];
-	int res = getFileSha1(args->file_path, sha1out, &param);
+	FingerprintCompareResult result;
+	int res = compareFingerprints(args->path_a, args->path_b, &result, &param);
 	if (res <= 0) {
-		// SHA1 Didn't complete successfully, or was cancelled
 		closeWaitDialog();
 		dialog_step = DIALOG_STEP_CANCELLED;
 		errorDialog(res);
 		goto EXIT;
 	}
 
-	// Since we hit here, we're done. Set progress to 100%
+	// Set progress to 100%
 	sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 100);
 	sceKernelDelayThread(COUNTUP_WAIT);
 
 	// Close
 	closeWaitDialog();
 
-	char sha1msg[42];
-	memset(sha1msg, 0, sizeof(sha1msg));
-
-	// Construct SHA1 sum string
-	int i;
-	for (i = 0; i < 20; i++) {
-		char string[4];
-		sprintf(string, "%02X", sha1out[i]);
-		strcat(sha1msg, string);
+	if (result.differences == 0) {
+		infoDialog(language_container[COMPARE_IDENTICAL]);
+	} else {
+		char msg[512];
+		int len = snprintf(msg, sizeof(msg), language_container[COMPARE_DIFFERENCES], result.differences);
+		if (len < sizeof(msg))
+			snprintf(msg + len, sizeof(msg) - len, "%s", result.report);
 
-		if (i == 9)
-			strcat(sha1msg, "\n");
+		infoDialog("%s", msg);
 	}
 
-	sha1msg[41] = '\0';
-
-	infoDialog(sha1msg);
-
 EXIT:
-
-	// Ensure the update thread ends gracefully
 	if (thid >= 0)
 		sceKernelWaitThreadEnd(thid, NULL, NULL);
 
+	// Unlock power timers
 	powerUnlock();
 
-	// Kill current thread
 	return sceKernelExitDeleteThread(0);
 }
@@ -52,9 +52,17 @@ typedef struct {
 } ExportArguments;
 
 typedef struct {
-	char *file_path;
+	FileList *file_list;
+	FileList *mark_list;
+	int index;
+	int verify;
 } HashArguments;
 
+typedef struct {
+	char *path_a;
+	char *path_b;
+} CompareArguments;
+
 int cancelHandler();
 void SetProgress(uint64_t value, uint64_t max);
 SceUID createStartUpdateThread(uint64_t max);
@@ -63,5 +71,6 @@ int delete_thread(SceSize args_size, DeleteArguments *args);
 int copy_thread(SceSize args_size, CopyArguments *args);
 int export_thread(SceSize args_size, ExportArguments *args);
 int hash_thread(SceSize args_size, HashArguments *args);
+int compare_thread(SceSize args_size, CompareArguments *args);
 
 #endif
@@ -82,6 +82,7 @@ void loadLanguage(int id) {
 		LANGUAGE_ENTRY(EXTRACTING),
 		LANGUAGE_ENTRY(COMPRESSING),
 		LANGUAGE_ENTRY(HASHING),
+		LANGUAGE_ENTRY(COMPARING),
 
 		// Audio player strings
 		LANGUAGE_ENTRY(TITLE),
@@ -92,6 +93,7 @@ void loadLanguage(int id) {
 
 		// Hex editor strings
 		LANGUAGE_ENTRY(OFFSET),
+		LANGUAGE_ENTRY(ENTER_OFFSET),
 		LANGUAGE_ENTRY(OPEN_HEX_EDITOR),
 
 		// Text editor strings
@@ -99,6 +101,8 @@ void loadLanguage(int id) {
 		LANGUAGE_ENTRY(ENTER_SEARCH_TERM),
 		LANGUAGE_ENTRY(CUT),
 		LANGUAGE_ENTRY(INSERT_EMPTY_LINE),
+		LANGUAGE_ENTRY(SEARCH_REGEX),
+		LANGUAGE_ENTRY(ENTER_REGEX),
 
 		// File browser context menu strings
 		LANGUAGE_ENTRY(MORE),
@@ -115,8 +119,12 @@ void loadLanguage(int id) {
 		LANGUAGE_ENTRY(INSTALL_ALL),
 		LANGUAGE_ENTRY(INSTALL_FOLDER),
 		LANGUAGE_ENTRY(CALCULATE_SHA1),
+		LANGUAGE_ENTRY(VERIFY_HASHES),
+		LANGUAGE_ENTRY(COMPARE_FOLDERS),
 		LANGUAGE_ENTRY(EXPORT_MEDIA),
 		LANGUAGE_ENTRY(SEARCH),
+		LANGUAGE_ENTRY(FILTER),
+		LANGUAGE_ENTRY(ENTER_FILTER),
 
 		// File browser properties strings
 		LANGUAGE_ENTRY(PROPERTY_NAME),
@@ -135,6 +143,7 @@ void loadLanguage(int id) {
 		LANGUAGE_ENTRY(PROPERTY_TYPE_OGG),
 		LANGUAGE_ENTRY(PROPERTY_TYPE_PNG),
 		LANGUAGE_ENTRY(PROPERTY_TYPE_SFO),
+		LANGUAGE_ENTRY(PROPERTY_TYPE_TAR),
 		LANGUAGE_ENTRY(PROPERTY_TYPE_TXT),
 		LANGUAGE_ENTRY(PROPERTY_TYPE_VPK),
 		LANGUAGE_ENTRY(PROPERTY_TYPE_XML),
@@ -166,6 +175,17 @@ void loadLanguage(int id) {
 		LANGUAGE_ENTRY(INSTALL_WARNING),
 		LANGUAGE_ENTRY(INSTALL_BRICK_WARNING),
 		LANGUAGE_ENTRY(HASH_FILE_QUESTION),
+		LANGUAGE_ENTRY(HASH_MANIFEST_WRITTEN),
+		LANGUAGE_ENTRY(HASH_MANIFEST_SKIPPED),
+		LANGUAGE_ENTRY(HASH_MANIFEST_UNREADABLE),
+		LANGUAGE_ENTRY(HASH_VERIFY_RESULT),
+		LANGUAGE_ENTRY(HASH_VERIFY_FAILED),
+		LANGUAGE_ENTRY(HASH_VERIFY_MISSING),
+		LANGUAGE_ENTRY(COMPARE_IDENTICAL),
+		LANGUAGE_ENTRY(COMPARE_DIFFERENCES),
+		LANGUAGE_ENTRY(COMPARE_DIFFERENT),
+		LANGUAGE_ENTRY(COMPARE_ONLY_IN_FIRST),
+		LANGUAGE_ENTRY(COMPARE_ONLY_IN_SECOND),
 
 		// HENkaku settings strings
 		LANGUAGE_ENTRY(HENKAKU_SETTINGS),
@@ -184,6 +204,11 @@ void loadLanguage(int id) {
 		LANGUAGE_ENTRY(VITASHELL_SETTINGS_LANGUAGE),
 		LANGUAGE_ENTRY(VITASHELL_SETTINGS_THEME),
 		LANGUAGE_ENTRY(VITASHELL_SETTINGS_NO_AUTO_UPDATE),
+		LANGUAGE_ENTRY(VITASHELL_SETTINGS_HASH_CRC32),
+		LANGUAGE_ENTRY(VITASHELL_SETTINGS_HASH_MD5),
+		LANGUAGE_ENTRY(VITASHELL_SETTINGS_HASH_SHA256),
+		LANGUAGE_ENTRY(VITASHELL_SETTINGS_HASH_EXPORT),
+		LANGUAGE_ENTRY(VITASHELL_SETTINGS_EDITOR_BACKUP),
 		LANGUAGE_ENTRY(VITASHELL_SETTINGS_POWER),
 		LANGUAGE_ENTRY(VITASHELL_SETTINGS_REBOOT),
 		LANGUAGE_ENTRY(VITASHELL_SETTINGS_POWEROFF),
@@ -203,6 +228,9 @@ void loadLanguage(int id) {
 		LANGUAGE_ENTRY(UPDATE_QUESTION),
 		LANGUAGE_ENTRY(ARCHIVE_NAME),
 		LANGUAGE_ENTRY(COMPRESSION_LEVEL),
+		LANGUAGE_ENTRY(COMPRESSING_AUTO_LEVEL),
+		LANGUAGE_ENTRY(COMPRESS_UPDATE_QUESTION),
+		LANGUAGE_ENTRY(INVALID_REGEX),
 	};
 
 	// Load default config file
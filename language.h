@@ -41,6 +41,7 @@ enum LanguageContainer {
 	EXTRACTING,
 	COMPRESSING,
 	HASHING,
+	COMPARING,
 
 	// Audio player strings
 	TITLE,
@@ -51,6 +52,7 @@ enum LanguageContainer {
 
 	// Hex editor strings
 	OFFSET,
+	ENTER_OFFSET,
 	OPEN_HEX_EDITOR,
 
 	// Text editor strings
@@ -58,6 +60,8 @@ enum LanguageContainer {
 	ENTER_SEARCH_TERM,
 	CUT,
 	INSERT_EMPTY_LINE,
+	SEARCH_REGEX,
+	ENTER_REGEX,
 
 	// File browser context menu strings
 	MORE,
@@ -74,8 +78,12 @@ enum LanguageContainer {
 	INSTALL_ALL,
 	INSTALL_FOLDER,
 	CALCULATE_SHA1,
+	VERIFY_HASHES,
+	COMPARE_FOLDERS,
 	EXPORT_MEDIA,
 	SEARCH,
+	FILTER,
+	ENTER_FILTER,
 
 	// File browser properties strings
 	PROPERTY_NAME,
@@ -94,6 +102,7 @@ enum LanguageContainer {
 	PROPERTY_TYPE_OGG,
 	PROPERTY_TYPE_PNG,
 	PROPERTY_TYPE_SFO,
+	PROPERTY_TYPE_TAR,
 	PROPERTY_TYPE_TXT,
 	PROPERTY_TYPE_VPK,
 	PROPERTY_TYPE_XML,
@@ -125,6 +134,17 @@ enum LanguageContainer {
 	INSTALL_WARNING,
 	INSTALL_BRICK_WARNING,
 	HASH_FILE_QUESTION,
+	HASH_MANIFEST_WRITTEN,
+	HASH_MANIFEST_SKIPPED,
+	HASH_MANIFEST_UNREADABLE,
+	HASH_VERIFY_RESULT,
+	HASH_VERIFY_FAILED,
+	HASH_VERIFY_MISSING,
+	COMPARE_IDENTICAL,
+	COMPARE_DIFFERENCES,
+	COMPARE_DIFFERENT,
+	COMPARE_ONLY_IN_FIRST,
+	COMPARE_ONLY_IN_SECOND,
 
 	// HENkaku settings strings
 	HENKAKU_SETTINGS,
@@ -143,6 +163,11 @@ enum LanguageContainer {
 	VITASHELL_SETTINGS_LANGUAGE,
 	VITASHELL_SETTINGS_THEME,
 	VITASHELL_SETTINGS_NO_AUTO_UPDATE,
+	VITASHELL_SETTINGS_HASH_CRC32,
+	VITASHELL_SETTINGS_HASH_MD5,
+	VITASHELL_SETTINGS_HASH_SHA256,
+	VITASHELL_SETTINGS_HASH_EXPORT,
+	VITASHELL_SETTINGS_EDITOR_BACKUP,
 	VITASHELL_SETTINGS_POWER,
 	VITASHELL_SETTINGS_REBOOT,
 	VITASHELL_SETTINGS_POWEROFF,
@@ -162,6 +187,9 @@ enum LanguageContainer {
 	UPDATE_QUESTION,
 	ARCHIVE_NAME,
 	COMPRESSION_LEVEL,
+	COMPRESSING_AUTO_LEVEL,
+	COMPRESS_UPDATE_QUESTION,
+	INVALID_REGEX,
 	LANGUAGE_CONTRAINER_SIZE,
 };
 
@@ -37,6 +37,7 @@
 #include "utils.h"
 #include "sfo.h"
 #include "list_dialog.h"
+#include "regexp.h"
 
 #include "audio/vita_audio.h"
 
@@ -54,7 +55,7 @@ static FileList file_list, mark_list, copy_list, install_list;
 static int sort_mode = SORT_BY_NAME;
 
 // Paths
-static char cur_file[MAX_PATH_LENGTH], archive_path[MAX_PATH_LENGTH], install_path[MAX_PATH_LENGTH];
+static char cur_file[MAX_PATH_LENGTH], copy_archive_path[MAX_PATH_LENGTH], install_path[MAX_PATH_LENGTH];
 static char focus_name[MAX_NAME_LENGTH], compress_name[MAX_NAME_LENGTH];
 
 // Position
@@ -66,9 +67,22 @@ static int dir_level = 0;
 // Copy mode
 static int copy_mode = COPY_MODE_NORMAL;
 
+// Hash mode
+static int hash_verify = 0;
+
+// Compression level
+static int compress_level = 0;
+
+// Folders to compare
+static char compare_path_a[MAX_PATH_LENGTH], compare_path_b[MAX_PATH_LENGTH];
+
+// Name filter, only applied to the folder it was set in
+static char filter_pattern[REGEX_MAX_PATTERN_LENGTH], filter_path[MAX_PATH_LENGTH];
+
 // Archive
-int is_in_archive = 0;
-int dir_level_archive = -1;
+static char archive_path[MAX_ARCHIVE_LEVELS][MAX_PATH_LENGTH];
+int is_in_archive = 0; // Number of opened archive levels
+int dir_level_archive[MAX_ARCHIVE_LEVELS];
 
 // FTP
 static char vita_ip[16];
@@ -106,10 +120,16 @@ int isInArchive() {
 }
 
 void dirUpCloseArchive() {
-	if (isInArchive() && dir_level_archive >= dir_level) {
-		is_in_archive = 0;
-		archiveClose();
-		dir_level_archive = -1;
+	while (isInArchive() && dir_level_archive[is_in_archive - 1] >= dir_level) {
+		is_in_archive--;
+		dir_level_archive[is_in_archive] = -1;
+
+		// Go back to the outer archive
+		if (isInArchive()) {
+			archiveCloseLevel();
+		} else {
+			archiveClose();
+		}
 	}
 }
 
@@ -176,6 +196,45 @@ void setFocusOnFilename(char *name) {
 	}
 }
 
+// Remove the entries whose names don't match the filter. Names are short, so
+// this is cheap enough to run inline
+static void filterFileList() {
+	if (filter_pattern[0] == '\0')
+		return;
+
+	// Leaving the folder drops the filter
+	if (strcmp(file_list.path, filter_path) != 0) {
+		filter_pattern[0] = '\0';
+		return;
+	}
+
+	Regex *re = regexGetCached(filter_pattern, REGEX_IGNORE_CASE);
+	if (!re)
+		return;
+
+	FileListEntry *entry = file_list.head;
+	while (entry) {
+		FileListEntry *next = entry->next;
+
+		// Match folders without their end slash
+		int length = entry->name_length;
+		if (entry->is_folder && length > 0 && entry->name[length - 1] == '/')
+			length--;
+
+		int start, end;
+		if (strcmp(entry->name, DIR_UP) != 0 && !regexFind(re, entry->name, length, 0, length + 1, &start, &end)) {
+			if (entry->is_folder)
+				file_list.folders--;
+			else
+				file_list.files--;
+
+			fileListRemoveEntry(&file_list, entry);
+		}
+
+		entry = next;
+	}
+}
+
 int refreshFileList() {
 	int ret = 0, res = 0;
 
@@ -190,6 +249,8 @@ int refreshFileList() {
 		}
 	} while (res < 0);
 
+	filterFileList();
+
 	// Correct position after deleting the latest entry of the file list
 	while ((base_pos + rel_pos) >= file_list.length) {
 		if (base_pos > 0) {
@@ -270,12 +331,18 @@ int handleFile(char *file, FileListEntry *entry) {
 	switch (type) {
 		case FILE_TYPE_MP3:
 		case FILE_TYPE_OGG:
-		case FILE_TYPE_VPK:
-		case FILE_TYPE_ZIP:
+			// The decoders read through sceIo from their own threads
 			if (isInArchive())
 				type = FILE_TYPE_UNKNOWN;
 
 			break;
+			
+		case FILE_TYPE_VPK:
+			// Browse archives in archives
+			if (isInArchive())
+				type = FILE_TYPE_ZIP;
+
+			break;
 	}
 
 	switch (type) {
@@ -302,6 +369,7 @@ int handleFile(char *file, FileListEntry *entry) {
 			dialog_step = DIALOG_STEP_INSTALL_QUESTION;
 			break;
 			
+		case FILE_TYPE_TAR:
 		case FILE_TYPE_ZIP:
 			res = archiveOpen(file);
 			break;
@@ -462,6 +530,9 @@ enum MenuMoreEntrys {
 	MENU_MORE_ENTRY_INSTALL_FOLDER,
 	MENU_MORE_ENTRY_EXPORT_MEDIA,
 	MENU_MORE_ENTRY_CALCULATE_SHA1,
+	MENU_MORE_ENTRY_VERIFY_HASHES,
+	MENU_MORE_ENTRY_COMPARE_FOLDERS,
+	MENU_MORE_ENTRY_FILTER,
 };
 
 MenuEntry menu_more_entries[] = {
@@ -470,6 +541,9 @@ MenuEntry menu_more_entries[] = {
 	{ INSTALL_FOLDER, 0, CTX_VISIBILITY_INVISIBLE },
 	{ EXPORT_MEDIA, 0, CTX_VISIBILITY_INVISIBLE },
 	{ CALCULATE_SHA1, 0, CTX_VISIBILITY_INVISIBLE },
+	{ VERIFY_HASHES, 0, CTX_VISIBILITY_INVISIBLE },
+	{ COMPARE_FOLDERS, 0, CTX_VISIBILITY_INVISIBLE },
+	{ FILTER, 0, CTX_VISIBILITY_INVISIBLE },
 };
 
 #define N_MENU_MORE_ENTRIES (sizeof(menu_more_entries) / sizeof(MenuEntry))
@@ -561,6 +635,35 @@ void setContextMenuVisibilities() {
 		setContextMenuPos(-1);
 }
 
+// Two marked folders, or a folder and the copied folder, can be compared
+static int getComparePaths(char *path_a, char *path_b) {
+	FileListEntry *file_entry = fileListGetNthEntry(&file_list, base_pos + rel_pos);
+	if (isInArchive() || !file_entry->is_folder || strcmp(file_entry->name, DIR_UP) == 0)
+		return 0;
+
+	if (fileListFindEntry(&mark_list, file_entry->name)) {
+		if (mark_list.length != 2 || !hasEndSlash(mark_list.head->name) || !hasEndSlash(mark_list.head->next->name))
+			return 0;
+
+		snprintf(path_a, MAX_PATH_LENGTH, "%s%s", file_list.path, mark_list.head->name);
+		snprintf(path_b, MAX_PATH_LENGTH, "%s%s", file_list.path, mark_list.head->next->name);
+	} else {
+		if (copy_list.length != 1 || copy_mode == COPY_MODE_EXTRACT || !hasEndSlash(copy_list.head->name))
+			return 0;
+
+		snprintf(path_a, MAX_PATH_LENGTH, "%s%s", copy_list.path, copy_list.head->name);
+		snprintf(path_b, MAX_PATH_LENGTH, "%s%s", file_list.path, file_entry->name);
+
+		if (strcasecmp(path_a, path_b) == 0)
+			return 0;
+	}
+
+	removeEndSlash(path_a);
+	removeEndSlash(path_b);
+
+	return 1;
+}
+
 void setContextMenuMoreVisibilities() {
 	int i;
 
@@ -579,19 +682,33 @@ void setContextMenuMoreVisibilities() {
 		menu_more_entries[MENU_MORE_ENTRY_INSTALL_FOLDER].visibility = CTX_VISIBILITY_INVISIBLE;
 		menu_more_entries[MENU_MORE_ENTRY_EXPORT_MEDIA].visibility = CTX_VISIBILITY_INVISIBLE;
 		menu_more_entries[MENU_MORE_ENTRY_CALCULATE_SHA1].visibility = CTX_VISIBILITY_INVISIBLE;
+		menu_more_entries[MENU_MORE_ENTRY_VERIFY_HASHES].visibility = CTX_VISIBILITY_INVISIBLE;
 	}
 
 	// Invisble operations in archives
 	if (isInArchive()) {
-		menu_more_entries[MENU_MORE_ENTRY_COMPRESS].visibility = CTX_VISIBILITY_INVISIBLE;
+		// Entries of a zip can be repacked into a new zip
+		int type = getFileType(archive_path[0]);
+		if (is_in_archive > 1 || (type != FILE_TYPE_ZIP && type != FILE_TYPE_VPK))
+			menu_more_entries[MENU_MORE_ENTRY_COMPRESS].visibility = CTX_VISIBILITY_INVISIBLE;
 		menu_more_entries[MENU_MORE_ENTRY_INSTALL_ALL].visibility = CTX_VISIBILITY_INVISIBLE;
 		menu_more_entries[MENU_MORE_ENTRY_INSTALL_FOLDER].visibility = CTX_VISIBILITY_INVISIBLE;
 		menu_more_entries[MENU_MORE_ENTRY_EXPORT_MEDIA].visibility = CTX_VISIBILITY_INVISIBLE;
 		menu_more_entries[MENU_MORE_ENTRY_CALCULATE_SHA1].visibility = CTX_VISIBILITY_INVISIBLE;
+		menu_more_entries[MENU_MORE_ENTRY_VERIFY_HASHES].visibility = CTX_VISIBILITY_INVISIBLE;
+	}
+
+	if (!getComparePaths(compare_path_a, compare_path_b)) {
+		menu_more_entries[MENU_MORE_ENTRY_COMPARE_FOLDERS].visibility = CTX_VISIBILITY_INVISIBLE;
+	}
+
+	// Only manifests can be verified
+	char *ext = strrchr(file_entry->name, '.');
+	if (file_entry->is_folder || !ext || (strcasecmp(ext, ".md5") != 0 && strcasecmp(ext, ".sha1") != 0 && strcasecmp(ext, ".sha256") != 0)) {
+		menu_more_entries[MENU_MORE_ENTRY_VERIFY_HASHES].visibility = CTX_VISIBILITY_INVISIBLE;
 	}
 
 	if (file_entry->is_folder) {
-		menu_more_entries[MENU_MORE_ENTRY_CALCULATE_SHA1].visibility = CTX_VISIBILITY_INVISIBLE;
 		do {
 			char check_path[MAX_PATH_LENGTH];
 			SceIoStat stat;
@@ -750,6 +867,10 @@ int contextMenuEnterCallback(int pos, void* context) {
 
 			strcpy(copy_list.path, file_list.path);
 
+			// Remember the archive to extract from
+			if (copy_mode == COPY_MODE_EXTRACT)
+				strcpy(copy_archive_path, archive_path[is_in_archive - 1]);
+
 			char *message;
 
 			// On marked entry
@@ -967,12 +1088,34 @@ int contextMenuMoreEnterCallback(int pos, void* context) {
 		}
 		
 		case MENU_MORE_ENTRY_CALCULATE_SHA1:
+		case MENU_MORE_ENTRY_VERIFY_HASHES:
 		{
+			hash_verify = (pos == MENU_MORE_ENTRY_VERIFY_HASHES);
+
 			// Ensure user wants to actually take the hash
 			initMessageDialog(SCE_MSG_DIALOG_BUTTON_TYPE_YESNO, language_container[HASH_FILE_QUESTION]);
 			dialog_step = DIALOG_STEP_HASH_QUESTION;
 			break;
 		}
+
+		case MENU_MORE_ENTRY_COMPARE_FOLDERS:
+		{
+			if (getComparePaths(compare_path_a, compare_path_b)) {
+				initMessageDialog(MESSAGE_DIALOG_PROGRESS_BAR, language_container[COMPARING]);
+				dialog_step = DIALOG_STEP_COMPARE_CONFIRMED;
+			}
+
+			break;
+		}
+
+		case MENU_MORE_ENTRY_FILTER:
+		{
+			// Empty input clears the filter
+			int filtered = filter_pattern[0] != '\0' && strcmp(file_list.path, filter_path) == 0;
+			initImeDialog(language_container[ENTER_FILTER], filtered ? filter_pattern : "", REGEX_MAX_PATTERN_LENGTH - 1, SCE_IME_TYPE_BASIC_LATIN, 0);
+			dialog_step = DIALOG_STEP_FILTER;
+			break;
+		}
 	}
 
 	return CONTEXT_MENU_CLOSING;
@@ -994,6 +1137,52 @@ void initFtp() {
 	ftpvita_ext_add_custom_command("PROM", ftpvita_PROM);	
 }
 
+static void runCompress(int update) {
+	CompressArguments args;
+	args.file_list = &file_list;
+	args.mark_list = &mark_list;
+	args.index = base_pos + rel_pos;
+	args.level = compress_level;
+	args.path = cur_file;
+	args.archive_path = isInArchive() ? archive_path[0] : NULL;
+	args.update = update;
+
+	initMessageDialog(MESSAGE_DIALOG_PROGRESS_BAR, language_container[COMPRESSING]);
+	dialog_step = DIALOG_STEP_COMPRESSING;
+
+	SceUID thid = sceKernelCreateThread("compress_thread", (SceKernelThreadEntry)compress_thread, 0x40, 0x100000, 0, 0, NULL);
+	if (thid >= 0)
+		sceKernelStartThread(thid, sizeof(CompressArguments), &args);
+}
+
+static void startCompress(int level) {
+	// Zips made of archive entries are placed next to the archive
+	if (isInArchive()) {
+		strcpy(cur_file, archive_path[0]);
+
+		char *p = strrchr(cur_file, '/');
+		if (!p)
+			p = strrchr(cur_file, ':');
+
+		snprintf(p + 1, MAX_PATH_LENGTH - (p + 1 - cur_file), "%s", compress_name);
+	} else {
+		snprintf(cur_file, MAX_PATH_LENGTH, "%s%s", file_list.path, compress_name);
+	}
+
+	compress_level = level;
+
+	// Ask before adding to an existing zip
+	SceIoStat stat;
+	memset(&stat, 0, sizeof(SceIoStat));
+	if (sceIoGetstat(cur_file, &stat) >= 0 && !SCE_S_ISDIR(stat.st_mode)) {
+		initMessageDialog(SCE_MSG_DIALOG_BUTTON_TYPE_YESNO, language_container[COMPRESS_UPDATE_QUESTION]);
+		dialog_step = DIALOG_STEP_COMPRESS_QUESTION;
+		return;
+	}
+
+	runCompress(0);
+}
+
 int dialogSteps() {
 	int refresh = REFRESH_MODE_NONE;
 
@@ -1016,6 +1205,14 @@ int dialogSteps() {
 			dialog_step = DIALOG_STEP_NONE;
 			break;
 			
+		case DIALOG_STEP_HASHED:
+			if (msg_result == MESSAGE_DIALOG_RESULT_NONE || msg_result == MESSAGE_DIALOG_RESULT_FINISHED) {
+				refresh = REFRESH_MODE_NORMAL;
+				dialog_step = DIALOG_STEP_NONE;
+			}
+
+			break;
+			
 		case DIALOG_STEP_DELETED:
 			if (msg_result == MESSAGE_DIALOG_RESULT_NONE || msg_result == MESSAGE_DIALOG_RESULT_FINISHED) {
 				FileListEntry *file_entry = fileListGetNthEntry(&file_list, base_pos + rel_pos);
@@ -1135,7 +1332,7 @@ int dialogSteps() {
 				CopyArguments args;
 				args.file_list = &file_list;
 				args.copy_list = &copy_list;
-				args.archive_path = archive_path;
+				args.archive_path = copy_archive_path;
 				args.copy_mode = copy_mode;
 
 				dialog_step = DIALOG_STEP_COPYING;
@@ -1266,8 +1463,13 @@ int dialogSteps() {
 				} else {
 					strcpy(compress_name, name);
 
-					initImeDialog(language_container[COMPRESSION_LEVEL], "6", 1, SCE_IME_TYPE_NUMBER, 0);
-					dialog_step = DIALOG_STEP_COMPRESS_LEVEL;
+					// Archive entries are copied as they are, no level to ask for
+					if (isInArchive()) {
+						startCompress(0);
+					} else {
+						initImeDialog(language_container[COMPRESSION_LEVEL], "6", 1, SCE_IME_TYPE_BASIC_LATIN, 0);
+						dialog_step = DIALOG_STEP_COMPRESS_LEVEL;
+					}
 				}
 			} else if (ime_result == IME_DIALOG_RESULT_CANCELED) {
 				dialog_step = DIALOG_STEP_NONE;
@@ -1275,27 +1477,34 @@ int dialogSteps() {
 			
 			break;
 			
+		case DIALOG_STEP_FILTER:
+			if (ime_result == IME_DIALOG_RESULT_FINISHED) {
+				char *pattern = (char *)getImeDialogInputTextUTF8();
+				if (pattern[0] != '\0' && !regexGetCached(pattern, REGEX_IGNORE_CASE)) {
+					infoDialog(language_container[INVALID_REGEX]);
+				} else {
+					strcpy(filter_pattern, pattern);
+					strcpy(filter_path, file_list.path);
+
+					base_pos = 0;
+					rel_pos = 0;
+					refreshFileList();
+
+					dialog_step = DIALOG_STEP_NONE;
+				}
+			} else if (ime_result == IME_DIALOG_RESULT_CANCELED) {
+				dialog_step = DIALOG_STEP_NONE;
+			}
+
+			break;
+
 		case DIALOG_STEP_COMPRESS_LEVEL:
 			if (ime_result == IME_DIALOG_RESULT_FINISHED) {
 				char *level = (char *)getImeDialogInputTextUTF8();
 				if (level[0] == '\0') {
 					dialog_step = DIALOG_STEP_NONE;
 				} else {
-					snprintf(cur_file, MAX_PATH_LENGTH, "%s%s", file_list.path, compress_name);
-
-					CompressArguments args;
-					args.file_list = &file_list;
-					args.mark_list = &mark_list;
-					args.index = base_pos + rel_pos;
-					args.level = atoi(level);
-					args.path = cur_file;
-
-					initMessageDialog(MESSAGE_DIALOG_PROGRESS_BAR, language_container[COMPRESSING]);
-					dialog_step = DIALOG_STEP_COMPRESSING;
-
-					SceUID thid = sceKernelCreateThread("compress_thread", (SceKernelThreadEntry)compress_thread, 0x40, 0x100000, 0, 0, NULL);
-					if (thid >= 0)
-						sceKernelStartThread(thid, sizeof(CompressArguments), &args);
+					startCompress((level[0] == 'a' || level[0] == 'A') ? ZIP_LEVEL_AUTO : atoi(level));
 				}
 			} else if (ime_result == IME_DIALOG_RESULT_CANCELED) {
 				dialog_step = DIALOG_STEP_NONE;
@@ -1303,6 +1512,15 @@ int dialogSteps() {
 			
 			break;
 			
+		case DIALOG_STEP_COMPRESS_QUESTION:
+			if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
+				runCompress(1);
+			} else if (msg_result == MESSAGE_DIALOG_RESULT_NO) {
+				dialog_step = DIALOG_STEP_NONE;
+			}
+
+			break;
+
 		case DIALOG_STEP_HASH_QUESTION:
 			if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
 				// Throw up the progress bar, enter hashing state
@@ -1317,14 +1535,13 @@ int dialogSteps() {
 
 		case DIALOG_STEP_HASH_CONFIRMED:
 			if (msg_result == MESSAGE_DIALOG_RESULT_RUNNING) {
-				// User has confirmed desire to hash, get requested file entry
-				FileListEntry *file_entry = fileListGetNthEntry(&file_list, base_pos + rel_pos);
-
-				// Place the full file path in cur_file
-				snprintf(cur_file, MAX_PATH_LENGTH, "%s%s", file_list.path, file_entry->name);
-
+				// User has confirmed desire to hash, the thread hashes the marked entries,
+				// a folder, a single file or the files of a manifest
 				HashArguments args;
-				args.file_path = cur_file;
+				args.file_list = &file_list;
+				args.mark_list = &mark_list;
+				args.index = base_pos + rel_pos;
+				args.verify = hash_verify;
 
 				dialog_step = DIALOG_STEP_HASHING;
 
@@ -1336,6 +1553,21 @@ int dialogSteps() {
 
 			break;
 			
+		case DIALOG_STEP_COMPARE_CONFIRMED:
+			if (msg_result == MESSAGE_DIALOG_RESULT_RUNNING) {
+				CompareArguments args;
+				args.path_a = compare_path_a;
+				args.path_b = compare_path_b;
+
+				dialog_step = DIALOG_STEP_COMPARING;
+
+				SceUID thid = sceKernelCreateThread("compare_thread", (SceKernelThreadEntry)compare_thread, 0x40, 0x100000, 0, 0, NULL);
+				if (thid >= 0)
+					sceKernelStartThread(thid, sizeof(CompareArguments), &args);
+			}
+
+			break;
+			
 		case DIALOG_STEP_INSTALL_QUESTION:
 			if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
 				initMessageDialog(MESSAGE_DIALOG_PROGRESS_BAR, language_container[INSTALLING]);
@@ -1571,11 +1803,10 @@ int fileBrowserMenuCtrl() {
 			int type = handleFile(cur_file, file_entry);
 
 			// Archive mode
-			if (type == FILE_TYPE_ZIP) {
-				is_in_archive = 1;
-				dir_level_archive = dir_level;
-
-				snprintf(archive_path, MAX_PATH_LENGTH, "%s%s", file_list.path, file_entry->name);
+			if (type == FILE_TYPE_ZIP || type == FILE_TYPE_TAR) {
+				dir_level_archive[is_in_archive] = dir_level;
+				snprintf(archive_path[is_in_archive], MAX_PATH_LENGTH, "%s%s", file_list.path, file_entry->name);
+				is_in_archive++;
 
 				strcat(file_list.path, file_entry->name);
 				addEndSlash(file_list.path);
@@ -1596,6 +1827,7 @@ int shellMain() {
 
 	// Paths
 	memset(cur_file, 0, sizeof(cur_file));
+	memset(copy_archive_path, 0, sizeof(copy_archive_path));
 	memset(archive_path, 0, sizeof(archive_path));
 
 	// File lists
@@ -1735,6 +1967,7 @@ int shellMain() {
 						icon = image_icon;
 						break;
 						
+					case FILE_TYPE_TAR:
 					case FILE_TYPE_VPK:
 					case FILE_TYPE_ZIP:
 						color = ARCHIVE_COLOR;
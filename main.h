@@ -178,6 +178,7 @@ enum DialogSteps {
 
 	DIALOG_STEP_COMPRESS_NAME,
 	DIALOG_STEP_COMPRESS_LEVEL,
+	DIALOG_STEP_COMPRESS_QUESTION,
 	DIALOG_STEP_COMPRESSING,
 	DIALOG_STEP_COMPRESSED,
 
@@ -201,6 +202,12 @@ enum DialogSteps {
 	DIALOG_STEP_HASH_QUESTION,
 	DIALOG_STEP_HASH_CONFIRMED,
 	DIALOG_STEP_HASHING,
+	DIALOG_STEP_HASHED,
+
+	DIALOG_STEP_COMPARE_CONFIRMED,
+	DIALOG_STEP_COMPARING,
+
+	DIALOG_STEP_FILTER,
 
 	DIALOG_STEP_SETTINGS_AGREEMENT,
 	DIALOG_STEP_SETTINGS_STRING,
@@ -222,7 +229,7 @@ extern volatile int dialog_step;
 extern int use_custom_config;
 
 extern int is_in_archive;
-extern int dir_level_archive;
+extern int dir_level_archive[];
 
 void drawScrollBar(int pos, int n);
 void drawShellInfo(char *path);
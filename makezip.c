@@ -21,8 +21,11 @@
 #include "makezip.h"
 #include "file.h"
 #include "utils.h"
+#include "language.h"
+#include "archive.h"
 
 #include "minizip/zip.h"
+#include "minizip/unzip.h"
 
 void convertToZipTime(SceDateTime *time, tm_zip *tmzip) {
 	SceDateTime time_local;
@@ -36,83 +39,432 @@ void convertToZipTime(SceDateTime *time, tm_zip *tmzip) {
 	tmzip->tm_year = time_local.year;
 }
 
-int zipAddFile(zipFile zf, char *path, int filename_start, int level, FileProcessParam *param) {
+// Files are cut into independent deflate chunks that are compressed on worker
+// threads and written back in order, like pigz
+#define ZIP_CHUNK_SIZE (512 * 1024)
+#define ZIP_OUT_SIZE (ZIP_CHUNK_SIZE + (ZIP_CHUNK_SIZE >> 8) + 64)
+#define ZIP_DICT_SIZE 0x8000
+#define ZIP_MAX_WORKERS 3
+#define ZIP_MAX_JOBS (2 * ZIP_MAX_WORKERS)
+
+// Raw entry transfers are pure I/O, so they use big blocks
+#define ZIP_TRANSFER_SIZE (1 * 1024 * 1024)
+
+// Files whose head does not shrink below 97% are stored
+#define ZIP_TRIAL_SIZE (64 * 1024)
+#define ZIP_TRIAL_RATIO 97
+
+typedef struct {
+	// Entry
+	char filename[MAX_PATH_LENGTH];
+	zip_fileinfo zi;
+	int method;
+	int zip64;
+	int first;
+	int last;
+
+	// Data
+	uint8_t *in;
+	int in_size;
+	uint8_t *dict;
+	int dict_size;
+	uint8_t *out;
+	int out_size;
+	uint32_t crc;
 	int res;
 
-	// Get file stat
-	SceIoStat stat;
-	memset(&stat, 0, sizeof(SceIoStat));
-	res = sceIoGetstat(path, &stat);
+	SceUID done_sema;
+	int busy;
+} ZipJob;
+
+typedef struct {
+	zipFile zf;
+	int level;
+
+	ZipJob jobs[ZIP_MAX_JOBS];
+	int submitted;
+	int taken;
+
+	SceUID workers[ZIP_MAX_WORKERS];
+	int n_workers;
+	SceUID queue_sema;
+	SceUID lock_sema;
+	int quit;
+
+	// Store-vs-deflate trial
+	z_stream trial;
+	int trial_init;
+	uint8_t *trial_out;
+
+	// Entry being written
+	int entry_open;
+	uint64_t entry_size;
+	uint32_t entry_crc;
+} ZipWriter;
+
+static int zipCompressJob(z_stream *stream, ZipJob *job) {
+	job->crc = crc32(0, job->in, job->in_size);
+
+	if (job->method == 0)
+		return 0;
+
+	deflateReset(stream);
+
+	// Continue the previous chunk's window so the ratio does not suffer
+	if (job->dict_size > 0)
+		deflateSetDictionary(stream, job->dict, job->dict_size);
+
+	stream->next_in = job->in;
+	stream->avail_in = job->in_size;
+	stream->next_out = job->out;
+	stream->avail_out = ZIP_OUT_SIZE;
+
+	// Sync flush ends the chunk on a byte boundary so the next one can be appended
+	int res = deflate(stream, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+	if (res != (job->last ? Z_STREAM_END : Z_OK) || stream->avail_in != 0)
+		return res < 0 ? res : Z_BUF_ERROR;
+
+	job->out_size = ZIP_OUT_SIZE - stream->avail_out;
+
+	return 0;
+}
+
+static int zip_worker_thread(SceSize args, void *argp) {
+	ZipWriter *writer = *(ZipWriter **)argp;
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(z_stream));
+	int init = deflateInit2(&stream, writer->level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+
+	while (1) {
+		sceKernelWaitSema(writer->queue_sema, 1, NULL);
+		if (writer->quit)
+			break;
+
+		// Jobs are taken in the order they were submitted
+		sceKernelWaitSema(writer->lock_sema, 1, NULL);
+		ZipJob *job = &writer->jobs[writer->taken % ZIP_MAX_JOBS];
+		writer->taken++;
+		sceKernelSignalSema(writer->lock_sema, 1);
+
+		job->res = (init == Z_OK) ? zipCompressJob(&stream, job) : init;
+
+		sceKernelSignalSema(job->done_sema, 1);
+	}
+
+	if (init == Z_OK)
+		deflateEnd(&stream);
+
+	return sceKernelExitDeleteThread(0);
+}
+
+static int zipWriterRetire(ZipWriter *writer, ZipJob *job) {
+	int res;
+
+	sceKernelWaitSema(job->done_sema, 1, NULL);
+	job->busy = 0;
+
+	if (job->res < 0)
+		return job->res;
+
+	if (job->first) {
+		res = zipOpenNewFileInZip3_64(writer->zf, job->filename, &job->zi,
+					NULL, 0, NULL, 0, NULL,
+					job->method, job->method ? writer->level : 0, 1,
+					-MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+					NULL, 0, job->zip64);
+		if (res < 0)
+			return res;
+
+		writer->entry_open = 1;
+		writer->entry_size = 0;
+		writer->entry_crc = 0;
+	}
+
+	if (job->method == 0) {
+		res = zipWriteInFileInZip(writer->zf, job->in, job->in_size);
+	} else {
+		res = zipWriteInFileInZip(writer->zf, job->out, job->out_size);
+	}
+
 	if (res < 0)
 		return res;
 
-	// Get file local time
-	zip_fileinfo zi;
-	memset(&zi, 0, sizeof(zip_fileinfo));
-	convertToZipTime(&stat.st_mtime, &zi.tmz_date);
+	writer->entry_crc = crc32_combine(writer->entry_crc, job->crc, job->in_size);
+	writer->entry_size += job->in_size;
 
-	// Large file?
-	int use_zip64 = (stat.st_size >= 0xFFFFFFFF);
+	if (job->last) {
+		writer->entry_open = 0;
 
-	// Open new file in zip
-	char filename[MAX_PATH_LENGTH];
-	strcpy(filename, path + filename_start);
+		res = zipCloseFileInZipRaw64(writer->zf, writer->entry_size, writer->entry_crc);
+		if (res < 0)
+			return res;
+	}
 
-	res = zipOpenNewFileInZip3_64(zf, filename, &zi,
-				NULL, 0, NULL, 0, NULL,
-				(level != 0) ? Z_DEFLATED : 0,
-				level, 0,
-				-MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
-				NULL, 0, use_zip64);
+	return 0;
+}
+
+// Get a free job slot, writing out the job that occupied it
+static ZipJob *zipWriterGetJob(ZipWriter *writer, int *res) {
+	ZipJob *job = &writer->jobs[writer->submitted % ZIP_MAX_JOBS];
+
+	*res = 0;
+	if (job->busy)
+		*res = zipWriterRetire(writer, job);
+
+	return job;
+}
+
+static void zipWriterSubmit(ZipWriter *writer, ZipJob *job) {
+	job->busy = 1;
+	job->res = 0;
+	writer->submitted++;
+
+	sceKernelSignalSema(writer->queue_sema, 1);
+}
+
+static int zipWriterFlush(ZipWriter *writer) {
+	int res = 0;
+
+	int i;
+	for (i = 0; i < ZIP_MAX_JOBS; i++) {
+		ZipJob *job = &writer->jobs[(writer->submitted + i) % ZIP_MAX_JOBS];
+		if (job->busy) {
+			int ret = zipWriterRetire(writer, job);
+			if (res == 0)
+				res = ret;
+		}
+	}
+
+	return res;
+}
+
+static void zipWriterClose(ZipWriter *writer) {
+	int i;
+
+	// Wait for the outstanding jobs without writing them
+	for (i = 0; i < ZIP_MAX_JOBS; i++) {
+		if (writer->jobs[i].busy) {
+			sceKernelWaitSema(writer->jobs[i].done_sema, 1, NULL);
+			writer->jobs[i].busy = 0;
+		}
+	}
+
+	if (writer->entry_open)
+		zipCloseFileInZipRaw64(writer->zf, writer->entry_size, writer->entry_crc);
+
+	writer->quit = 1;
+	if (writer->queue_sema >= 0)
+		sceKernelSignalSema(writer->queue_sema, writer->n_workers);
+
+	for (i = 0; i < writer->n_workers; i++)
+		sceKernelWaitThreadEnd(writer->workers[i], NULL, NULL);
+
+	for (i = 0; i < ZIP_MAX_JOBS; i++) {
+		ZipJob *job = &writer->jobs[i];
+
+		if (job->done_sema >= 0)
+			sceKernelDeleteSema(job->done_sema);
+
+		if (job->in)
+			free(job->in);
+		if (job->out)
+			free(job->out);
+		if (job->dict)
+			free(job->dict);
+	}
+
+	if (writer->queue_sema >= 0)
+		sceKernelDeleteSema(writer->queue_sema);
+	if (writer->lock_sema >= 0)
+		sceKernelDeleteSema(writer->lock_sema);
+
+	if (writer->trial_init)
+		deflateEnd(&writer->trial);
+	if (writer->trial_out)
+		free(writer->trial_out);
+
+	free(writer);
+}
+
+static ZipWriter *zipWriterOpen(zipFile zf, int level) {
+	ZipWriter *writer = malloc(sizeof(ZipWriter));
+	if (!writer)
+		return NULL;
+
+	memset(writer, 0, sizeof(ZipWriter));
+	writer->zf = zf;
+	writer->level = level;
 
+	int i;
+	for (i = 0; i < ZIP_MAX_JOBS; i++)
+		writer->jobs[i].done_sema = -1;
+
+	writer->lock_sema = sceKernelCreateSema("zip_lock_sema", 0, 1, 1, NULL);
+	writer->queue_sema = sceKernelCreateSema("zip_queue_sema", 0, 0, ZIP_MAX_JOBS + ZIP_MAX_WORKERS, NULL);
+
+	for (i = 0; i < ZIP_MAX_JOBS; i++) {
+		ZipJob *job = &writer->jobs[i];
+
+		job->done_sema = sceKernelCreateSema("zip_job_sema", 0, 0, 1, NULL);
+		job->in = malloc(ZIP_CHUNK_SIZE);
+		job->out = malloc(ZIP_OUT_SIZE);
+		job->dict = malloc(ZIP_DICT_SIZE);
+
+		if (job->done_sema < 0 || !job->in || !job->out || !job->dict) {
+			zipWriterClose(writer);
+			return NULL;
+		}
+	}
+
+	if (writer->lock_sema < 0 || writer->queue_sema < 0) {
+		zipWriterClose(writer);
+		return NULL;
+	}
+
+	if (level != 0) {
+		writer->trial_out = malloc(ZIP_TRIAL_SIZE * ZIP_TRIAL_RATIO / 100);
+		if (!writer->trial_out ||
+			deflateInit2(&writer->trial, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+			zipWriterClose(writer);
+			return NULL;
+		}
+
+		writer->trial_init = 1;
+	}
+
+	for (i = 0; i < ZIP_MAX_WORKERS; i++) {
+		SceUID thid = sceKernelCreateThread("zip_worker_thread", (SceKernelThreadEntry)zip_worker_thread, 0x40, 0x10000, 0, 0x70000, NULL);
+		if (thid < 0)
+			break;
+
+		sceKernelStartThread(thid, sizeof(ZipWriter *), &writer);
+		writer->workers[writer->n_workers++] = thid;
+	}
+
+	if (writer->n_workers == 0) {
+		zipWriterClose(writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+// Already compressed formats are stored
+static int zipIsCompressedType(char *path) {
+	switch (getFileType(path)) {
+		case FILE_TYPE_JPEG:
+		case FILE_TYPE_MP3:
+		case FILE_TYPE_OGG:
+		case FILE_TYPE_PNG:
+		case FILE_TYPE_VPK:
+		case FILE_TYPE_ZIP:
+			return 1;
+	}
+
+	return 0;
+}
+
+// Decide the method of a file from its type and its first chunk
+static int zipGetMethod(ZipWriter *writer, char *path, uint8_t *data, int size) {
+	if (writer->level == 0 || size == 0)
+		return 0;
+
+	if (zipIsCompressedType(path))
+		return 0;
+
+	// Trial compress the head at the fastest level. If it does not fit
+	// into 97% of its size, deflating the whole file is not worth it
+	z_stream *trial = &writer->trial;
+	deflateReset(trial);
+
+	trial->next_in = data;
+	trial->avail_in = MIN(size, ZIP_TRIAL_SIZE);
+	trial->next_out = writer->trial_out;
+	trial->avail_out = trial->avail_in * ZIP_TRIAL_RATIO / 100;
+
+	if (deflate(trial, Z_FINISH) != Z_STREAM_END)
+		return 0;
+
+	return Z_DEFLATED;
+}
+
+int zipAddFile(ZipWriter *writer, char *path, int filename_start, int level, FileProcessParam *param) {
+	int res;
+
+	// Get file stat
+	SceIoStat stat;
+	memset(&stat, 0, sizeof(SceIoStat));
+	res = sceIoGetstat(path, &stat);
 	if (res < 0)
 		return res;
 
 	// Open file to add
 	SceUID fd = sceIoOpen(path, SCE_O_RDONLY, 0);
-	if (fd < 0) {
-		zipCloseFileInZip(zf);
+	if (fd < 0)
 		return fd;
-	}
-
-	// Add file to zip
-	void *buf = malloc(TRANSFER_SIZE);
 
 	uint64_t seek = 0;
+	ZipJob *prev = NULL;
+	int method = 0;
 
 	while (1) {
-		int read = sceIoRead(fd, buf, TRANSFER_SIZE);
-		if (read == SCE_ERROR_ERRNO_ENODEV) {
-			fd = sceIoOpen(path, SCE_O_RDONLY, 0);
-			if (fd >= 0) {
-				sceIoLseek(fd, seek, SCE_SEEK_SET);
-				read = sceIoRead(fd, buf, TRANSFER_SIZE);
-			}
+		ZipJob *job = zipWriterGetJob(writer, &res);
+		if (res < 0) {
+			sceIoClose(fd);
+			return res;
 		}
 
-		if (read < 0) {
-			free(buf);
+		// Read the next chunk straight into the job, a read may return less than asked
+		int size = (int)MIN(ZIP_CHUNK_SIZE, stat.st_size - seek);
+		int read = 0;
+
+		while (read < size) {
+			res = sceIoRead(fd, job->in + read, size - read);
+			if (res == SCE_ERROR_ERRNO_ENODEV) {
+				fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+				if (fd >= 0) {
+					sceIoLseek(fd, seek + read, SCE_SEEK_SET);
+					res = sceIoRead(fd, job->in + read, size - read);
+				}
+			}
 
-			sceIoClose(fd);
-			zipCloseFileInZip(zf);
+			// The file ended before its size
+			if (res <= 0) {
+				sceIoClose(fd);
+				return res < 0 ? res : ZIP_ERRNO;
+			}
 
-			return read;
+			read += res;
 		}
 
-		if (read == 0)
-			break;
+		job->first = (prev == NULL);
+		job->last = (seek + read >= stat.st_size);
+		job->in_size = read;
+		job->dict_size = 0;
 
-		int written = zipWriteInFileInZip(zf, buf, read);
-		if (written < 0) {
-			free(buf);
+		if (job->first) {
+			// Get file local time
+			memset(&job->zi, 0, sizeof(zip_fileinfo));
+			convertToZipTime(&stat.st_mtime, &job->zi.tmz_date);
 
-			sceIoClose(fd);
-			zipCloseFileInZip(zf);
+			// Large file?
+			job->zip64 = (stat.st_size >= 0xFFFFFFFF);
 
-			return written;
+			strcpy(job->filename, path + filename_start);
+
+			method = zipGetMethod(writer, path, job->in, read);
+		} else {
+			job->dict_size = MIN(ZIP_DICT_SIZE, prev->in_size);
+			memcpy(job->dict, prev->in + prev->in_size - job->dict_size, job->dict_size);
 		}
 
-		seek += written;
+		job->method = method;
+
+		zipWriterSubmit(writer, job);
+		prev = job;
+
+		seek += read;
 
 		if (param) {
 			if (param->value)
@@ -122,25 +474,21 @@ int zipAddFile(zipFile zf, char *path, int filename_start, int level, FileProces
 				param->SetProgress(param->value ? *param->value : 0, param->max);
 
 			if (param->cancelHandler && param->cancelHandler()) {
-				free(buf);
-
 				sceIoClose(fd);
-				zipCloseFileInZip(zf);
-
 				return 0;
 			}
 		}
-	}
 
-	free(buf);
+		if (job->last)
+			break;
+	}
 
 	sceIoClose(fd);
-	zipCloseFileInZip(zf);
 
 	return 1;
 }
 
-int zipAddFolder(zipFile zf, char *path, int filename_start, int level, FileProcessParam *param) {
+int zipAddFolder(ZipWriter *writer, char *path, int filename_start, int level, FileProcessParam *param) {
 	int res;
 
 	// Get file stat
@@ -150,25 +498,26 @@ int zipAddFolder(zipFile zf, char *path, int filename_start, int level, FileProc
 	if (res < 0)
 		return res;
 
+	ZipJob *job = zipWriterGetJob(writer, &res);
+	if (res < 0)
+		return res;
+
 	// Get file local time
-	zip_fileinfo zi;
-	memset(&zi, 0, sizeof(zip_fileinfo));
-	convertToZipTime(&stat.st_mtime, &zi.tmz_date);
+	memset(&job->zi, 0, sizeof(zip_fileinfo));
+	convertToZipTime(&stat.st_mtime, &job->zi.tmz_date);
 
 	// Open new file in zip
-	char filename[MAX_PATH_LENGTH];
-	strcpy(filename, path + filename_start);
-	addEndSlash(filename);
+	strcpy(job->filename, path + filename_start);
+	addEndSlash(job->filename);
 
-	res = zipOpenNewFileInZip3_64(zf, filename, &zi,
-				NULL, 0, NULL, 0, NULL,
-				(level != 0) ? Z_DEFLATED : 0,
-				level, 0,
-				-MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
-				NULL, 0, 0);
+	job->first = 1;
+	job->last = 1;
+	job->method = 0;
+	job->zip64 = 0;
+	job->in_size = 0;
+	job->dict_size = 0;
 
-	if (res < 0)
-		return res;
+	zipWriterSubmit(writer, job);
 
 	if (param) {
 		if (param->value)
@@ -178,20 +527,17 @@ int zipAddFolder(zipFile zf, char *path, int filename_start, int level, FileProc
 			param->SetProgress(param->value ? *param->value : 0, param->max);
 
 		if (param->cancelHandler && param->cancelHandler()) {
-			zipCloseFileInZip(zf);
 			return 0;
 		}
 	}
 
-	zipCloseFileInZip(zf);
-
 	return 1;
 }
 
-int zipAddPath(zipFile zf, char *path, int filename_start, int level, FileProcessParam *param) {
+int zipAddPath(ZipWriter *writer, char *path, int filename_start, int level, FileProcessParam *param) {
 	SceUID dfd = sceIoDopen(path);
 	if (dfd >= 0) {
-		int ret = zipAddFolder(zf, path, filename_start, level, param);
+		int ret = zipAddFolder(writer, path, filename_start, level, param);
 		if (ret <= 0)
 			return ret;
 
@@ -209,9 +555,9 @@ int zipAddPath(zipFile zf, char *path, int filename_start, int level, FileProces
 				int ret = 0;
 
 				if (SCE_S_ISDIR(dir.d_stat.st_mode)) {
-					ret = zipAddPath(zf, new_path, filename_start, level, param);
+					ret = zipAddPath(writer, new_path, filename_start, level, param);
 				} else {
-					ret = zipAddFile(zf, new_path, filename_start, level, param);
+					ret = zipAddFile(writer, new_path, filename_start, level, param);
 				}
 
 				free(new_path);
@@ -226,24 +572,459 @@ int zipAddPath(zipFile zf, char *path, int filename_start, int level, FileProces
 
 		sceIoDclose(dfd);
 	} else {
-		return zipAddFile(zf, path, filename_start, level, param);
+		return zipAddFile(writer, path, filename_start, level, param);
 	}
 
 	return 1;
 }
 
-int makeZip(char *zip_file, char *src_path, int filename_start, int level, int append, FileProcessParam *param) {
+// Close the zip and cut off what is left of a central directory that shrank.
+// When updating, entries added again replace the older ones of the same name
+static int zipCloseTruncate(zipFile zf, char *zip_file, int replace) {
+	int res = replace ? zipRemoveReplaced(zf) : 0;
+
+	ZPOS64_T end_pos = 0;
+	int ret = zipClose3_64(zf, NULL, 0, &end_pos);
+	if (res >= 0)
+		res = ret;
+	if (res < 0)
+		return res;
+
+	SceIoStat stat;
+	memset(&stat, 0, sizeof(SceIoStat));
+	res = sceIoGetstat(zip_file, &stat);
+	if (res < 0)
+		return res;
+
+	if (end_pos > 0 && stat.st_size > end_pos) {
+		stat.st_size = end_pos;
+		res = sceIoChstat(zip_file, &stat, SCE_CST_SIZE);
+		if (res < 0)
+			return res;
+	}
+
+	return 0;
+}
+
+int makeZip(char *zip_file, char *src_path, int filename_start, int level, int append, int replace, FileProcessParam *param) {
 	zipFile zf = zipOpen64(zip_file, append);
 	if (zf == NULL)
 		return -1;
 
-	int res = zipAddPath(zf, src_path, filename_start, level, param);
+	ZipWriter *writer = zipWriterOpen(zf, level);
+	if (!writer) {
+		zipClose(zf, NULL);
+		return -1;
+	}
 
-	zipClose(zf, NULL);
+	int res = zipAddPath(writer, src_path, filename_start, level, param);
+
+	// Write the chunks still in flight
+	if (res > 0) {
+		int ret = zipWriterFlush(writer);
+		if (ret < 0)
+			res = ret;
+	}
+
+	zipWriterClose(writer);
+
+	int ret = zipCloseTruncate(zf, zip_file, replace);
+	if (res > 0 && ret < 0)
+		res = ret;
+
+	return res;
+}
+
+// Copy the current entry of uf into zf without recompressing it
+static int zipTransferEntry(zipFile zf, unzFile uf, SceUID *fd, char *src_zip, char *filename, void *buf, FileProcessParam *param) {
+	int res;
+
+	unz_file_info64 file_info;
+	res = unzGetCurrentFileInfo64(uf, &file_info, NULL, 0, NULL, 0, NULL, 0);
+	if (res < 0)
+		return res;
+
+	// Encrypted data can not be written without its password
+	if (file_info.flag & 1)
+		return UNZ_PARAMERROR;
+
+	// Get position of the compressed data
+	int method = 0, level = 0;
+	res = unzOpenCurrentFile2(uf, &method, &level, 1);
+	if (res < 0)
+		return res;
+
+	SceOff offset = (SceOff)unzGetCurrentFileZStreamPos64(uf);
+	unzCloseCurrentFile(uf);
+
+	zip_fileinfo zi;
+	memset(&zi, 0, sizeof(zip_fileinfo));
+	zi.dosDate = file_info.dosDate;
+	zi.internal_fa = file_info.internal_fa;
+	zi.external_fa = file_info.external_fa;
+
+	// Keep the deflate option and UTF-8 flags of the source
+	res = zipOpenNewFileInZip4_64(zf, filename, &zi,
+				NULL, 0, NULL, 0, NULL,
+				method, 0, 1,
+				-MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+				NULL, 0, 0, file_info.flag & 0x806,
+				file_info.uncompressed_size >= 0xFFFFFFFF);
+	if (res < 0)
+		return res;
+
+	uint64_t seek = 0;
+	uint64_t reported = 0;
+
+	sceIoLseek(*fd, offset, SCE_SEEK_SET);
+
+	while (seek < file_info.compressed_size) {
+		int size = (int)MIN(ZIP_TRANSFER_SIZE, file_info.compressed_size - seek);
+
+		int read = sceIoRead(*fd, buf, size);
+		if (read == SCE_ERROR_ERRNO_ENODEV) {
+			*fd = sceIoOpen(src_zip, SCE_O_RDONLY, 0);
+			if (*fd >= 0) {
+				sceIoLseek(*fd, offset + seek, SCE_SEEK_SET);
+				read = sceIoRead(*fd, buf, size);
+			}
+		}
+
+		if (read <= 0) {
+			zipCloseFileInZipRaw64(zf, 0, 0);
+			return read < 0 ? read : UNZ_ERRNO;
+		}
+
+		res = zipWriteInFileInZip(zf, buf, read);
+		if (res < 0) {
+			zipCloseFileInZipRaw64(zf, 0, 0);
+			return res;
+		}
+
+		seek += read;
+
+		if (param) {
+			// Progress is counted in uncompressed bytes like extraction
+			uint64_t done = file_info.uncompressed_size * seek / file_info.compressed_size;
+
+			if (param->value)
+				(*param->value) += done - reported;
+			reported = done;
+
+			if (param->SetProgress)
+				param->SetProgress(param->value ? *param->value : 0, param->max);
+
+			if (param->cancelHandler && param->cancelHandler()) {
+				zipCloseFileInZipRaw64(zf, 0, 0);
+				return 0;
+			}
+		}
+	}
+
+	res = zipCloseFileInZipRaw64(zf, file_info.uncompressed_size, file_info.crc);
+	if (res < 0)
+		return res;
+
+	if (param && param->value) {
+		// Folders count as one like in getArchivePathInfo
+		if (hasEndSlash(filename))
+			(*param->value)++;
+		else
+			(*param->value) += file_info.uncompressed_size - reported;
+	}
+
+	return 1;
+}
+
+int transferZip(char *zip_file, char *src_zip, char *src_path, int filename_start, int append, int replace, FileProcessParam *param) {
+	int res = 0;
+
+	// The source can not be updated while reading from it
+	if (strcasecmp(zip_file, src_zip) == 0)
+		return -1;
+
+	unzFile uf = unzOpen64(src_zip);
+	if (uf == NULL)
+		return -1;
+
+	SceUID fd = sceIoOpen(src_zip, SCE_O_RDONLY, 0);
+	if (fd < 0) {
+		unzClose(uf);
+		return fd;
+	}
+
+	zipFile zf = zipOpen64(zip_file, append);
+	if (zf == NULL) {
+		sceIoClose(fd);
+		unzClose(uf);
+		return -1;
+	}
+
+	void *buf = malloc(ZIP_TRANSFER_SIZE);
+	if (!buf) {
+		zipClose(zf, NULL);
+		sceIoClose(fd);
+		unzClose(uf);
+		return -1;
+	}
+
+	int src_length = strlen(src_path);
+	if (src_length > 0 && src_path[src_length - 1] == '/')
+		src_length--;
+
+	res = unzGoToFirstFile(uf);
+	while (res >= 0) {
+		char name[MAX_PATH_LENGTH];
+		res = unzGetCurrentFileInfo64(uf, NULL, name, MAX_PATH_LENGTH, NULL, 0, NULL, 0);
+		if (res < 0)
+			break;
+
+		// The entry itself and everything below it
+		if (strncasecmp(name, src_path, src_length) == 0 && (name[src_length] == '\0' || name[src_length] == '/')) {
+			res = zipTransferEntry(zf, uf, &fd, src_zip, name + filename_start, buf, param);
+			if (res <= 0)
+				break;
+		}
+
+		res = unzGoToNextFile(uf);
+	}
+
+	if (res == UNZ_END_OF_LIST_OF_FILE)
+		res = 1;
+
+	free(buf);
+
+	int ret = zipCloseTruncate(zf, zip_file, replace);
+	if (res > 0 && ret < 0)
+		res = ret;
+
+	sceIoClose(fd);
+	unzClose(uf);
 
 	return res;
 }
 
+// The auto level deflates a few blocks spread over the input at each
+// candidate level and predicts the total time from the measured rates
+#define ZIP_SAMPLE_BLOCKS 16
+#define ZIP_SAMPLE_SIZE (32 * 1024)
+#define ZIP_DEFAULT_LEVEL 6
+
+static int zip_auto_levels[] = { 1, 3, 6, 9 };
+
+#define N_ZIP_AUTO_LEVELS (sizeof(zip_auto_levels) / sizeof(int))
+
+typedef struct {
+	uint8_t *buf;
+	int block_size[ZIP_SAMPLE_BLOCKS];
+	int n_blocks;
+	int next;
+	uint64_t total;
+	uint64_t pos;
+	uint64_t stored;
+	uint64_t read_bytes;
+	SceUInt64 read_time;
+} ZipSampler;
+
+static void zipSampleFile(ZipSampler *sampler, char *path, SceOff size) {
+	uint64_t start = sampler->pos;
+	sampler->pos += size;
+
+	// Samples landing in stored files are dropped
+	if (zipIsCompressedType(path)) {
+		sampler->stored += size;
+		while (sampler->next < ZIP_SAMPLE_BLOCKS && sampler->total * sampler->next / ZIP_SAMPLE_BLOCKS < sampler->pos)
+			sampler->next++;
+		return;
+	}
+
+	SceUID fd = -1;
+
+	while (sampler->next < ZIP_SAMPLE_BLOCKS) {
+		uint64_t offset = sampler->total * sampler->next / ZIP_SAMPLE_BLOCKS;
+		if (offset >= sampler->pos)
+			break;
+
+		sampler->next++;
+
+		if (fd < 0) {
+			fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+			if (fd < 0)
+				continue;
+		}
+
+		// Keep the block inside the file
+		SceOff local = offset - start;
+		if (local + ZIP_SAMPLE_SIZE > size)
+			local = MAX(size - ZIP_SAMPLE_SIZE, 0);
+
+		SceUInt64 time = sceKernelGetProcessTimeWide();
+
+		uint8_t *block = sampler->buf + sampler->n_blocks * ZIP_SAMPLE_SIZE;
+		sceIoLseek(fd, local, SCE_SEEK_SET);
+		int read = sceIoRead(fd, block, ZIP_SAMPLE_SIZE);
+
+		sampler->read_time += sceKernelGetProcessTimeWide() - time;
+
+		if (read > 0) {
+			sampler->block_size[sampler->n_blocks++] = read;
+			sampler->read_bytes += read;
+		}
+	}
+
+	if (fd >= 0)
+		sceIoClose(fd);
+}
+
+static void zipSamplePath(ZipSampler *sampler, char *path) {
+	SceUID dfd = sceIoDopen(path);
+	if (dfd >= 0) {
+		int res = 0;
+
+		do {
+			SceIoDirent dir;
+			memset(&dir, 0, sizeof(SceIoDirent));
+
+			res = sceIoDread(dfd, &dir);
+			if (res > 0) {
+				char *new_path = malloc(strlen(path) + strlen(dir.d_name) + 2);
+				snprintf(new_path, MAX_PATH_LENGTH, "%s%s%s", path, hasEndSlash(path) ? "" : "/", dir.d_name);
+
+				if (SCE_S_ISDIR(dir.d_stat.st_mode)) {
+					zipSamplePath(sampler, new_path);
+				} else {
+					zipSampleFile(sampler, new_path, dir.d_stat.st_size);
+				}
+
+				free(new_path);
+			}
+		} while (res > 0 && sampler->next < ZIP_SAMPLE_BLOCKS);
+
+		sceIoDclose(dfd);
+	} else {
+		SceIoStat stat;
+		memset(&stat, 0, sizeof(SceIoStat));
+		if (sceIoGetstat(path, &stat) >= 0)
+			zipSampleFile(sampler, path, stat.st_size);
+	}
+}
+
+// Pick the level with the shortest predicted time, or with the best ratio
+// that still finishes within the budget (in seconds). Deflate runs on the
+// workers while the main thread reads and writes, so the slower of both
+// bounds the time
+static int zipChooseLevel(ZipSampler *sampler, int budget, int *ratio, int *rate) {
+	int i, j;
+
+	*ratio = 100;
+	*rate = 0;
+
+	if (sampler->n_blocks == 0 || sampler->read_bytes == 0)
+		return ZIP_DEFAULT_LEVEL;
+
+	int out_size = deflateBound(NULL, ZIP_SAMPLE_SIZE);
+	uint8_t *out = malloc(out_size);
+	if (!out)
+		return ZIP_DEFAULT_LEVEL;
+
+	double deflate_bytes = (double)(sampler->total - sampler->stored);
+	double io_rate = (double)sampler->read_bytes / (double)MAX(sampler->read_time, 1);
+
+	double times[N_ZIP_AUTO_LEVELS], ratios[N_ZIP_AUTO_LEVELS];
+	int n_levels = 0;
+
+	for (i = 0; i < N_ZIP_AUTO_LEVELS; i++) {
+		z_stream stream;
+		memset(&stream, 0, sizeof(z_stream));
+		if (deflateInit2(&stream, zip_auto_levels[i], Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK)
+			break;
+
+		uint64_t in_bytes = 0, out_bytes = 0;
+		SceUInt64 time = sceKernelGetProcessTimeWide();
+
+		for (j = 0; j < sampler->n_blocks; j++) {
+			deflateReset(&stream);
+
+			stream.next_in = sampler->buf + j * ZIP_SAMPLE_SIZE;
+			stream.avail_in = sampler->block_size[j];
+			stream.next_out = out;
+			stream.avail_out = out_size;
+			deflate(&stream, Z_FINISH);
+
+			in_bytes += sampler->block_size[j];
+			out_bytes += stream.total_out;
+		}
+
+		time = MAX(sceKernelGetProcessTimeWide() - time, 1);
+		deflateEnd(&stream);
+
+		ratios[i] = (double)out_bytes / (double)in_bytes;
+
+		double cpu = deflate_bytes * (double)time / (double)in_bytes / ZIP_MAX_WORKERS;
+		double io = ((double)sampler->total + (double)sampler->stored + deflate_bytes * ratios[i]) / io_rate;
+		times[i] = MAX(cpu, io);
+
+		n_levels++;
+	}
+
+	free(out);
+
+	if (n_levels == 0)
+		return ZIP_DEFAULT_LEVEL;
+
+	int fastest = 0;
+	for (i = 1; i < n_levels; i++) {
+		if (times[i] < times[fastest])
+			fastest = i;
+	}
+
+	// Without a budget a level that is almost as fast but smaller wins
+	double limit = budget > 0 ? (double)budget * 1000000.0f : times[fastest] * 1.05f;
+
+	int best = fastest;
+	for (i = 0; i < n_levels; i++) {
+		if (times[i] <= limit && ratios[i] < ratios[best])
+			best = i;
+	}
+
+	double total_ratio = ((double)sampler->stored + deflate_bytes * ratios[best]) / (double)MAX(sampler->total, 1);
+	*ratio = (int)(total_ratio * 100.0f);
+	*rate = (int)((double)sampler->total / times[best] * 1000000.0f / 1024.0f);
+
+	return zip_auto_levels[best];
+}
+
+static int zipAutoLevel(FileList *file_list, FileListEntry *head, int count, uint64_t size) {
+	ZipSampler sampler;
+	memset(&sampler, 0, sizeof(ZipSampler));
+	sampler.total = size;
+
+	sampler.buf = malloc(ZIP_SAMPLE_BLOCKS * ZIP_SAMPLE_SIZE);
+	if (!sampler.buf)
+		return ZIP_DEFAULT_LEVEL;
+
+	char path[MAX_PATH_LENGTH];
+	FileListEntry *mark_entry = head;
+
+	int i;
+	for (i = 0; i < count && sampler.next < ZIP_SAMPLE_BLOCKS; i++) {
+		snprintf(path, MAX_PATH_LENGTH, "%s%s", file_list->path, mark_entry->name);
+		zipSamplePath(&sampler, path);
+		mark_entry = mark_entry->next;
+	}
+
+	int ratio = 0, rate = 0;
+	int level = zipChooseLevel(&sampler, vitashell_config.compress_time_budget, &ratio, &rate);
+
+	free(sampler.buf);
+
+	char msg[128];
+	snprintf(msg, sizeof(msg), language_container[COMPRESSING_AUTO_LEVEL], level, ratio, rate);
+	sceMsgDialogProgressBarSetMsg(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, (SceChar8 *)msg);
+
+	return level;
+}
+
 int compress_thread(SceSize args_size, CompressArguments *args) {
 	SceUID thid = -1;
 
@@ -284,7 +1065,11 @@ int compress_thread(SceSize args_size, CompressArguments *args) {
 	for (i = 0; i < count; i++) {
 		snprintf(path, MAX_PATH_LENGTH, "%s%s", args->file_list->path, mark_entry->name);
 
-		getPathInfo(path, &size, &folders, &files, NULL);
+		if (args->archive_path) {
+			getArchivePathInfo(path, &size, &folders, &files);
+		} else {
+			getPathInfo(path, &size, &folders, &files, NULL);
+		}
 
 		mark_entry = mark_entry->next;
 	}
@@ -294,6 +1079,11 @@ int compress_thread(SceSize args_size, CompressArguments *args) {
 	if (checkMemoryCardFreeSpace((uint64_t)guessed_size))
 		goto EXIT;
 
+	// Sample the input to find a level
+	int level = args->level;
+	if (level == ZIP_LEVEL_AUTO && !args->archive_path)
+		level = zipAutoLevel(args->file_list, head, count, size);
+
 	// Update thread
 	thid = createStartUpdateThread(size + folders);
 
@@ -311,7 +1101,18 @@ int compress_thread(SceSize args_size, CompressArguments *args) {
 		param.SetProgress = SetProgress;
 		param.cancelHandler = cancelHandler;
 
-		int res = makeZip(args->path, path, strlen(args->file_list->path), args->level, i == 0 ? APPEND_STATUS_CREATE : APPEND_STATUS_ADDINZIP, &param);
+		// An existing zip is updated in place if the user asked for it, with the
+		// new entries replacing those of the same name
+		int append = (i == 0 && !args->update) ? APPEND_STATUS_CREATE : APPEND_STATUS_ADDINZIP;
+
+		int res;
+		if (args->archive_path) {
+			// Entries of an archive are copied without recompressing them
+			int inner_start = strlen(args->archive_path) + 1;
+			res = transferZip(args->path, args->archive_path, path + inner_start, strlen(args->file_list->path) - inner_start, append, args->update, &param);
+		} else {
+			res = makeZip(args->path, path, strlen(args->file_list->path), level, append, args->update, &param);
+		}
 		if (res <= 0) {
 			closeWaitDialog();
 			dialog_step = DIALOG_STEP_CANCELLED;
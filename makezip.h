@@ -19,14 +19,21 @@
 #ifndef __MAKEZIP_H__
 #define __MAKEZIP_H__
 
+#define ZIP_LEVEL_AUTO -1
+
 typedef struct {
 	FileList *file_list;
 	FileList *mark_list;
 	int index;
 	int level;
 	char *path;
+	char *archive_path;
+	int update;
 } CompressArguments;
 
+int makeZip(char *zip_file, char *src_path, int filename_start, int level, int append, int replace, FileProcessParam *param);
+int transferZip(char *zip_file, char *src_zip, char *src_path, int filename_start, int append, int replace, FileProcessParam *param);
+
 int compress_thread(SceSize args_size, CompressArguments *args);
 
 #endif
\ No newline at end of file
@@ -116,6 +116,12 @@ typedef struct
 #ifdef HAVE_BZIP2
     bz_stream bstream;                  /* bzLib stream structure for bziped */
 #endif
+#ifdef HAVE_LZMA
+    lzma_stream lstream;                /* liblzma stream structure for lzma */
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zstream;              /* zstd stream structure for zstd */
+#endif
 #ifdef HAVE_AES
     fcrypt_ctx aes_ctx;
 #endif
@@ -1052,6 +1058,12 @@ local int unz64local_CheckCurrentFileCoherencyHeader(unz64_s* s, uInt* piSizeVar
     if ((err == UNZ_OK) && (compression_method != 0) &&
 #ifdef HAVE_BZIP2
         (compression_method != Z_BZIP2ED) &&
+#endif
+#ifdef HAVE_LZMA
+        (compression_method != Z_LZMA) &&
+#endif
+#ifdef HAVE_ZSTD
+        (compression_method != Z_ZSTD) &&
 #endif
         (compression_method != Z_DEFLATED))
         err = UNZ_BADZIPFILE;
@@ -1159,6 +1171,12 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method, int* level, in
     if ((compression_method != 0) &&
 #ifdef HAVE_BZIP2
         (compression_method != Z_BZIP2ED) &&
+#endif
+#ifdef HAVE_LZMA
+        (compression_method != Z_LZMA) &&
+#endif
+#ifdef HAVE_ZSTD
+        (compression_method != Z_ZSTD) &&
 #endif
         (compression_method != Z_DEFLATED))
         err = UNZ_BADZIPFILE;
@@ -1203,6 +1221,39 @@ extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int* method, int* level, in
             }
 #else
             pfile_in_zip_read_info->raw = 1;
+#endif
+        }
+        else if (compression_method == Z_LZMA)
+        {
+#ifdef HAVE_LZMA
+            lzma_stream init = LZMA_STREAM_INIT;
+
+            pfile_in_zip_read_info->lstream = init;
+            pfile_in_zip_read_info->stream.next_in = 0;
+            pfile_in_zip_read_info->stream.avail_in = 0;
+            /* the decoder is set up from the properties header on the first read */
+#else
+            pfile_in_zip_read_info->raw = 1;
+#endif
+        }
+        else if (compression_method == Z_ZSTD)
+        {
+#ifdef HAVE_ZSTD
+            pfile_in_zip_read_info->stream.next_in = 0;
+            pfile_in_zip_read_info->stream.avail_in = 0;
+
+            pfile_in_zip_read_info->zstream = ZSTD_createDStream();
+            if ((pfile_in_zip_read_info->zstream != NULL) &&
+                (!ZSTD_isError(ZSTD_initDStream(pfile_in_zip_read_info->zstream))))
+                pfile_in_zip_read_info->stream_initialised = Z_ZSTD;
+            else
+            {
+                ZSTD_freeDStream(pfile_in_zip_read_info->zstream);
+                TRYFREE(pfile_in_zip_read_info);
+                return UNZ_INTERNALERROR;
+            }
+#else
+            pfile_in_zip_read_info->raw = 1;
 #endif
         }
         else if (compression_method == Z_DEFLATED)
@@ -1494,6 +1545,126 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, unsigned len)
                 return (read == 0) ? UNZ_EOF : read;
             if (err != BZ_OK)
                 break;
+#endif
+        }
+        else if (s->pfile_in_zip_read->compression_method == Z_LZMA)
+        {
+#ifdef HAVE_LZMA
+            uLong out_bytes;
+            lzma_ret ret;
+
+            if (s->pfile_in_zip_read->stream_initialised != Z_LZMA)
+            {
+                /* zip lzma header: version (2 bytes), properties size (2 bytes), properties */
+                lzma_filter filters[2];
+                uInt props_size;
+
+                if (s->pfile_in_zip_read->stream.avail_in < 4)
+                    return UNZ_BADZIPFILE;
+                props_size = s->pfile_in_zip_read->stream.next_in[2] |
+                    (s->pfile_in_zip_read->stream.next_in[3] << 8);
+                if (s->pfile_in_zip_read->stream.avail_in < 4 + props_size)
+                    return UNZ_BADZIPFILE;
+
+                filters[0].id = LZMA_FILTER_LZMA1;
+                filters[0].options = NULL;
+                filters[1].id = LZMA_VLI_UNKNOWN;
+                filters[1].options = NULL;
+                if (lzma_properties_decode(&filters[0], NULL,
+                        s->pfile_in_zip_read->stream.next_in + 4, props_size) != LZMA_OK)
+                    return UNZ_BADZIPFILE;
+
+                ret = lzma_raw_decoder(&s->pfile_in_zip_read->lstream, filters);
+                free(filters[0].options);
+                if (ret != LZMA_OK)
+                    return UNZ_INTERNALERROR;
+
+                s->pfile_in_zip_read->stream_initialised = Z_LZMA;
+                s->pfile_in_zip_read->stream.next_in += 4 + props_size;
+                s->pfile_in_zip_read->stream.avail_in -= 4 + props_size;
+                s->pfile_in_zip_read->stream.total_in += 4 + props_size;
+            }
+
+            s->pfile_in_zip_read->lstream.next_in   = s->pfile_in_zip_read->stream.next_in;
+            s->pfile_in_zip_read->lstream.avail_in  = s->pfile_in_zip_read->stream.avail_in;
+            s->pfile_in_zip_read->lstream.next_out  = s->pfile_in_zip_read->stream.next_out;
+            s->pfile_in_zip_read->lstream.avail_out = s->pfile_in_zip_read->stream.avail_out;
+
+            ret = lzma_code(&s->pfile_in_zip_read->lstream, LZMA_RUN);
+
+            out_bytes = s->pfile_in_zip_read->stream.avail_out - s->pfile_in_zip_read->lstream.avail_out;
+
+            s->pfile_in_zip_read->total_out_64 = s->pfile_in_zip_read->total_out_64 + out_bytes;
+            s->pfile_in_zip_read->rest_read_uncompressed -= out_bytes;
+            s->pfile_in_zip_read->crc32 = crc32(s->pfile_in_zip_read->crc32,
+                                s->pfile_in_zip_read->stream.next_out, (uInt)out_bytes);
+
+            read += (uInt)out_bytes;
+
+            s->pfile_in_zip_read->stream.total_in += s->pfile_in_zip_read->stream.avail_in -
+                s->pfile_in_zip_read->lstream.avail_in;
+            s->pfile_in_zip_read->stream.next_in   = (Bytef*)s->pfile_in_zip_read->lstream.next_in;
+            s->pfile_in_zip_read->stream.avail_in  = (uInt)s->pfile_in_zip_read->lstream.avail_in;
+            s->pfile_in_zip_read->stream.next_out  = s->pfile_in_zip_read->lstream.next_out;
+            s->pfile_in_zip_read->stream.avail_out = (uInt)s->pfile_in_zip_read->lstream.avail_out;
+            s->pfile_in_zip_read->stream.total_out += out_bytes;
+
+            if (ret == LZMA_STREAM_END)
+                return (read == 0) ? UNZ_EOF : read;
+            if (ret != LZMA_OK)
+            {
+                err = Z_DATA_ERROR;
+                break;
+            }
+#endif
+        }
+        else if (s->pfile_in_zip_read->compression_method == Z_ZSTD)
+        {
+#ifdef HAVE_ZSTD
+            ZSTD_inBuffer input;
+            ZSTD_outBuffer output;
+            uLong out_bytes;
+            size_t ret;
+
+            input.src = s->pfile_in_zip_read->stream.next_in;
+            input.size = s->pfile_in_zip_read->stream.avail_in;
+            input.pos = 0;
+            output.dst = s->pfile_in_zip_read->stream.next_out;
+            output.size = s->pfile_in_zip_read->stream.avail_out;
+            output.pos = 0;
+
+            ret = ZSTD_decompressStream(s->pfile_in_zip_read->zstream, &output, &input);
+            if (ZSTD_isError(ret))
+            {
+                err = Z_DATA_ERROR;
+                break;
+            }
+
+            out_bytes = (uLong)output.pos;
+
+            s->pfile_in_zip_read->total_out_64 = s->pfile_in_zip_read->total_out_64 + out_bytes;
+            s->pfile_in_zip_read->rest_read_uncompressed -= out_bytes;
+            s->pfile_in_zip_read->crc32 = crc32(s->pfile_in_zip_read->crc32,
+                                s->pfile_in_zip_read->stream.next_out, (uInt)out_bytes);
+
+            read += (uInt)out_bytes;
+
+            s->pfile_in_zip_read->stream.next_in   += input.pos;
+            s->pfile_in_zip_read->stream.avail_in  -= (uInt)input.pos;
+            s->pfile_in_zip_read->stream.total_in  += input.pos;
+            s->pfile_in_zip_read->stream.next_out  += output.pos;
+            s->pfile_in_zip_read->stream.avail_out -= (uInt)output.pos;
+            s->pfile_in_zip_read->stream.total_out += output.pos;
+
+            if (ret == 0)
+                return (read == 0) ? UNZ_EOF : read;
+            /* truncated frame: no input left and nothing produced */
+            if ((input.pos == 0) && (output.pos == 0) &&
+                (s->pfile_in_zip_read->rest_read_compressed == 0))
+            {
+                err = Z_DATA_ERROR;
+                break;
+            }
 #endif
         }
         else
@@ -1635,6 +1806,14 @@ extern int ZEXPORT unzCloseCurrentFile(unzFile file)
     else if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
         BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
 #endif
+#ifdef HAVE_LZMA
+    else if (pfile_in_zip_read_info->stream_initialised == Z_LZMA)
+        lzma_end(&pfile_in_zip_read_info->lstream);
+#endif
+#ifdef HAVE_ZSTD
+    else if (pfile_in_zip_read_info->stream_initialised == Z_ZSTD)
+        ZSTD_freeDStream(pfile_in_zip_read_info->zstream);
+#endif
 
     pfile_in_zip_read_info->stream_initialised = 0;
     TRYFREE(pfile_in_zip_read_info);
@@ -33,7 +33,17 @@ extern "C" {
 #include "bzlib.h"
 #endif
 
+#ifdef HAVE_LZMA
+#include "lzma.h"
+#endif
+
+#ifdef HAVE_ZSTD
+#include "zstd.h"
+#endif
+
 #define Z_BZIP2ED 12
+#define Z_LZMA 14
+#define Z_ZSTD 93
 
 #if defined(STRICTUNZIP) || defined(STRICTZIPUNZIP)
 /* like the STRICT of WIN32, we define a pointer that cannot be converted
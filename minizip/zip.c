@@ -1001,7 +1001,8 @@ extern int ZEXPORT zipOpenNewFileInZip4_64(zipFile file, const char* filename, c
     if (file == NULL)
         return ZIP_PARAMERROR;
 
-    if ((method != 0) &&
+    /* Raw data is written as is, whatever its method */
+    if ((!raw) && (method != 0) &&
 #ifdef HAVE_BZIP2
         (method != Z_BZIP2ED) &&
 #endif
@@ -1491,7 +1492,9 @@ extern int ZEXPORT zipWriteInFileInZip(zipFile file,const void* buf,unsigned int
     if (zi->in_opened_file_inzip == 0)
         return ZIP_PARAMERROR;
 
-    zi->ci.crc32 = crc32(zi->ci.crc32, buf, (uInt)len);
+    /* raw data is written with the crc given to zipCloseFileInZipRaw */
+    if (!zi->ci.raw)
+        zi->ci.crc32 = crc32(zi->ci.crc32, buf, (uInt)len);
 
 #ifdef HAVE_BZIP2
     if ((zi->ci.compression_method == Z_BZIP2ED) && (!zi->ci.raw))
@@ -1860,6 +1863,179 @@ extern int ZEXPORT zipCloseFileInZip(zipFile file)
     return zipCloseFileInZipRaw(file, 0, 0);
 }
 
+#ifndef NO_ADDFILEINEXISTINGZIP
+/* Copy the central directory into one contiguous buffer */
+local int zip64local_getCentralDir OF((zip64_internal* zi, unsigned char** buf, uLong* size));
+local int zip64local_getCentralDir(zip64_internal* zi, unsigned char** buf, uLong* size)
+{
+    linkedlist_datablock_internal* ldi;
+    uLong pos = 0;
+
+    *size = 0;
+    for (ldi = zi->central_dir.first_block; ldi != NULL; ldi = ldi->next_datablock)
+        *size += ldi->filled_in_this_block;
+
+    *buf = (unsigned char*)ALLOC(*size + 1);
+    if (*buf == NULL)
+        return ZIP_INTERNALERROR;
+
+    for (ldi = zi->central_dir.first_block; ldi != NULL; ldi = ldi->next_datablock)
+    {
+        memcpy(*buf + pos, ldi->data, ldi->filled_in_this_block);
+        pos += ldi->filled_in_this_block;
+    }
+    return ZIP_OK;
+}
+
+/* Replace the central directory with the records in buf */
+local int zip64local_setCentralDir OF((zip64_internal* zi, const unsigned char* buf, uLong size));
+local int zip64local_setCentralDir(zip64_internal* zi, const unsigned char* buf, uLong size)
+{
+    free_linkedlist(&zi->central_dir);
+    if (size == 0)
+        return ZIP_OK;
+    return add_data_in_datablock(&zi->central_dir, buf, size);
+}
+
+local uLong zip64local_centralRecordSize OF((unsigned char* record));
+local uLong zip64local_centralRecordSize(unsigned char* record)
+{
+    return SIZECENTRALHEADER +
+        (uLong)zip64local_getValue_frommemory(record + 28, 2) +
+        (uLong)zip64local_getValue_frommemory(record + 30, 2) +
+        (uLong)zip64local_getValue_frommemory(record + 32, 2);
+}
+
+typedef struct
+{
+    const unsigned char* name;
+    uLong size_name;
+    uLong pos;
+    uLong record_size;
+    int removed;
+} zip64_central_record;
+
+/* Names are compared case insensitive */
+local int zip64local_compareNames OF((const zip64_central_record* ra, const zip64_central_record* rb));
+local int zip64local_compareNames(const zip64_central_record* ra, const zip64_central_record* rb)
+{
+    uLong i;
+
+    for (i = 0; (i < ra->size_name) && (i < rb->size_name); i++)
+    {
+        unsigned char c1 = ra->name[i], c2 = rb->name[i];
+        if ((c1 >= 'A') && (c1 <= 'Z'))
+            c1 += 'a' - 'A';
+        if ((c2 >= 'A') && (c2 <= 'Z'))
+            c2 += 'a' - 'A';
+        if (c1 != c2)
+            return (c1 < c2) ? -1 : 1;
+    }
+
+    if (ra->size_name != rb->size_name)
+        return (ra->size_name < rb->size_name) ? -1 : 1;
+    return 0;
+}
+
+/* Records sorted by name and then by position */
+local int zip64local_compareRecords OF((const void* a, const void* b));
+local int zip64local_compareRecords(const void* a, const void* b)
+{
+    const zip64_central_record* ra = *(const zip64_central_record**)a;
+    const zip64_central_record* rb = *(const zip64_central_record**)b;
+    int cmp = zip64local_compareNames(ra, rb);
+
+    if (cmp != 0)
+        return cmp;
+    return (ra->pos > rb->pos) - (ra->pos < rb->pos);
+}
+
+extern int ZEXPORT zipRemoveReplaced(zipFile file)
+{
+    zip64_internal* zi;
+    zip64_central_record* records = NULL;
+    zip64_central_record** sorted = NULL;
+    unsigned char* buf = NULL;
+    uLong size = 0;
+    uLong pos = 0;
+    uLong kept = 0;
+    uLong n_records = 0;
+    uLong i;
+    int err;
+
+    if (file == NULL)
+        return ZIP_PARAMERROR;
+    zi = (zip64_internal*)file;
+
+    if (zi->in_opened_file_inzip == 1)
+        return ZIP_PARAMERROR;
+
+    err = zip64local_getCentralDir(zi, &buf, &size);
+    if (err != ZIP_OK)
+        return err;
+
+    /* Every record takes at least SIZECENTRALHEADER bytes */
+    records = (zip64_central_record*)ALLOC((size / SIZECENTRALHEADER + 1) * sizeof(zip64_central_record));
+    sorted = (zip64_central_record**)ALLOC((size / SIZECENTRALHEADER + 1) * sizeof(zip64_central_record*));
+    if ((records == NULL) || (sorted == NULL))
+        err = ZIP_INTERNALERROR;
+
+    while ((err == ZIP_OK) && (pos + SIZECENTRALHEADER <= size))
+    {
+        zip64_central_record* record = &records[n_records];
+
+        record->name = buf + pos + SIZECENTRALHEADER;
+        record->size_name = (uLong)zip64local_getValue_frommemory(buf + pos + 28, 2);
+        record->pos = pos;
+        record->record_size = zip64local_centralRecordSize(buf + pos);
+        record->removed = 0;
+
+        if (pos + record->record_size > size)
+        {
+            err = ZIP_BADZIPFILE;
+            break;
+        }
+
+        sorted[n_records++] = record;
+        pos += record->record_size;
+    }
+
+    /* Of the records with the same name only the last one added stays.
+       The local records of the others stay in the file as dead space */
+    if (err == ZIP_OK)
+    {
+        qsort(sorted, n_records, sizeof(zip64_central_record*), zip64local_compareRecords);
+
+        for (i = 0; i + 1 < n_records; i++)
+        {
+            if (zip64local_compareNames(sorted[i], sorted[i + 1]) == 0)
+            {
+                sorted[i]->removed = 1;
+                zi->number_entry--;
+            }
+        }
+
+        for (i = 0; i < n_records; i++)
+        {
+            if (!records[i].removed)
+            {
+                memmove(buf + kept, buf + records[i].pos, records[i].record_size);
+                kept += records[i].record_size;
+            }
+        }
+
+        if (kept != size)
+            err = zip64local_setCentralDir(zi, buf, kept);
+    }
+
+    TRYFREE(sorted);
+    TRYFREE(records);
+    TRYFREE(buf);
+    return err;
+}
+
+#endif
+
 extern int ZEXPORT zipClose(zipFile file, const char* global_comment)
 {
     return zipClose_64(file, global_comment);
@@ -1871,6 +2047,11 @@ extern int ZEXPORT zipClose_64(zipFile file, const char* global_comment)
 }
 
 extern int ZEXPORT zipClose2_64(zipFile file, const char* global_comment, uLong versionMadeBy)
+{
+    return zipClose3_64(file, global_comment, versionMadeBy, NULL);
+}
+
+extern int ZEXPORT zipClose3_64(zipFile file, const char* global_comment, uLong versionMadeBy, ZPOS64_T* end_pos)
 {
     zip64_internal* zi;
     int err = 0;
@@ -2034,6 +2215,9 @@ extern int ZEXPORT zipClose2_64(zipFile file, const char* global_comment, uLong
             err = ZIP_ERRNO;
     }
 
+    if (end_pos != NULL)
+        *end_pos = ZTELL64(zi->z_filefunc, zi->filestream);
+
     if ((ZCLOSE64(zi->z_filefunc, zi->filestream) != 0) && (err == ZIP_OK))
         err = ZIP_ERRNO;
 
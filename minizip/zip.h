@@ -194,6 +194,14 @@ extern int ZEXPORT zipClose_64 OF((zipFile file, const char* global_comment));
 extern int ZEXPORT zipClose2_64 OF((zipFile file, const char* global_comment, uLong versionMadeBy));
 /* Same as zipClose_64 except versionMadeBy field */
 
+extern int ZEXPORT zipClose3_64 OF((zipFile file, const char* global_comment, uLong versionMadeBy, ZPOS64_T* end_pos));
+/* Same as zipClose2_64, end_pos receives the end of the written archive. When entries were
+   removed, the file may be longer and must be truncated there */
+
+extern int ZEXPORT zipRemoveReplaced OF((zipFile file));
+/* Remove the central records of entries that were added again under the same name,
+   keeping the last one. Call it once before closing a zipfile opened with APPEND_STATUS_ADDINZIP */
+
 /***************************************************************************/
 
 #ifdef __cplusplus
@@ -0,0 +1,283 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Piece table: the document is a list of pieces pointing into the unchanged
+// original buffer or into an append-only add buffer. Edits only touch the
+// piece list, the text itself is never moved
+
+#include "main.h"
+#include "piece.h"
+
+int pieceTableInit(PieceTable *table, char *original, int size) {
+	memset(table, 0, sizeof(PieceTable));
+
+	table->pieces = malloc(PIECE_TABLE_PIECES_CHUNK * sizeof(Piece));
+	if (!table->pieces)
+		return PIECE_TABLE_ERROR_MEMORY;
+
+	table->max_pieces = PIECE_TABLE_PIECES_CHUNK;
+	table->original = original;
+	table->size = size;
+
+	if (size > 0) {
+		table->pieces[0].add = 0;
+		table->pieces[0].offset = 0;
+		table->pieces[0].length = size;
+		table->pieces[0].start = 0;
+		table->n_pieces = 1;
+	}
+
+	return 0;
+}
+
+void pieceTableFree(PieceTable *table) {
+	free(table->flat);
+	free(table->add);
+	free(table->pieces);
+	memset(table, 0, sizeof(PieceTable));
+}
+
+// Piece containing offset, n_pieces at the end of the document
+static int pieceTableFind(PieceTable *table, int offset) {
+	if (offset >= table->size)
+		return table->n_pieces;
+
+	int low = 0, high = table->n_pieces - 1;
+	while (low < high) {
+		int mid = (low + high + 1) / 2;
+
+		if (table->pieces[mid].start <= offset)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+
+	return low;
+}
+
+static int pieceTableReserve(PieceTable *table, int n) {
+	if (table->n_pieces + n <= table->max_pieces)
+		return 0;
+
+	int max_pieces = table->max_pieces + MAX(n, PIECE_TABLE_PIECES_CHUNK);
+	Piece *pieces = realloc(table->pieces, max_pieces * sizeof(Piece));
+	if (!pieces)
+		return PIECE_TABLE_ERROR_MEMORY;
+
+	table->pieces = pieces;
+	table->max_pieces = max_pieces;
+
+	return 0;
+}
+
+// Make a piece start at offset and return its index
+static int pieceTableSplit(PieceTable *table, int offset) {
+	int i = pieceTableFind(table, offset);
+	if (i == table->n_pieces)
+		return i;
+
+	Piece *piece = &table->pieces[i];
+	int rel = offset - piece->start;
+	if (rel == 0)
+		return i;
+
+	if (pieceTableReserve(table, 1) < 0)
+		return PIECE_TABLE_ERROR_MEMORY;
+
+	piece = &table->pieces[i];
+	memmove(piece + 2, piece + 1, (table->n_pieces - i - 1) * sizeof(Piece));
+	table->n_pieces++;
+
+	piece[1].add = piece->add;
+	piece[1].offset = piece->offset + rel;
+	piece[1].length = piece->length - rel;
+	piece[1].start = offset;
+	piece->length = rel;
+
+	return i + 1;
+}
+
+static void pieceTableShift(PieceTable *table, int i, int delta) {
+	for (; i < table->n_pieces; i++)
+		table->pieces[i].start += delta;
+}
+
+int pieceTableInsert(PieceTable *table, int offset, const char *data, int length) {
+	if (length <= 0)
+		return 0;
+
+	if (table->add_size + length > table->add_max) {
+		int add_max = table->add_max + MAX(length, PIECE_TABLE_ADD_CHUNK_SIZE);
+		char *add = realloc(table->add, add_max);
+		if (!add)
+			return PIECE_TABLE_ERROR_MEMORY;
+
+		table->add = add;
+		table->add_max = add_max;
+	}
+
+	if (pieceTableReserve(table, 2) < 0)
+		return PIECE_TABLE_ERROR_MEMORY;
+
+	int i = pieceTableSplit(table, offset);
+	if (i < 0)
+		return i;
+
+	memcpy(table->add + table->add_size, data, length);
+
+	// Typing on goes into the piece added last
+	Piece *previous = i > 0 ? &table->pieces[i - 1] : NULL;
+	if (previous && previous->add && previous->offset + previous->length == table->add_size) {
+		previous->length += length;
+	} else {
+		Piece *piece = &table->pieces[i];
+		memmove(piece + 1, piece, (table->n_pieces - i) * sizeof(Piece));
+		table->n_pieces++;
+
+		piece->add = 1;
+		piece->offset = table->add_size;
+		piece->length = length;
+		piece->start = offset;
+		i++;
+	}
+
+	pieceTableShift(table, i, length);
+
+	table->add_size += length;
+	table->size += length;
+
+	return 0;
+}
+
+int pieceTableDelete(PieceTable *table, int offset, int length) {
+	length = MIN(length, table->size - offset);
+	if (length <= 0)
+		return 0;
+
+	if (pieceTableReserve(table, 2) < 0)
+		return PIECE_TABLE_ERROR_MEMORY;
+
+	int first = pieceTableSplit(table, offset);
+	if (first < 0)
+		return first;
+
+	int last = pieceTableSplit(table, offset + length);
+	if (last < 0)
+		return last;
+
+	memmove(&table->pieces[first], &table->pieces[last], (table->n_pieces - last) * sizeof(Piece));
+	table->n_pieces -= last - first;
+
+	pieceTableShift(table, first, -length);
+
+	table->size -= length;
+
+	return 0;
+}
+
+int pieceTableRead(PieceTable *table, int offset, char *data, int length) {
+	int read = 0;
+	int i = pieceTableFind(table, offset);
+
+	while (read < length && i < table->n_pieces) {
+		Piece *piece = &table->pieces[i];
+		int rel = offset + read - piece->start;
+		int size = MIN(piece->length - rel, length - read);
+
+		memcpy(data + read, (piece->add ? table->add : table->original) + piece->offset + rel, size);
+		read += size;
+		i++;
+	}
+
+	return read;
+}
+
+// Data at offset that is contiguous in memory
+char *pieceTableGetPointer(PieceTable *table, int offset, int *length) {
+	int i = pieceTableFind(table, offset);
+	if (i == table->n_pieces) {
+		*length = 0;
+		return NULL;
+	}
+
+	Piece *piece = &table->pieces[i];
+	int rel = offset - piece->start;
+
+	*length = piece->length - rel;
+	return (piece->add ? table->add : table->original) + piece->offset + rel;
+}
+
+// Copy the document into one buffer, which becomes the new original
+char *pieceTableFlatten(PieceTable *table) {
+	if (table->n_pieces == 0 || (table->n_pieces == 1 && !table->pieces[0].add))
+		return table->original + (table->n_pieces ? table->pieces[0].offset : 0);
+
+	char *flat = malloc(table->size);
+	if (!flat)
+		return NULL;
+
+	pieceTableRead(table, 0, flat, table->size);
+
+	free(table->flat);
+	table->flat = flat;
+	table->original = flat;
+	table->add_size = 0;
+
+	table->pieces[0].add = 0;
+	table->pieces[0].offset = 0;
+	table->pieces[0].length = table->size;
+	table->pieces[0].start = 0;
+	table->n_pieces = 1;
+
+	return flat;
+}
+
+// Whether all the original text is still where it was, so only the added
+// pieces differ from it
+int pieceTableIsInPlace(PieceTable *table) {
+	// The original was replaced by a copy with the edits
+	if (table->flat)
+		return 0;
+
+	int i;
+	for (i = 0; i < table->n_pieces; i++) {
+		Piece *piece = &table->pieces[i];
+		if (!piece->add && piece->offset != piece->start)
+			return 0;
+	}
+
+	return 1;
+}
+
+// Stream the document to fd
+int pieceTableWrite(PieceTable *table, SceUID fd) {
+	int written = 0;
+
+	int i;
+	for (i = 0; i < table->n_pieces; i++) {
+		Piece *piece = &table->pieces[i];
+
+		int res = sceIoWrite(fd, (piece->add ? table->add : table->original) + piece->offset, piece->length);
+		if (res < 0)
+			return res;
+
+		written += res;
+	}
+
+	return written;
+}
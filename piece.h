@@ -0,0 +1,58 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PIECE_H__
+#define __PIECE_H__
+
+#define PIECE_TABLE_ADD_CHUNK_SIZE 16 * 1024
+#define PIECE_TABLE_PIECES_CHUNK 64
+
+#define PIECE_TABLE_ERROR_MEMORY -1
+
+typedef struct {
+	int add; // Data is in the add buffer, otherwise in the original
+	int offset;
+	int length;
+	int start; // Offset in the document
+} Piece;
+
+typedef struct {
+	char *original;
+	char *flat; // Original allocated by pieceTableFlatten
+	char *add;
+	int add_size;
+	int add_max;
+	Piece *pieces;
+	int n_pieces;
+	int max_pieces;
+	int size;
+} PieceTable;
+
+int pieceTableInit(PieceTable *table, char *original, int size);
+void pieceTableFree(PieceTable *table);
+
+int pieceTableInsert(PieceTable *table, int offset, const char *data, int length);
+int pieceTableDelete(PieceTable *table, int offset, int length);
+
+int pieceTableRead(PieceTable *table, int offset, char *data, int length);
+char *pieceTableGetPointer(PieceTable *table, int offset, int *length);
+char *pieceTableFlatten(PieceTable *table);
+int pieceTableIsInPlace(PieceTable *table);
+int pieceTableWrite(PieceTable *table, SceUID fd);
+
+#endif
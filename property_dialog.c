@@ -241,6 +241,10 @@ int initPropertyDialog(char *path, FileListEntry *entry) {
 			type = PROPERTY_TYPE_SFO;
 			break;
 			
+		case FILE_TYPE_TAR:
+			type = PROPERTY_TYPE_TAR;
+			break;
+			
 		case FILE_TYPE_TXT:
 			type = PROPERTY_TYPE_TXT;
 			break;
@@ -0,0 +1,915 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Regular expressions compiled to a Thompson NFA and run as a Pike VM. All
+// threads advance in lockstep, so matching is linear in the text length for
+// any pattern.
+//
+// Supported: literals, ., [...], [^...], \d \w \s \D \W \S, \t \n, \ escapes,
+// ^ $ (at line boundaries), ( ), |, *, +, ? and {m}, {m,}, {,n}, {m,n}.
+// Intervals are expanded into copies of their atom when compiling. A { that
+// doesn't start an interval is a literal
+
+#include "main.h"
+#include "regexp.h"
+#include "utils.h"
+
+#include <ctype.h>
+
+enum RegexOpcodes {
+	OP_CHAR,
+	OP_ANY,
+	OP_CLASS,
+	OP_BOL,
+	OP_EOL,
+	OP_SPLIT,
+	OP_JMP,
+	OP_MATCH,
+};
+
+enum RegexNodeTypes {
+	NODE_EMPTY,
+	NODE_CHAR,
+	NODE_ANY,
+	NODE_CLASS,
+	NODE_BOL,
+	NODE_EOL,
+	NODE_CAT,
+	NODE_ALT,
+	NODE_STAR,
+	NODE_PLUS,
+	NODE_QUEST,
+	NODE_REPEAT,
+};
+
+typedef struct {
+	int type;
+	int arg;
+	int left;
+	int right;
+} RegexNode;
+
+typedef struct {
+	Regex *re;
+	const char *p;
+	RegexNode *nodes;
+	int n_nodes;
+	int depth;
+} RegexParser;
+
+#define REGEX_MAX_DEPTH 64
+#define REGEX_MAX_REPEAT 255
+#define REGEX_MAX_PROGRAM_LENGTH 65536
+
+static int parseAlternation(RegexParser *parser);
+
+static int newNode(RegexParser *parser, int type, int arg, int left, int right) {
+	RegexNode *node = &parser->nodes[parser->n_nodes];
+	node->type = type;
+	node->arg = arg;
+	node->left = left;
+	node->right = right;
+	return parser->n_nodes++;
+}
+
+static void classSet(unsigned char *class, int ch) {
+	class[ch >> 3] |= 1 << (ch & 7);
+}
+
+static int classTest(unsigned char *class, int ch) {
+	return class[ch >> 3] & (1 << (ch & 7));
+}
+
+// Add \d, \w or \s and their negations. Returns 0 if ch isn't one of them
+static int classAddShorthand(unsigned char *class, int ch) {
+	int lower = tolower(ch);
+	if (lower != 'd' && lower != 'w' && lower != 's')
+		return 0;
+
+	int i;
+	for (i = 0; i < 256; i++) {
+		int in;
+		if (lower == 'd')
+			in = (i >= '0' && i <= '9');
+		else if (lower == 'w')
+			in = (i < 0x80 && (isalnum(i) || i == '_'));
+		else
+			in = (i == ' ' || (i >= '\t' && i <= '\r'));
+
+		if (in != (ch != lower))
+			classSet(class, i);
+	}
+
+	return 1;
+}
+
+static int escapeChar(int ch) {
+	if (ch == 't')
+		return '\t';
+	if (ch == 'n')
+		return '\n';
+	if (ch == 'r')
+		return '\r';
+	return ch;
+}
+
+static int newClass(RegexParser *parser) {
+	Regex *re = parser->re;
+	memset(re->classes[re->n_classes], 0, 32);
+	return re->n_classes++;
+}
+
+static int parseClass(RegexParser *parser) {
+	int index = newClass(parser);
+	unsigned char *class = parser->re->classes[index];
+
+	int negate = 0;
+	if (*parser->p == '^') {
+		negate = 1;
+		parser->p++;
+	}
+
+	// A ] right at the start is a literal
+	int first = 1;
+	while (*parser->p && (*parser->p != ']' || first)) {
+		int ch = (unsigned char)*parser->p++;
+		first = 0;
+
+		if (ch == '\\') {
+			if (!*parser->p)
+				return REGEX_ERROR_SYNTAX;
+
+			ch = (unsigned char)*parser->p++;
+			if (classAddShorthand(class, ch))
+				continue;
+
+			ch = escapeChar(ch);
+		}
+
+		int last = ch;
+		if (parser->p[0] == '-' && parser->p[1] && parser->p[1] != ']') {
+			parser->p++;
+			last = (unsigned char)*parser->p++;
+			if (last == '\\') {
+				if (!*parser->p)
+					return REGEX_ERROR_SYNTAX;
+				last = escapeChar((unsigned char)*parser->p++);
+			}
+
+			if (last < ch)
+				return REGEX_ERROR_SYNTAX;
+		}
+
+		int i;
+		for (i = ch; i <= last; i++) {
+			classSet(class, i);
+
+			if (parser->re->flags & REGEX_IGNORE_CASE) {
+				classSet(class, tolower(i));
+				classSet(class, toupper(i));
+			}
+		}
+	}
+
+	if (*parser->p != ']')
+		return REGEX_ERROR_SYNTAX;
+
+	parser->p++;
+
+	if (negate) {
+		int i;
+		for (i = 0; i < 32; i++)
+			class[i] = ~class[i];
+	}
+
+	return newNode(parser, NODE_CLASS, index, -1, -1);
+}
+
+static int parseNumber(const char **p) {
+	int number = 0;
+
+	while (isdigit((unsigned char)**p)) {
+		number = number * 10 + (*(*p)++ - '0');
+		if (number > REGEX_MAX_REPEAT)
+			number = REGEX_MAX_REPEAT + 1;
+	}
+
+	return number;
+}
+
+// Parse {m}, {m,}, {,n} or {m,n} at p. Returns 0 if there is no interval
+static int parseInterval(RegexParser *parser, int *min, int *max) {
+	const char *p = parser->p;
+	if (*p++ != '{')
+		return 0;
+
+	const char *digits = p;
+	*min = parseNumber(&p);
+	int has_min = p > digits;
+
+	if (*p == ',') {
+		p++;
+		digits = p;
+		*max = parseNumber(&p);
+		if (p == digits)
+			*max = -1;
+	} else {
+		if (!has_min)
+			return 0;
+
+		*max = *min;
+	}
+
+	if (*p++ != '}')
+		return 0;
+
+	if (*min > REGEX_MAX_REPEAT || *max > REGEX_MAX_REPEAT || (*max >= 0 && *min > *max))
+		return REGEX_ERROR_SYNTAX;
+
+	parser->p = p;
+	return 1;
+}
+
+static int parseAtom(RegexParser *parser) {
+	int min, max;
+
+	// Nothing to repeat
+	if (*parser->p == '{' && parseInterval(parser, &min, &max) != 0)
+		return REGEX_ERROR_SYNTAX;
+
+	int ch = (unsigned char)*parser->p++;
+
+	switch (ch) {
+		case '(':
+		{
+			if (++parser->depth > REGEX_MAX_DEPTH)
+				return REGEX_ERROR_SYNTAX;
+
+			int node = parseAlternation(parser);
+			if (node < 0)
+				return node;
+
+			if (*parser->p != ')')
+				return REGEX_ERROR_SYNTAX;
+
+			parser->p++;
+			parser->depth--;
+			return node;
+		}
+
+		case '[':
+			return parseClass(parser);
+
+		case '.':
+			return newNode(parser, NODE_ANY, 0, -1, -1);
+
+		case '^':
+			return newNode(parser, NODE_BOL, 0, -1, -1);
+
+		case '$':
+			return newNode(parser, NODE_EOL, 0, -1, -1);
+
+		case '\\':
+		{
+			if (!*parser->p)
+				return REGEX_ERROR_SYNTAX;
+
+			ch = (unsigned char)*parser->p++;
+
+			int index = newClass(parser);
+			if (classAddShorthand(parser->re->classes[index], ch))
+				return newNode(parser, NODE_CLASS, index, -1, -1);
+
+			parser->re->n_classes--;
+			ch = escapeChar(ch);
+			break;
+		}
+
+		case '*':
+		case '+':
+		case '?':
+		case ')':
+		case '|':
+			return REGEX_ERROR_SYNTAX;
+	}
+
+	if (parser->re->flags & REGEX_IGNORE_CASE)
+		ch = tolower(ch);
+
+	return newNode(parser, NODE_CHAR, ch, -1, -1);
+}
+
+static int parseRepetition(RegexParser *parser) {
+	int node = parseAtom(parser);
+	if (node < 0)
+		return node;
+
+	while (1) {
+		int ch = *parser->p;
+
+		if (ch == '*' || ch == '+' || ch == '?') {
+			parser->p++;
+			int type = (ch == '*') ? NODE_STAR : ((ch == '+') ? NODE_PLUS : NODE_QUEST);
+			node = newNode(parser, type, 0, node, -1);
+		} else if (ch == '{') {
+			int min, max;
+			int res = parseInterval(parser, &min, &max);
+			if (res < 0)
+				return res;
+			if (res == 0)
+				break;
+
+			node = newNode(parser, NODE_REPEAT, min, node, max);
+		} else {
+			break;
+		}
+	}
+
+	return node;
+}
+
+static int parseConcatenation(RegexParser *parser) {
+	int node = -1;
+
+	while (*parser->p && *parser->p != '|' && *parser->p != ')') {
+		int next = parseRepetition(parser);
+		if (next < 0)
+			return next;
+
+		node = (node < 0) ? next : newNode(parser, NODE_CAT, 0, node, next);
+	}
+
+	if (node < 0)
+		node = newNode(parser, NODE_EMPTY, 0, -1, -1);
+
+	return node;
+}
+
+static int parseAlternation(RegexParser *parser) {
+	int node = parseConcatenation(parser);
+	if (node < 0)
+		return node;
+
+	while (*parser->p == '|') {
+		parser->p++;
+
+		int right = parseConcatenation(parser);
+		if (right < 0)
+			return right;
+
+		node = newNode(parser, NODE_ALT, 0, node, right);
+	}
+
+	return node;
+}
+
+// Instructions compileNode emits for a node, stops counting at REGEX_MAX_PROGRAM_LENGTH
+static int programLength(RegexNode *nodes, int index) {
+	RegexNode *node = &nodes[index];
+	int64_t length = 0;
+
+	switch (node->type) {
+		case NODE_EMPTY:
+			break;
+
+		case NODE_CAT:
+			length = programLength(nodes, node->left) + programLength(nodes, node->right);
+			break;
+
+		case NODE_ALT:
+			length = programLength(nodes, node->left) + programLength(nodes, node->right) + 2;
+			break;
+
+		case NODE_QUEST:
+		case NODE_PLUS:
+			length = programLength(nodes, node->left) + 1;
+			break;
+
+		case NODE_STAR:
+			length = programLength(nodes, node->left) + 2;
+			break;
+
+		case NODE_REPEAT:
+		{
+			int64_t left = programLength(nodes, node->left);
+			length = node->arg * left + ((node->right < 0) ? left + 2 : (node->right - node->arg) * (left + 1));
+			break;
+		}
+
+		default:
+			length = 1;
+			break;
+	}
+
+	return (int)MIN(length, REGEX_MAX_PROGRAM_LENGTH);
+}
+
+static void emit(Regex *re, int opcode, int arg, int x, int y) {
+	RegexInstruction *instruction = &re->program[re->length++];
+	instruction->opcode = opcode;
+	instruction->arg = arg;
+	instruction->x = x;
+	instruction->y = y;
+}
+
+static void compileNode(Regex *re, RegexNode *nodes, int index) {
+	RegexNode *node = &nodes[index];
+
+	switch (node->type) {
+		case NODE_EMPTY:
+			break;
+
+		case NODE_CHAR:
+			emit(re, OP_CHAR, node->arg, 0, 0);
+			break;
+
+		case NODE_ANY:
+			emit(re, OP_ANY, 0, 0, 0);
+			break;
+
+		case NODE_CLASS:
+			emit(re, OP_CLASS, node->arg, 0, 0);
+			break;
+
+		case NODE_BOL:
+			emit(re, OP_BOL, 0, 0, 0);
+			break;
+
+		case NODE_EOL:
+			emit(re, OP_EOL, 0, 0, 0);
+			break;
+
+		case NODE_CAT:
+			compileNode(re, nodes, node->left);
+			compileNode(re, nodes, node->right);
+			break;
+
+		case NODE_ALT:
+		{
+			int split = re->length;
+			emit(re, OP_SPLIT, 0, split + 1, 0);
+			compileNode(re, nodes, node->left);
+
+			int jmp = re->length;
+			emit(re, OP_JMP, 0, 0, 0);
+
+			re->program[split].y = re->length;
+			compileNode(re, nodes, node->right);
+			re->program[jmp].x = re->length;
+			break;
+		}
+
+		case NODE_QUEST:
+		{
+			int split = re->length;
+			emit(re, OP_SPLIT, 0, split + 1, 0);
+			compileNode(re, nodes, node->left);
+			re->program[split].y = re->length;
+			break;
+		}
+
+		case NODE_STAR:
+		{
+			int split = re->length;
+			emit(re, OP_SPLIT, 0, split + 1, 0);
+			compileNode(re, nodes, node->left);
+			emit(re, OP_JMP, 0, split, 0);
+			re->program[split].y = re->length;
+			break;
+		}
+
+		case NODE_PLUS:
+		{
+			int start = re->length;
+			compileNode(re, nodes, node->left);
+			emit(re, OP_SPLIT, 0, start, re->length + 1);
+			break;
+		}
+
+		case NODE_REPEAT:
+		{
+			int i;
+			for (i = 0; i < node->arg; i++)
+				compileNode(re, nodes, node->left);
+
+			if (node->right < 0) {
+				int split = re->length;
+				emit(re, OP_SPLIT, 0, split + 1, 0);
+				compileNode(re, nodes, node->left);
+				emit(re, OP_JMP, 0, split, 0);
+				re->program[split].y = re->length;
+				break;
+			}
+
+			// Every optional copy may skip to the end
+			int splits[REGEX_MAX_REPEAT];
+			int n_splits = node->right - node->arg;
+
+			for (i = 0; i < n_splits; i++) {
+				splits[i] = re->length;
+				emit(re, OP_SPLIT, 0, re->length + 1, 0);
+				compileNode(re, nodes, node->left);
+			}
+
+			for (i = 0; i < n_splits; i++)
+				re->program[splits[i]].y = re->length;
+
+			break;
+		}
+	}
+}
+
+// Bytes a match can start with. Not used if a match can start without consuming one
+static void computeFirst(Regex *re) {
+	memset(re->first, 0, sizeof(re->first));
+	re->use_first = 1;
+
+	int *stack = malloc(re->length * sizeof(int));
+	unsigned char *seen = malloc(re->length);
+	if (!stack || !seen) {
+		re->use_first = 0;
+		free(stack);
+		free(seen);
+		return;
+	}
+
+	memset(seen, 0, re->length);
+
+	int n = 0;
+	stack[n++] = 0;
+	seen[0] = 1;
+
+	while (n > 0 && re->use_first) {
+		RegexInstruction *instruction = &re->program[stack[--n]];
+
+		switch (instruction->opcode) {
+			case OP_CHAR:
+				re->first[instruction->arg] = 1;
+				if (re->flags & REGEX_IGNORE_CASE)
+					re->first[toupper(instruction->arg)] = 1;
+				break;
+
+			case OP_CLASS:
+			{
+				int i;
+				for (i = 0; i < 256; i++) {
+					if (classTest(re->classes[instruction->arg], i))
+						re->first[i] = 1;
+				}
+
+				break;
+			}
+
+			case OP_SPLIT:
+				if (!seen[instruction->y]) {
+					seen[instruction->y] = 1;
+					stack[n++] = instruction->y;
+				}
+				// Fall through
+
+			case OP_JMP:
+				if (!seen[instruction->x]) {
+					seen[instruction->x] = 1;
+					stack[n++] = instruction->x;
+				}
+				break;
+
+			default:
+				re->use_first = 0;
+				break;
+		}
+	}
+
+	free(stack);
+	free(seen);
+}
+
+int regexCompile(Regex *re, const char *pattern, int flags) {
+	memset(re, 0, sizeof(Regex));
+
+	int length = strlen(pattern);
+	if (length >= REGEX_MAX_PATTERN_LENGTH)
+		return REGEX_ERROR_SYNTAX;
+
+	strcpy(re->pattern, pattern);
+	re->flags = flags;
+
+	// Every pattern character makes at most an atom, an operator and a concatenation
+	int max_nodes = 3 * length + 1;
+
+	RegexParser parser;
+	parser.re = re;
+	parser.p = pattern;
+	parser.n_nodes = 0;
+	parser.depth = 0;
+	parser.nodes = malloc(max_nodes * sizeof(RegexNode));
+	re->classes = malloc((length + 1) * 32);
+
+	if (!parser.nodes || !re->classes) {
+		free(parser.nodes);
+		regexFree(re);
+		return REGEX_ERROR_MEMORY;
+	}
+
+	int root = parseAlternation(&parser);
+
+	// Unbalanced )
+	if (root >= 0 && *parser.p)
+		root = REGEX_ERROR_SYNTAX;
+
+	if (root < 0) {
+		free(parser.nodes);
+		regexFree(re);
+		return root;
+	}
+
+	// Intervals can make the program much longer than the pattern
+	int program_length = programLength(parser.nodes, root) + 1;
+	if (program_length > REGEX_MAX_PROGRAM_LENGTH) {
+		free(parser.nodes);
+		regexFree(re);
+		return REGEX_ERROR_SYNTAX;
+	}
+
+	re->program = malloc(program_length * sizeof(RegexInstruction));
+	if (!re->program) {
+		free(parser.nodes);
+		regexFree(re);
+		return REGEX_ERROR_MEMORY;
+	}
+
+	compileNode(re, parser.nodes, root);
+	emit(re, OP_MATCH, 0, 0, 0);
+
+	free(parser.nodes);
+
+	computeFirst(re);
+
+	return 0;
+}
+
+void regexFree(Regex *re) {
+	free(re->program);
+	free(re->classes);
+	re->program = NULL;
+	re->classes = NULL;
+	re->length = 0;
+}
+
+typedef struct {
+	int pc;
+	int start;
+} RegexThread;
+
+typedef struct {
+	RegexThread *threads;
+	int n;
+} RegexThreadList;
+
+typedef struct {
+	Regex *re;
+	const char *text;
+	int size;
+	int *marks;
+	int *stack;
+	int generation;
+} RegexVM;
+
+// Add the thread and everything reachable from it without consuming input
+static void addThread(RegexVM *vm, RegexThreadList *list, int pc, int start, int pos) {
+	Regex *re = vm->re;
+	int n = 0;
+
+	vm->stack[n++] = pc;
+
+	while (n > 0) {
+		pc = vm->stack[--n];
+
+		if (vm->marks[pc] == vm->generation)
+			continue;
+
+		vm->marks[pc] = vm->generation;
+
+		RegexInstruction *instruction = &re->program[pc];
+
+		switch (instruction->opcode) {
+			case OP_JMP:
+				vm->stack[n++] = instruction->x;
+				break;
+
+			case OP_SPLIT:
+				// x has priority so it is processed first
+				vm->stack[n++] = instruction->y;
+				vm->stack[n++] = instruction->x;
+				break;
+
+			case OP_BOL:
+				if (pos == 0 || vm->text[pos - 1] == '\n')
+					vm->stack[n++] = pc + 1;
+				break;
+
+			case OP_EOL:
+				if (pos == vm->size || vm->text[pos] == '\n')
+					vm->stack[n++] = pc + 1;
+				break;
+
+			default:
+				list->threads[list->n].pc = pc;
+				list->threads[list->n].start = start;
+				list->n++;
+				break;
+		}
+	}
+}
+
+// Leftmost match starting in [from, to). Matches may extend up to size.
+// Returns 1 and the match in [start, end) if one was found. With running,
+// the search gives the CPU away now and then and stops once *running is 0
+int regexFindStoppable(Regex *re, const char *text, int size, int from, int to, int *start, int *end, int *running) {
+	if (!re->program)
+		return 0;
+
+	// Small programs run on the stack
+	RegexThread local_threads[2 * REGEX_STACK_PROGRAM_LENGTH];
+	int local_marks[REGEX_STACK_PROGRAM_LENGTH];
+	int local_stack[2 * REGEX_STACK_PROGRAM_LENGTH + 1];
+
+	RegexThread *threads = local_threads;
+	int *marks = local_marks;
+	int *stack = local_stack;
+	void *memory = NULL;
+
+	if (re->length > REGEX_STACK_PROGRAM_LENGTH) {
+		memory = malloc(2 * re->length * sizeof(RegexThread) + (3 * re->length + 1) * sizeof(int));
+		if (!memory)
+			return 0;
+
+		threads = (RegexThread *)memory;
+		marks = (int *)(threads + 2 * re->length);
+		stack = marks + re->length;
+	}
+
+	memset(marks, 0, re->length * sizeof(int));
+
+	YieldState yield;
+	initYield(&yield, 1);
+
+	RegexVM vm;
+	vm.re = re;
+	vm.text = text;
+	vm.size = size;
+	vm.marks = marks;
+	vm.stack = stack;
+	vm.generation = 1;
+
+	RegexThreadList current, next;
+	current.threads = threads;
+	current.n = 0;
+	next.threads = threads + re->length;
+	next.n = 0;
+
+	int ignore_case = re->flags & REGEX_IGNORE_CASE;
+	int matched = 0;
+	int pos = from;
+
+	while (1) {
+		if (running && (pos & (REGEX_CHECK_INTERVAL - 1)) == 0) {
+			if (!*running) {
+				matched = 0;
+				break;
+			}
+
+			yieldIfNeeded(&yield);
+		}
+
+		if (!matched && pos < to) {
+			// Nothing running, skip to a byte a match can start with
+			if (current.n == 0 && re->use_first) {
+				while (pos < to && !re->first[(unsigned char)text[pos]])
+					pos++;
+
+				if (pos >= to)
+					break;
+			}
+
+			addThread(&vm, &current, 0, pos, pos);
+		}
+
+		if (current.n == 0) {
+			if (matched || pos >= to || pos >= size)
+				break;
+
+			// Anchors can reject every start, try the next position
+			vm.generation++;
+			pos++;
+			continue;
+		}
+
+		int ch = pos < size ? (unsigned char)text[pos] : -1;
+		if (ignore_case && ch >= 0)
+			ch = tolower(ch);
+
+		vm.generation++;
+		next.n = 0;
+
+		int i;
+		for (i = 0; i < current.n; i++) {
+			RegexThread *thread = &current.threads[i];
+			RegexInstruction *instruction = &re->program[thread->pc];
+			int step = 0;
+
+			switch (instruction->opcode) {
+				case OP_CHAR:
+					step = (ch == instruction->arg);
+					break;
+
+				case OP_ANY:
+					step = (ch >= 0 && ch != '\n');
+					break;
+
+				case OP_CLASS:
+					step = (ch >= 0 && classTest(re->classes[instruction->arg], (unsigned char)text[pos]));
+					break;
+
+				case OP_MATCH:
+					*start = thread->start;
+					*end = pos;
+					matched = 1;
+
+					// Threads behind this one have lower priority
+					i = current.n;
+					break;
+			}
+
+			if (step)
+				addThread(&vm, &next, thread->pc + 1, thread->start, pos + 1);
+		}
+
+		RegexThreadList tmp = current;
+		current = next;
+		next = tmp;
+
+		if (pos >= size)
+			break;
+
+		pos++;
+	}
+
+	free(memory);
+
+	return matched;
+}
+
+int regexFind(Regex *re, const char *text, int size, int from, int to, int *start, int *end) {
+	return regexFindStoppable(re, text, size, from, to, start, end, NULL);
+}
+
+int regexMatch(Regex *re, const char *string) {
+	int start, end;
+	int length = strlen(string);
+	return regexFind(re, string, length, 0, length + 1, &start, &end);
+}
+
+static Regex regex_cache[REGEX_CACHE_SIZE];
+static int regex_cache_used[REGEX_CACHE_SIZE];
+static int regex_cache_counter = 0;
+
+// Compiled pattern from the cache, compiled on the first use. Returns NULL
+// if the pattern is invalid. The least recently used entry is replaced
+Regex *regexGetCached(const char *pattern, int flags) {
+	int i, oldest = 0;
+	for (i = 0; i < REGEX_CACHE_SIZE; i++) {
+		if (regex_cache[i].program && regex_cache[i].flags == flags && strcmp(regex_cache[i].pattern, pattern) == 0) {
+			regex_cache_used[i] = ++regex_cache_counter;
+			return &regex_cache[i];
+		}
+
+		if (regex_cache_used[i] < regex_cache_used[oldest])
+			oldest = i;
+	}
+
+	Regex re;
+	if (regexCompile(&re, pattern, flags) < 0)
+		return NULL;
+
+	regexFree(&regex_cache[oldest]);
+	memcpy(&regex_cache[oldest], &re, sizeof(Regex));
+	regex_cache_used[oldest] = ++regex_cache_counter;
+
+	return &regex_cache[oldest];
+}
@@ -0,0 +1,64 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __REGEXP_H__
+#define __REGEXP_H__
+
+#define REGEX_MAX_PATTERN_LENGTH 256
+#define REGEX_CACHE_SIZE 4
+
+// Longest program matched without allocating
+#define REGEX_STACK_PROGRAM_LENGTH 128
+// Positions between checks whether a search was stopped
+#define REGEX_CHECK_INTERVAL 4096
+
+#define REGEX_ERROR_SYNTAX -1
+#define REGEX_ERROR_MEMORY -2
+
+enum RegexFlags {
+	REGEX_IGNORE_CASE = 0x1,
+};
+
+typedef struct {
+	int opcode;
+	int arg;
+	int x;
+	int y;
+} RegexInstruction;
+
+typedef struct {
+	char pattern[REGEX_MAX_PATTERN_LENGTH];
+	int flags;
+	RegexInstruction *program;
+	int length;
+	unsigned char (*classes)[32];
+	int n_classes;
+	unsigned char first[256];
+	int use_first;
+} Regex;
+
+int regexCompile(Regex *re, const char *pattern, int flags);
+void regexFree(Regex *re);
+
+Regex *regexGetCached(const char *pattern, int flags);
+
+int regexFind(Regex *re, const char *text, int size, int from, int to, int *start, int *end);
+int regexFindStoppable(Regex *re, const char *text, int size, int from, int to, int *start, int *end, int *running);
+int regexMatch(Regex *re, const char *string);
+
+#endif
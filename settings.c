@@ -67,7 +67,13 @@ static SettingsMenuEntry *settings_menu_entries = NULL;
 static int n_settings_entries = 0;
 
 static ConfigEntry settings_entries[] = {
-	{ "DISABLE_AUTOUPDATE", CONFIG_TYPE_BOOLEAN, (int *)&vitashell_config.disable_autoupdate }
+	{ "DISABLE_AUTOUPDATE", CONFIG_TYPE_BOOLEAN, (int *)&vitashell_config.disable_autoupdate },
+	{ "COMPRESS_TIME_BUDGET", CONFIG_TYPE_DECIMAL, (int *)&vitashell_config.compress_time_budget },
+	{ "HASH_CRC32", CONFIG_TYPE_BOOLEAN, (int *)&vitashell_config.hash_crc32 },
+	{ "HASH_MD5", CONFIG_TYPE_BOOLEAN, (int *)&vitashell_config.hash_md5 },
+	{ "HASH_SHA256", CONFIG_TYPE_BOOLEAN, (int *)&vitashell_config.hash_sha256 },
+	{ "HASH_EXPORT", CONFIG_TYPE_BOOLEAN, (int *)&vitashell_config.hash_export },
+	{ "EDITOR_BACKUP", CONFIG_TYPE_BOOLEAN, (int *)&vitashell_config.editor_backup },
 };
 
 SettingsMenuOption henkaku_settings[] = {
@@ -83,6 +89,11 @@ SettingsMenuOption main_settings[] = {
 	// { VITASHELL_SETTINGS_LANGUAGE,		SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, &language },
 	// { VITASHELL_SETTINGS_THEME,			SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, &theme },
 	{ VITASHELL_SETTINGS_NO_AUTO_UPDATE,	SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, &vitashell_config.disable_autoupdate },
+	{ VITASHELL_SETTINGS_HASH_CRC32,		SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, &vitashell_config.hash_crc32 },
+	{ VITASHELL_SETTINGS_HASH_MD5,			SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, &vitashell_config.hash_md5 },
+	{ VITASHELL_SETTINGS_HASH_SHA256,		SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, &vitashell_config.hash_sha256 },
+	{ VITASHELL_SETTINGS_HASH_EXPORT,		SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, &vitashell_config.hash_export },
+	{ VITASHELL_SETTINGS_EDITOR_BACKUP,		SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, &vitashell_config.editor_backup },
 };
 
 SettingsMenuOption power_settings[] = {
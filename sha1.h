@@ -25,7 +25,6 @@ typedef struct {
 	WORD datalen;
 	unsigned long long bitlen;
 	WORD state[5];
-	WORD k[4];
 } SHA1_CTX;
 
 /*********************** FUNCTION DECLARATIONS **********************/
@@ -0,0 +1,653 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "tar.h"
+#include "file.h"
+#include "utils.h"
+
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_BUFFER_SIZE (128 * 1024)
+
+enum TarCompression {
+	TAR_COMPRESSION_NONE,
+	TAR_COMPRESSION_GZIP,
+	TAR_COMPRESSION_ZSTD,
+};
+
+typedef struct {
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char pad[12];
+} TarHeader;
+
+typedef struct {
+	char name[MAX_PATH_LENGTH];
+	int is_folder;
+	SceOff offset;
+	SceOff size;
+	SceOff mtime;
+} TarEntry;
+
+struct TarArchive {
+	TarInput input;
+	int compression;
+
+	uint8_t *in_buf;
+	uint8_t *in_ptr;
+	SceSize in_size;
+	int in_eof;
+
+	z_stream stream;
+	int stream_initialised;
+
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *zstd;
+#endif
+
+	// Position in the uncompressed tar stream
+	SceOff pos;
+	SceOff next_header;
+	int stream_end;
+
+	uint8_t *buffer;
+};
+
+static int tarFillInput(TarArchive *tar) {
+	if (tar->in_size > 0 || tar->in_eof)
+		return 0;
+
+	int read = tar->input.read(tar->input.opaque, tar->in_buf, TAR_BUFFER_SIZE);
+	if (read < 0)
+		return read;
+
+	if (read == 0)
+		tar->in_eof = 1;
+
+	tar->in_ptr = tar->in_buf;
+	tar->in_size = read;
+
+	return 0;
+}
+
+static int tarReadStream(TarArchive *tar, uint8_t *buf, SceSize size) {
+	int res;
+	SceSize done = 0;
+
+	while (done < size && !tar->stream_end) {
+		res = tarFillInput(tar);
+		if (res < 0)
+			return res;
+
+		if (tar->in_size == 0 && tar->in_eof)
+			break;
+
+		if (tar->compression == TAR_COMPRESSION_NONE) {
+			SceSize n = MIN(tar->in_size, size - done);
+			memcpy(buf + done, tar->in_ptr, n);
+
+			tar->in_ptr += n;
+			tar->in_size -= n;
+			done += n;
+		} else if (tar->compression == TAR_COMPRESSION_GZIP) {
+			tar->stream.next_in = tar->in_ptr;
+			tar->stream.avail_in = tar->in_size;
+			tar->stream.next_out = buf + done;
+			tar->stream.avail_out = size - done;
+
+			res = inflate(&tar->stream, Z_NO_FLUSH);
+
+			done = size - tar->stream.avail_out;
+			tar->in_ptr = tar->stream.next_in;
+			tar->in_size = tar->stream.avail_in;
+
+			if (res == Z_STREAM_END) {
+				// Concatenated gzip members
+				res = tarFillInput(tar);
+				if (res < 0)
+					return res;
+
+				if (tar->in_size == 0)
+					tar->stream_end = 1;
+				else
+					inflateReset(&tar->stream);
+			} else if (res == Z_NEED_DICT) {
+				return Z_DATA_ERROR;
+			} else if (res < 0 && res != Z_BUF_ERROR) {
+				return res;
+			}
+		} else {
+#ifdef HAVE_ZSTD
+			ZSTD_inBuffer in = { tar->in_ptr, tar->in_size, 0 };
+			ZSTD_outBuffer out = { buf, size, done };
+
+			size_t ret = ZSTD_decompressStream(tar->zstd, &out, &in);
+			if (ZSTD_isError(ret))
+				return -1;
+
+			done = out.pos;
+			tar->in_ptr += in.pos;
+			tar->in_size -= in.pos;
+#else
+			return -1;
+#endif
+		}
+	}
+
+	tar->pos += done;
+
+	return done;
+}
+
+static int tarReadFull(TarArchive *tar, void *buf, SceSize size) {
+	SceSize done = 0;
+
+	while (done < size) {
+		int read = tarReadStream(tar, (uint8_t *)buf + done, size - done);
+		if (read < 0)
+			return read;
+
+		if (read == 0)
+			break;
+
+		done += read;
+	}
+
+	return done;
+}
+
+static int tarSkip(TarArchive *tar, SceOff size) {
+	while (size > 0) {
+		int read = tarReadStream(tar, tar->buffer, MIN(size, TAR_BUFFER_SIZE));
+		if (read < 0)
+			return read;
+
+		if (read == 0)
+			return -1;
+
+		size -= read;
+	}
+
+	return 0;
+}
+
+static int tarRewind(TarArchive *tar) {
+	int res = tar->input.rewind(tar->input.opaque);
+	if (res < 0)
+		return res;
+
+	tar->in_ptr = tar->in_buf;
+	tar->in_size = 0;
+	tar->in_eof = 0;
+
+	if (tar->compression == TAR_COMPRESSION_GZIP)
+		inflateReset(&tar->stream);
+
+#ifdef HAVE_ZSTD
+	if (tar->compression == TAR_COMPRESSION_ZSTD)
+		ZSTD_initDStream(tar->zstd);
+#endif
+
+	tar->pos = 0;
+	tar->next_header = 0;
+	tar->stream_end = 0;
+
+	return 0;
+}
+
+static SceOff tarParseNumber(const char *p, int size) {
+	SceOff value = 0;
+
+	// GNU base-256 encoding
+	if (p[0] & 0x80) {
+		value = p[0] & 0x3F;
+
+		int i;
+		for (i = 1; i < size; i++) {
+			value = (value << 8) | (uint8_t)p[i];
+		}
+
+		return value;
+	}
+
+	int i;
+	for (i = 0; i < size && p[i]; i++) {
+		if (p[i] >= '0' && p[i] <= '7')
+			value = (value << 3) | (p[i] - '0');
+	}
+
+	return value;
+}
+
+static int tarCheckHeader(TarHeader *header) {
+	uint8_t *p = (uint8_t *)header;
+
+	unsigned int sum = 0;
+
+	int i;
+	for (i = 0; i < TAR_BLOCK_SIZE; i++) {
+		if (i >= 148 && i < 156)
+			sum += ' ';
+		else
+			sum += p[i];
+	}
+
+	return sum == (unsigned int)tarParseNumber(header->chksum, sizeof(header->chksum));
+}
+
+// Read the next file or folder. The stream is left at the start of its data
+static int tarNext(TarArchive *tar, TarEntry *entry) {
+	int res;
+	TarHeader header;
+	char long_name[MAX_PATH_LENGTH];
+
+	long_name[0] = '\0';
+
+	while (1) {
+		res = tarSkip(tar, tar->next_header - tar->pos);
+		if (res < 0)
+			return res;
+
+		res = tarReadFull(tar, &header, sizeof(TarHeader));
+		if (res < 0)
+			return res;
+
+		// End of archive
+		if (res < sizeof(TarHeader) || header.name[0] == '\0')
+			return 0;
+
+		if (!tarCheckHeader(&header))
+			return -1;
+
+		SceOff size = tarParseNumber(header.size, sizeof(header.size));
+		tar->next_header = tar->pos + ((size + TAR_BLOCK_SIZE - 1) & ~(TAR_BLOCK_SIZE - 1));
+
+		// GNU long name
+		if (header.typeflag == 'L') {
+			int length = MIN(size, MAX_PATH_LENGTH - 1);
+			res = tarReadFull(tar, long_name, length);
+			if (res < 0)
+				return res;
+
+			long_name[res] = '\0';
+			continue;
+		}
+
+		// pax extended header, only the path is used
+		if (header.typeflag == 'x') {
+			char *pax = malloc(size + 1);
+			if (!pax)
+				return -1;
+
+			res = tarReadFull(tar, pax, size);
+			if (res < 0) {
+				free(pax);
+				return res;
+			}
+
+			pax[res] = '\0';
+
+			char *p = pax;
+			while (p < pax + res) {
+				char *key = strchr(p, ' ');
+				int length = atoi(p);
+				if (!key || length <= 0)
+					break;
+
+				if (strncmp(key + 1, "path=", 5) == 0) {
+					int name_length = MIN(length - (key + 6 - p) - 1, MAX_PATH_LENGTH - 1);
+					if (name_length > 0) {
+						strncpy(long_name, key + 6, name_length);
+						long_name[name_length] = '\0';
+					}
+				}
+
+				p += length;
+			}
+
+			free(pax);
+			continue;
+		}
+
+		// Only files and folders
+		if (header.typeflag != '0' && header.typeflag != '\0' && header.typeflag != '7' && header.typeflag != '5') {
+			long_name[0] = '\0';
+			continue;
+		}
+
+		if (long_name[0]) {
+			strcpy(entry->name, long_name);
+		} else if (header.prefix[0] && memcmp(header.magic, "ustar", 5) == 0) {
+			snprintf(entry->name, MAX_PATH_LENGTH, "%.155s/%.100s", header.prefix, header.name);
+		} else {
+			snprintf(entry->name, MAX_PATH_LENGTH, "%.100s", header.name);
+		}
+
+		// Remove leading ./
+		if (strncmp(entry->name, "./", 2) == 0)
+			memmove(entry->name, entry->name + 2, strlen(entry->name + 2) + 1);
+
+		// Archive root
+		if (entry->name[0] == '\0' || strcmp(entry->name, ".") == 0 || strcmp(entry->name, "./") == 0)
+			continue;
+
+		entry->is_folder = header.typeflag == '5';
+		if (entry->is_folder)
+			addEndSlash(entry->name);
+
+		entry->offset = tar->pos;
+		entry->size = entry->is_folder ? 0 : size;
+		entry->mtime = tarParseNumber(header.mtime, sizeof(header.mtime));
+
+		return 1;
+	}
+}
+
+int tarGetEntries(TarArchive *tar, FileList *list) {
+	int res;
+	TarEntry tar_entry;
+
+	res = tarRewind(tar);
+	if (res < 0)
+		return res;
+
+	while ((res = tarNext(tar, &tar_entry)) > 0) {
+		FileListEntry *entry = malloc(sizeof(FileListEntry));
+
+		// File info
+		strcpy(entry->name, tar_entry.name);
+		entry->is_folder = 0;
+		entry->name_length = strlen(entry->name);
+		entry->size = tar_entry.size;
+		entry->size2 = tar_entry.size;
+
+		// Time
+		SceDateTime time;
+		sceRtcSetTime_t(&time, tar_entry.mtime);
+
+		memcpy(&entry->ctime, &time, sizeof(SceDateTime));
+		memcpy(&entry->mtime, &time, sizeof(SceDateTime));
+		memcpy(&entry->atime, &time, sizeof(SceDateTime));
+
+		// Data offset
+		*(SceOff *)&entry->reserved = tar_entry.offset;
+
+		// Add entry
+		fileListAddEntry(list, entry, SORT_BY_NAME);
+	}
+
+	return res;
+}
+
+int tarRead(TarArchive *tar, SceOff offset, void *buf, SceSize size) {
+	int res;
+
+	// The stream can only go forward
+	if (offset < tar->pos) {
+		res = tarRewind(tar);
+		if (res < 0)
+			return res;
+	}
+
+	res = tarSkip(tar, offset - tar->pos);
+	if (res < 0)
+		return res;
+
+	return tarReadFull(tar, buf, size);
+}
+
+static void tarMakeParentFolders(const char *file) {
+	char path[MAX_PATH_LENGTH];
+	strncpy(path, file, MAX_PATH_LENGTH - 1);
+	path[MAX_PATH_LENGTH - 1] = '\0';
+
+	// Tarballs do not always contain the folder entries
+	char *p = strchr(path, '/');
+	while (p && p[1]) {
+		*p = '\0';
+		sceIoMkdir(path, 0777);
+		*p = '/';
+
+		p = strchr(p + 1, '/');
+	}
+}
+
+static int tarExtractFile(TarArchive *tar, TarEntry *entry, const char *dst, FileProcessParam *param) {
+	tarMakeParentFolders(dst);
+
+	SceUID fddst = sceIoOpen(dst, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+	if (fddst < 0)
+		return fddst;
+
+	SceOff seek = 0;
+
+	while (seek < entry->size) {
+		int read = tarReadFull(tar, tar->buffer, MIN(entry->size - seek, TAR_BUFFER_SIZE));
+		if (read <= 0) {
+			sceIoClose(fddst);
+			return read < 0 ? read : -1;
+		}
+
+		int written = sceIoWrite(fddst, tar->buffer, read);
+		if (written == SCE_ERROR_ERRNO_ENODEV) {
+			fddst = sceIoOpen(dst, SCE_O_WRONLY | SCE_O_CREAT, 0777);
+			if (fddst >= 0) {
+				sceIoLseek(fddst, seek, SCE_SEEK_SET);
+				written = sceIoWrite(fddst, tar->buffer, read);
+			}
+		}
+
+		if (written < 0) {
+			sceIoClose(fddst);
+			return written;
+		}
+
+		seek += written;
+
+		if (param) {
+			if (param->value)
+				(*param->value) += read;
+
+			if (param->SetProgress)
+				param->SetProgress(param->value ? *param->value : 0, param->max);
+
+			if (param->cancelHandler && param->cancelHandler()) {
+				sceIoClose(fddst);
+				return 0;
+			}
+		}
+	}
+
+	sceIoClose(fddst);
+
+	return 1;
+}
+
+// Single pass over the stream. src is a file or a folder with end slash, relative to the archive
+int tarExtract(TarArchive *tar, const char *src, const char *dst, FileProcessParam *param) {
+	int res;
+	TarEntry entry;
+
+	int src_length = strlen(src);
+	int is_folder = src_length == 0 || src[src_length - 1] == '/';
+	int found = 0;
+
+	res = tarRewind(tar);
+	if (res < 0)
+		return res;
+
+	// Folder itself
+	if (is_folder) {
+		res = sceIoMkdir(dst, 0777);
+		if (res < 0 && res != SCE_ERROR_ERRNO_EEXIST)
+			return res;
+
+		if (param) {
+			if (param->value)
+				(*param->value) += DIRECTORY_SIZE;
+
+			if (param->SetProgress)
+				param->SetProgress(param->value ? *param->value : 0, param->max);
+		}
+
+		found = 1;
+	}
+
+	while ((res = tarNext(tar, &entry)) > 0) {
+		if (strncasecmp(entry.name, src, src_length) != 0)
+			continue;
+
+		// Another file with the same prefix
+		if (!is_folder && entry.name[src_length] != '\0')
+			continue;
+
+		char *dst_path = malloc(strlen(dst) + strlen(entry.name + src_length) + 2);
+		if (!dst_path)
+			return -1;
+
+		sprintf(dst_path, "%s%s", dst, entry.name + src_length);
+
+		if (entry.is_folder) {
+			if (entry.name[src_length] != '\0') {
+				tarMakeParentFolders(dst_path);
+
+				res = sceIoMkdir(dst_path, 0777);
+				if (res < 0 && res != SCE_ERROR_ERRNO_EEXIST) {
+					free(dst_path);
+					return res;
+				}
+
+				if (param) {
+					if (param->value)
+						(*param->value) += DIRECTORY_SIZE;
+
+					if (param->SetProgress)
+						param->SetProgress(param->value ? *param->value : 0, param->max);
+				}
+			}
+		} else {
+			res = tarExtractFile(tar, &entry, dst_path, param);
+			if (res <= 0) {
+				free(dst_path);
+				return res;
+			}
+		}
+
+		free(dst_path);
+
+		found = 1;
+
+		if (param && param->cancelHandler && param->cancelHandler())
+			return 0;
+
+		// A single file is done
+		if (!is_folder)
+			break;
+	}
+
+	if (res < 0)
+		return res;
+
+	return found ? 1 : -1;
+}
+
+TarArchive *tarOpen(TarInput *input) {
+	TarArchive *tar = malloc(sizeof(TarArchive));
+	if (!tar)
+		return NULL;
+
+	memset(tar, 0, sizeof(TarArchive));
+	memcpy(&tar->input, input, sizeof(TarInput));
+
+	tar->in_buf = malloc(TAR_BUFFER_SIZE);
+	tar->buffer = malloc(TAR_BUFFER_SIZE);
+	if (!tar->in_buf || !tar->buffer)
+		goto ERROR;
+
+	tar->in_ptr = tar->in_buf;
+
+	// Detect outer stream by its magic
+	if (tarFillInput(tar) < 0)
+		goto ERROR;
+
+	if (tar->in_size >= 2 && tar->in_buf[0] == 0x1F && tar->in_buf[1] == 0x8B) {
+		tar->compression = TAR_COMPRESSION_GZIP;
+
+		if (inflateInit2(&tar->stream, 15 + 16) != Z_OK)
+			goto ERROR;
+
+		tar->stream_initialised = 1;
+	} else if (tar->in_size >= 4 && *(uint32_t *)tar->in_buf == 0xFD2FB528) {
+#ifdef HAVE_ZSTD
+		tar->compression = TAR_COMPRESSION_ZSTD;
+
+		tar->zstd = ZSTD_createDStream();
+		if (!tar->zstd)
+			goto ERROR;
+
+		ZSTD_initDStream(tar->zstd);
+#else
+		goto ERROR;
+#endif
+	} else {
+		tar->compression = TAR_COMPRESSION_NONE;
+	}
+
+	return tar;
+
+ERROR:
+	tarClose(tar);
+	return NULL;
+}
+
+void tarClose(TarArchive *tar) {
+	if (!tar)
+		return;
+
+	if (tar->stream_initialised)
+		inflateEnd(&tar->stream);
+
+#ifdef HAVE_ZSTD
+	if (tar->zstd)
+		ZSTD_freeDStream(tar->zstd);
+#endif
+
+	free(tar->buffer);
+	free(tar->in_buf);
+	free(tar);
+}
@@ -0,0 +1,40 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2016, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TAR_H__
+#define __TAR_H__
+
+#include "file.h"
+
+// Sequential input of the (compressed) tar stream
+typedef struct {
+	int (* read)(void *opaque, void *buf, SceSize size);
+	int (* rewind)(void *opaque);
+	void *opaque;
+} TarInput;
+
+typedef struct TarArchive TarArchive;
+
+TarArchive *tarOpen(TarInput *input);
+void tarClose(TarArchive *tar);
+
+int tarGetEntries(TarArchive *tar, FileList *list);
+int tarRead(TarArchive *tar, SceOff offset, void *buf, SceSize size);
+int tarExtract(TarArchive *tar, const char *src, const char *dst, FileProcessParam *param);
+
+#endif
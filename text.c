@@ -26,6 +26,10 @@
 #include "utils.h"
 #include "language.h"
 #include "ime_dialog.h"
+#include "bm.h"
+#include "regexp.h"
+#include "piece.h"
+#include "encoding.h"
 #include "message_dialog.h"
 
 float text_ctx_menu_max_width = 0.0f;
@@ -40,6 +44,7 @@ enum TextMenuEntrys {
 	TEXT_MENU_ENTRY_INSERT_EMPTY_LINE,
 	TEXT_MENU_ENTRY_EMPTY_2,
 	TEXT_MENU_ENTRY_SEARCH,
+	TEXT_MENU_ENTRY_SEARCH_REGEX,
 	TEXT_MENU_ENTRY_EMPTY_3,
 	TEXT_MENU_ENTRY_HEX_EDITOR,
 };
@@ -54,6 +59,7 @@ MenuEntry text_menu_entries[] = {
 	{ INSERT_EMPTY_LINE, 0, CTX_VISIBILITY_INVISIBLE },
 	{ -1, 0, CTX_VISIBILITY_UNUSED },
 	{ SEARCH, 0, CTX_VISIBILITY_VISIBLE },
+	{ SEARCH_REGEX, 0, CTX_VISIBILITY_VISIBLE },
 	{ -1, 0, CTX_VISIBILITY_UNUSED },
 	{ OPEN_HEX_EDITOR, 0, CTX_VISIBILITY_VISIBLE },
 };
@@ -62,22 +68,26 @@ typedef struct TextEditorState {
 	int running;
 	char *buffer;
 	int size;
+	PieceTable table;
 	int base_pos;
 	int rel_pos;
-	int offset_list[MAX_LINES];
+	int *offset_list;
+	int max_lines;
 	int selection_list[MAX_SELECTION];
 	int n_selections;
 	int n_copied_lines;
 	int copy_reset;
 	int modify_allowed;
+	int has_utf8_bom;
 	ContextMenu context_menu;
-	CopyEntry copy_buffer[MAX_COPY_BUFFER_SIZE];
+	CopyEntry *copy_buffer;
+	int max_copied_lines;
 	TextList list;
 	int changed;
 	int save_question;
 	int edit_line;
 	char search_term[MAX_LINE_CHARACTERS];
-	int search_result_offsets[MAX_SEARCH_RESULTS];
+	int *search_result_blocks[MAX_SEARCH_RESULTS / SEARCH_RESULTS_BLOCK_SIZE];
 	int search_term_input;
 	int n_search_results;
 	int search_thid;
@@ -86,11 +96,35 @@ typedef struct TextEditorState {
 	int count_lines_running;
 	int n_lines;
 	int search_running;
+	int search_regex;
+	Regex *regex;
+	StringSearch search;
+	int invalid_regex;
+	TextRow rows[TEXT_ROW_CACHE_SIZE];
+	int row_clock;
+
+	// Paged mode
+	int paged;
+	char *path;
+	int in_archive;
+	SceUID fd;
+	SceUID read_sema;
+	SceOff file_size;
+	SceOff window_offset;
+	int window_line;
+	int window_eof;
+	SceOff *checkpoints;
+	int n_checkpoints;
+	int max_checkpoints;
+	SceUID checkpoint_sema;
+	int total_lines;
+	int index_thid;
+	int index_running;
 } TextEditorState;
 
 typedef struct SearchParams {
 	TextEditorState *state;
-	char search_term[MAX_LINE_CHARACTERS];
+	Regex *regex;
 } SearchParams;
 
 typedef struct CountParams {
@@ -147,11 +181,13 @@ static int textReadLine(char *buffer, int offset, int size, char *line) {
 	// Get line
 	int line_width = 0;
 	int count = 0;
+	int limit = MIN(size, MIN(size - offset, MAX_LINE_CHARACTERS - 1));
 
-	int i;
-	for (i = 0; i < MIN(size, MIN(size - offset, MAX_LINE_CHARACTERS - 1)); i++) {
+	int i = 0;
+	while (i < limit) {
 		char ch = buffer[offset + i];
-		char ch_width = 0;
+		int ch_width = 0;
+		int length = 1;
 
 		// Line break
 		if (ch == '\n') {
@@ -162,12 +198,24 @@ static int textReadLine(char *buffer, int offset, int size, char *line) {
 		// Tab
 		if (ch == '\t') {
 			ch_width = TAB_SIZE * font_size_cache[' '];
+		} else if ((unsigned char)ch < 0x80) {
+			ch_width = font_size_cache[(int)ch];
 		} else {
+			unsigned int code;
+			length = utf8Decode(buffer + offset + i, size - offset - i, &code);
+
+			// Don't split a character at the end of a long line
+			if (i + length > limit)
+				break;
+
+			if (length > 0)
+				ch_width = getGlyphWidth(code);
+		}
+
+		if (ch_width == 0) {
+			ch = ' '; // Change invalid characters to space
 			ch_width = font_size_cache[(int)ch];
-			if (ch_width == 0) {
-				ch = ' '; // Change invalid characters to space
-				ch_width = font_size_cache[(int)ch];
-			}
+			length = MAX(length, 1);
 		}
 
 		// Too long
@@ -178,8 +226,16 @@ static int textReadLine(char *buffer, int offset, int size, char *line) {
 		line_width += ch_width;
 
 		// Add to line string
-		if (line)
-			line[count++] = ch;
+		if (line) {
+			if (ch == ' ' || length == 1) {
+				line[count++] = ch;
+			} else {
+				memcpy(line + count, buffer + offset + i, length);
+				count += length;
+			}
+		}
+
+		i += length;
 	}
 
 	// End of line
@@ -189,6 +245,557 @@ static int textReadLine(char *buffer, int offset, int size, char *line) {
 	return i;
 }
 
+#define WORD_ONES 0x01010101
+#define WORD_HIGHS 0x80808080
+#define WORD_NEWLINES (WORD_ONES * '\n')
+
+// Find the next line break a word at a time. Also reports whether any byte
+// before it is non-ASCII, as the font width of those can't be bounded
+static int textFindNewline(char *buffer, int offset, int size, int *non_ascii) {
+	unsigned char *p = (unsigned char *)buffer;
+	uint32_t high = 0;
+	int i = offset;
+
+	// Align to a word
+	while (i < size && ((uintptr_t)(p + i) & 3) && p[i] != '\n')
+		high |= p[i++];
+
+	while (((uintptr_t)(p + i) & 3) == 0 && i + 4 <= size) {
+		uint32_t word;
+		memcpy(&word, p + i, 4);
+
+		// A zero byte in word ^ WORD_NEWLINES is a newline
+		uint32_t x = word ^ WORD_NEWLINES;
+		if ((x - WORD_ONES) & ~x & WORD_HIGHS)
+			break;
+
+		high |= word;
+		i += 4;
+	}
+
+	while (i < size && p[i] != '\n')
+		high |= p[i++];
+
+	*non_ascii = (high & WORD_HIGHS) != 0;
+
+	return i;
+}
+
+// Longest line that can't reach the screen width
+static int textGetShortLineLength() {
+	int max_width = (int)(MAX_WIDTH - TEXT_START_X + SHELL_MARGIN_X);
+
+	int ch_width = TAB_SIZE * font_size_cache[' '];
+	int i;
+	for (i = 0; i < 256; i++)
+		ch_width = MAX(ch_width, font_size_cache[i]);
+
+	return MIN(MAX_LINE_CHARACTERS - 2, (max_width - 1) / MAX(ch_width, 1));
+}
+
+// Offset of the display line following the one at offset. Short lines are found
+// by the newline scan alone, only longer ones go through textReadLine
+static int textNextLine(char *buffer, int offset, int size, int short_length) {
+	int scan_end = MIN(size, offset + short_length + 1);
+
+	int non_ascii;
+	int newline = textFindNewline(buffer, offset, scan_end, &non_ascii);
+
+	if (!non_ascii && (newline < scan_end || scan_end == size))
+		return newline < size ? newline + 1 : newline;
+
+	return offset + textReadLine(buffer, offset, size, NULL);
+}
+
+// Up to a line of text at offset. Only copied when it spans several pieces
+static char *textGetChunk(TextEditorState *state, int offset, char *chunk, int *length) {
+	int wanted = MIN(MAX_LINE_CHARACTERS, state->size - offset);
+
+	char *p = pieceTableGetPointer(&state->table, offset, length);
+	if (p && *length >= wanted) {
+		*length = wanted;
+		return p;
+	}
+
+	*length = pieceTableRead(&state->table, offset, chunk, wanted);
+	return chunk;
+}
+
+// Display line at offset, laid out again only if it isn't in the row cache
+static int textGetLine(TextEditorState *state, int offset, char *line) {
+	TextRow *row = &state->rows[0];
+
+	int i;
+	for (i = 0; i < TEXT_ROW_CACHE_SIZE; i++) {
+		TextRow *current = &state->rows[i];
+
+		if (current->length > 0 && current->offset == offset) {
+			row = current;
+			break;
+		}
+
+		// An unused or the least recently used one is replaced
+		if (row->length > 0 && (current->length == 0 || current->last_use < row->last_use))
+			row = current;
+	}
+
+	if (i == TEXT_ROW_CACHE_SIZE) {
+		char chunk[MAX_LINE_CHARACTERS];
+		int length;
+		char *p = textGetChunk(state, offset, chunk, &length);
+
+		row->offset = offset;
+		row->length = textReadLine(p, 0, length, row->line);
+	}
+
+	row->last_use = ++state->row_clock;
+
+	if (line)
+		strcpy(line, row->line);
+
+	return row->length;
+}
+
+// The text from start up to old_end was replaced, changing the size by delta.
+// A row depends on its text and at most one character behind it
+static void textInvalidateRows(TextEditorState *state, int start, int old_end, int delta) {
+	int i;
+	for (i = 0; i < TEXT_ROW_CACHE_SIZE; i++) {
+		TextRow *row = &state->rows[i];
+
+		if (row->offset >= old_end)
+			row->offset += delta;
+		else if (row->offset + row->length + UTF8_MAX_LENGTH > start)
+			row->length = 0;
+	}
+}
+
+static void textClearRows(TextEditorState *state) {
+	int i;
+	for (i = 0; i < TEXT_ROW_CACHE_SIZE; i++)
+		state->rows[i].length = 0;
+}
+
+static int textNextLineAt(TextEditorState *state, int offset, int short_length) {
+	char chunk[MAX_LINE_CHARACTERS];
+	int length;
+	char *p = textGetChunk(state, offset, chunk, &length);
+
+	return offset + textNextLine(p, 0, length, short_length);
+}
+
+// Make offset_list hold n_lines lines. The entries on screen can reach
+// MAX_ENTRIES behind the last line
+static int textReserveLines(TextEditorState *state, int n_lines) {
+	n_lines = MIN(n_lines, MAX_LINES - 1);
+	if (n_lines <= state->max_lines)
+		return state->offset_list ? 0 : -1;
+
+	int *offset_list = realloc(state->offset_list, (n_lines + MAX_ENTRIES + 1) * sizeof(int));
+	if (!offset_list)
+		return -1;
+
+	state->offset_list = offset_list;
+	state->max_lines = n_lines;
+
+	return 0;
+}
+
+// Build offset_list from line onwards
+static void textIndexLines(TextEditorState *state, int line, int *running) {
+	int short_length = textGetShortLineLength();
+
+	line = MIN(line, state->n_lines);
+	state->n_lines = line;
+
+	int offset = state->offset_list[line];
+
+	YieldState yield;
+	initYield(&yield, 256);
+
+	while ((!running || *running) && offset < state->size) {
+		// The indexer thread can't move offset_list, it was sized for the file.
+		// Growing it also stops at MAX_LINES
+		if (line >= state->max_lines && (running || textReserveLines(state, state->max_lines * 2) < 0 || line >= state->max_lines))
+			break;
+
+		offset = textNextLineAt(state, offset, short_length);
+
+		state->offset_list[++line] = offset;
+		state->n_lines = line;
+
+		yieldIfNeeded(&yield);
+	}
+}
+
+// Line breaks in the buffer, up to as many lines as offset_list can hold
+static int textCountNewlines(char *buffer, int size) {
+	char *p = buffer, *end = buffer + size;
+	int lines = 0;
+
+	while ((p = memchr(p, '\n', end - p)) && ++lines < MAX_LINES - 1)
+		p++;
+
+	return lines;
+}
+
+// Line containing offset
+static int textGetLineOfOffset(TextEditorState *state, int offset) {
+	int low = 0, high = MAX(state->n_lines - 1, 0);
+
+	while (low < high) {
+		int mid = (low + high + 1) / 2;
+
+		if (state->offset_list[mid] <= offset)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+
+	return low;
+}
+
+// Edits need the complete index of the text before them
+static void textFinishIndex(TextEditorState *state) {
+	if (state->count_lines_running) {
+		state->count_lines_running = 0;
+		sceKernelWaitThreadEnd(state->count_lines_thid, NULL, NULL);
+		textIndexLines(state, state->n_lines, NULL);
+	}
+}
+
+// Index of the old line starting at offset, or -1
+static int textFindLineStart(TextEditorState *state, int offset, int line) {
+	int low = line, high = state->n_lines;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+
+		if (state->offset_list[mid] < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return state->offset_list[low] == offset ? low : -1;
+}
+
+// The text from the start of line up to old_end was replaced, changing the size
+// by delta. Lines are scanned again only until one starts where an old line did,
+// the ones behind are shifted
+static void textUpdateIndex(TextEditorState *state, int line, int old_end, int delta) {
+	int short_length = textGetShortLineLength();
+	int *offset_list = state->offset_list;
+
+	textInvalidateRows(state, offset_list[MIN(line, state->n_lines)], old_end, delta);
+
+	// A line break inserted at line can join the line before
+	line = MAX(MIN(line, state->n_lines) - 1, 0);
+
+	int *starts = NULL;
+	int n_starts = 0, max_starts = 0;
+
+	int offset = offset_list[line];
+	int old_line = state->n_lines;
+
+	while (1) {
+		if (offset >= old_end + delta) {
+			int found = textFindLineStart(state, offset - delta, line);
+			if (found >= 0) {
+				old_line = found;
+				break;
+			}
+		}
+
+		if (offset >= state->size)
+			break;
+
+		if (line + n_starts >= state->max_lines) {
+			textReserveLines(state, state->max_lines * 2);
+			if (line + n_starts >= state->max_lines)
+				break;
+		}
+
+		if (n_starts == max_starts) {
+			max_starts += 256;
+			int *tmp = realloc(starts, max_starts * sizeof(int));
+			if (!tmp) {
+				free(starts);
+				textIndexLines(state, line, NULL);
+				return;
+			}
+
+			starts = tmp;
+		}
+
+		offset = textNextLineAt(state, offset, short_length);
+		starts[n_starts++] = offset;
+	}
+
+	// Move the unchanged lines behind the scanned ones
+	textReserveLines(state, line + n_starts + state->n_lines - old_line);
+	offset_list = state->offset_list;
+
+	int n_tail = MIN(state->n_lines - old_line, state->max_lines - line - n_starts);
+	memmove(&offset_list[line + n_starts + 1], &offset_list[old_line + 1], n_tail * sizeof(int));
+
+	int i;
+	for (i = 0; i < n_tail; i++)
+		offset_list[line + n_starts + 1 + i] += delta;
+
+	memcpy(&offset_list[line + 1], starts, n_starts * sizeof(int));
+	state->n_lines = line + n_starts + n_tail;
+
+	free(starts);
+}
+
+static int textAddCheckpoint(TextEditorState *state, SceOff offset) {
+	sceKernelWaitSema(state->checkpoint_sema, 1, NULL);
+
+	if (state->n_checkpoints == state->max_checkpoints) {
+		int max_checkpoints = state->max_checkpoints * 2;
+		SceOff *checkpoints = realloc(state->checkpoints, max_checkpoints * sizeof(SceOff));
+		if (!checkpoints) {
+			sceKernelSignalSema(state->checkpoint_sema, 1);
+			return -1;
+		}
+
+		state->checkpoints = checkpoints;
+		state->max_checkpoints = max_checkpoints;
+	}
+
+	state->checkpoints[state->n_checkpoints++] = offset;
+
+	sceKernelSignalSema(state->checkpoint_sema, 1);
+
+	return 0;
+}
+
+static SceOff textGetCheckpoint(TextEditorState *state, int checkpoint) {
+	sceKernelWaitSema(state->checkpoint_sema, 1, NULL);
+	SceOff offset = checkpoint < state->n_checkpoints ? state->checkpoints[checkpoint] : -1;
+	sceKernelSignalSema(state->checkpoint_sema, 1);
+
+	return offset;
+}
+
+// Files inside archives are opened through the archive handles
+static int textOpenFile(TextEditorState *state, char *file) {
+	state->in_archive = isInArchive();
+	if (!state->in_archive) {
+		state->fd = sceIoOpen(file, SCE_O_RDONLY, 0);
+		return state->fd;
+	}
+
+	state->read_sema = sceKernelCreateSema("text_read_sema", 0, 1, 1, NULL);
+	if (state->read_sema < 0)
+		return state->read_sema;
+
+	state->fd = archiveFileOpen(file, SCE_O_RDONLY, 0);
+	if (state->fd < 0)
+		sceKernelDeleteSema(state->read_sema);
+
+	return state->fd;
+}
+
+static void textCloseFile(TextEditorState *state) {
+	if (state->in_archive) {
+		archiveFileClose(state->fd);
+		sceKernelDeleteSema(state->read_sema);
+	} else {
+		sceIoClose(state->fd);
+	}
+}
+
+// Archived files have a single handle that the window and the index thread
+// take turns on. Archive reads may return less than asked for
+static int textReadFile(TextEditorState *state, SceUID fd, SceOff offset, char *buf, int size) {
+	if (!state->in_archive) {
+		sceIoLseek(fd, offset, SCE_SEEK_SET);
+		return sceIoRead(fd, buf, size);
+	}
+
+	sceKernelWaitSema(state->read_sema, 1, NULL);
+
+	int total = 0;
+	archiveFileLseek(fd, offset, SCE_SEEK_SET);
+
+	while (total < size) {
+		int read = archiveFileRead(fd, buf + total, size - total);
+		if (read <= 0) {
+			if (total == 0)
+				total = read;
+			break;
+		}
+
+		total += read;
+	}
+
+	sceKernelSignalSema(state->read_sema, 1);
+
+	return total;
+}
+
+// Count display lines of the whole file and keep the offset of every
+// TEXT_CHECKPOINT_LINES line, so the window can be placed anywhere
+static int index_file_thread(SceSize args, CountParams *params) {
+	TextEditorState *state = params->state;
+
+	SceUID fd = state->in_archive ? state->fd : sceIoOpen(state->path, SCE_O_RDONLY, 0);
+	char *buf = malloc(TEXT_INDEX_CHUNK_SIZE);
+
+	if (fd >= 0 && buf) {
+		int short_length = textGetShortLineLength();
+		SceOff pos = textGetCheckpoint(state, 0);
+		int line = 0;
+
+		YieldState yield;
+		initYield(&yield, 256);
+
+		while (state->index_running && pos < state->file_size) {
+			int read = textReadFile(state, fd, pos, buf, TEXT_INDEX_CHUNK_SIZE);
+			if (read <= 0)
+				break;
+
+			// Lines starting before limit end inside the chunk. A short read
+			// means the file ended early, so index the rest as the last chunk
+			int eof = pos + read >= state->file_size || read < TEXT_INDEX_CHUNK_SIZE;
+			int limit = eof ? read : read - MAX_LINE_CHARACTERS;
+
+			int offset = 0;
+			while (state->index_running && offset < limit) {
+				if (line > 0 && line % TEXT_CHECKPOINT_LINES == 0 && textAddCheckpoint(state, pos + offset) < 0) {
+					state->index_running = 0;
+					break;
+				}
+
+				offset = textNextLine(buf, offset, read, short_length);
+				state->total_lines = ++line;
+
+				yieldIfNeeded(&yield);
+			}
+
+			pos += offset;
+		}
+	}
+
+	if (buf)
+		free(buf);
+
+	if (fd >= 0 && !state->in_archive)
+		sceIoClose(fd);
+
+	state->index_running = 0;
+
+	return sceKernelExitDeleteThread(0);
+}
+
+// Read the window starting at checkpoint and index its lines
+static int textLoadWindow(TextEditorState *state, int checkpoint) {
+	SceOff offset = textGetCheckpoint(state, checkpoint);
+	if (offset < 0)
+		return -1;
+
+	int read = textReadFile(state, state->fd, offset, state->buffer, TEXT_WINDOW_SIZE);
+	if (read < 0)
+		return read;
+
+	state->window_offset = offset;
+	state->window_line = checkpoint * TEXT_CHECKPOINT_LINES;
+	state->window_eof = offset + read >= state->file_size;
+	state->size = read;
+
+	if (state->window_eof && (state->size == 0 || state->buffer[state->size - 1] != '\n'))
+		state->buffer[state->size++] = '\n';
+
+	pieceTableFree(&state->table);
+	if (pieceTableInit(&state->table, state->buffer, state->size) < 0)
+		return -1;
+
+	textClearRows(state);
+	cacheGlyphWidths(state->buffer, state->size);
+
+	state->n_lines = 0;
+	state->offset_list[0] = 0;
+	textIndexLines(state, 0, NULL);
+
+	// The last line may continue behind the window
+	int end = state->offset_list[state->n_lines];
+	if (!state->window_eof && end == state->size && state->n_lines > 1)
+		end = state->offset_list[--state->n_lines];
+
+	if (end < state->size) {
+		pieceTableDelete(&state->table, end, state->size - end);
+		state->size = end;
+		state->window_eof = 0;
+	}
+
+	return 0;
+}
+
+static void textClosePaged(TextEditorState *state) {
+	if (state->index_running) {
+		state->index_running = 0;
+		sceKernelWaitThreadEnd(state->index_thid, NULL, NULL);
+	}
+
+	free(state->checkpoints);
+	sceKernelDeleteSema(state->checkpoint_sema);
+	textCloseFile(state);
+}
+
+static int textOpenPaged(TextEditorState *state, char *file, SceOff size) {
+	int res = textOpenFile(state, file);
+	if (res < 0)
+		return res;
+
+	state->checkpoint_sema = sceKernelCreateSema("text_checkpoint_sema", 0, 1, 1, NULL);
+	if (state->checkpoint_sema < 0) {
+		textCloseFile(state);
+		return state->checkpoint_sema;
+	}
+
+	state->max_checkpoints = 1024;
+	state->checkpoints = malloc(state->max_checkpoints * sizeof(SceOff));
+	if (!state->checkpoints) {
+		sceKernelDeleteSema(state->checkpoint_sema);
+		textCloseFile(state);
+		return -1;
+	}
+
+	// Skip UTF-8 BOM
+	char bom[3];
+	char utf8_bom[3] = {0xEF, 0xBB, 0xBF};
+	int read = textReadFile(state, state->fd, 0, bom, sizeof(bom));
+
+	state->checkpoints[0] = (read == sizeof(bom) && memcmp(bom, utf8_bom, sizeof(bom)) == 0) ? sizeof(bom) : 0;
+	state->n_checkpoints = 1;
+
+	state->paged = 1;
+	state->path = file;
+	state->file_size = size;
+	state->total_lines = 0;
+	state->modify_allowed = 0;
+
+	res = textLoadWindow(state, 0);
+	if (res < 0) {
+		textClosePaged(state);
+		return res;
+	}
+
+	CountParams index_params;
+	index_params.state = state;
+
+	state->index_running = 1;
+	state->index_thid = sceKernelCreateThread("index_file_thread", (SceKernelThreadEntry)index_file_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
+	if (state->index_thid >= 0)
+		sceKernelStartThread(state->index_thid, sizeof(CountParams), &index_params);
+	else
+		state->index_running = 0;
+
+	return 0;
+}
+
 static void updateTextEntry(TextEditorState *state, TextListEntry* entry, int rel_pos) {
 	entry->line_number = state->base_pos + rel_pos;
 
@@ -202,7 +809,7 @@ static void updateTextEntry(TextEditorState *state, TextListEntry* entry, int re
 		}
 	}
 
-	int length = textReadLine(state->buffer, state->offset_list[state->base_pos + rel_pos], state->size, entry->line);
+	int length = textGetLine(state, state->offset_list[state->base_pos + rel_pos], entry->line);
 	state->offset_list[state->base_pos + rel_pos + 1] = state->offset_list[state->base_pos + rel_pos] + length;
 }
 
@@ -221,6 +828,75 @@ static void updateTextEntries(TextEditorState *state) {
 }
 
 
+// Last checkpoint at or before offset
+static int textFindCheckpoint(TextEditorState *state, SceOff offset) {
+	sceKernelWaitSema(state->checkpoint_sema, 1, NULL);
+
+	int low = 0, high = state->n_checkpoints - 1;
+	while (low < high) {
+		int mid = (low + high + 1) / 2;
+
+		if (state->checkpoints[mid] <= offset)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+
+	sceKernelSignalSema(state->checkpoint_sema, 1);
+
+	return low;
+}
+
+// Move the window once the view gets close to one of its ends. The new window
+// keeps most of its data in the scroll direction
+static void textSlideWindow(TextEditorState *state) {
+	int line = state->window_line + state->base_pos;
+	SceOff offset = state->window_offset + state->offset_list[state->base_pos];
+	int window_checkpoint = state->window_line / TEXT_CHECKPOINT_LINES;
+	int checkpoint = -1;
+
+	// Keep 3/4 of the window behind the view when scrolling up, 1/4 when scrolling down.
+	// Also in lines, as offset_list limits how many fit in
+	if (state->base_pos < MAX_ENTRIES && state->window_line > 0) {
+		checkpoint = textFindCheckpoint(state, offset - TEXT_WINDOW_SIZE * 3 / 4);
+		checkpoint = MAX(checkpoint, (line - MAX_LINES * 3 / 4) / TEXT_CHECKPOINT_LINES);
+	} else if (state->base_pos + 2 * MAX_ENTRIES > state->n_lines && !state->window_eof) {
+		checkpoint = textFindCheckpoint(state, offset - TEXT_WINDOW_SIZE / 4);
+		checkpoint = MAX(checkpoint, (line - MAX_LINES / 4) / TEXT_CHECKPOINT_LINES);
+		if (checkpoint <= window_checkpoint)
+			checkpoint = line / TEXT_CHECKPOINT_LINES - 1;
+	}
+
+	if (checkpoint < 0 || checkpoint == window_checkpoint)
+		return;
+
+	// The file indexer hasn't got there yet
+	if (checkpoint >= state->n_checkpoints)
+		return;
+
+	// Search results are window offsets
+	if (state->search_running) {
+		state->search_running = 0;
+		sceKernelWaitThreadEnd(state->search_thid, NULL, NULL);
+	}
+
+	state->n_search_results = 0;
+
+	if (textLoadWindow(state, checkpoint) < 0)
+		return;
+
+	// Too many lines in between for one window
+	if (line - state->window_line >= state->n_lines - MAX_ENTRIES && !state->window_eof) {
+		if (textLoadWindow(state, MAX(line / TEXT_CHECKPOINT_LINES - 1, 0)) < 0)
+			return;
+	}
+
+	state->base_pos = MIN(line - state->window_line, MAX(state->n_lines - 1, 0));
+	state->rel_pos = MIN(state->rel_pos, state->n_lines - state->base_pos - 1);
+
+	updateTextEntries(state);
+}
+
 static CopyEntry *copy_line(TextEditorState *state, int line_number) {
 	if (state->copy_reset) {
 		state->copy_reset = 0;
@@ -230,12 +906,33 @@ static CopyEntry *copy_line(TextEditorState *state, int line_number) {
 	// Get current line
 	int line_start = state->offset_list[line_number];
 	char line[MAX_LINE_CHARACTERS];
-	int length = textReadLine(state->buffer, line_start, state->size, line);
+	int length = textGetLine(state, line_start, line);
+
+	if (state->n_copied_lines == state->max_copied_lines) {
+		int max_copied_lines = MIN(MAX(state->max_copied_lines * 2, 16), MAX_COPY_BUFFER_SIZE);
+		if (max_copied_lines == state->max_copied_lines)
+			return NULL;
+
+		CopyEntry *copy_buffer = realloc(state->copy_buffer, max_copied_lines * sizeof(CopyEntry));
+		if (!copy_buffer)
+			return NULL;
+
+		memset(copy_buffer + state->max_copied_lines, 0, (max_copied_lines - state->max_copied_lines) * sizeof(CopyEntry));
+		state->copy_buffer = copy_buffer;
+		state->max_copied_lines = max_copied_lines;
+	}
 
 	CopyEntry *entry = &state->copy_buffer[state->n_copied_lines];
 
+	// Room for a newline and the terminator
+	char *copy = realloc(entry->line, length + 2);
+	if (!copy)
+		return NULL;
+
+	entry->line = copy;
+
 	// Copy line into copy_buffer
-	memcpy(entry->line, &state->buffer[line_start], length);
+	pieceTableRead(&state->table, line_start, entry->line, length);
 
 	// Make sure line end with a newline
 	if (entry->line[length - 1] != '\n') {
@@ -244,7 +941,7 @@ static CopyEntry *copy_line(TextEditorState *state, int line_number) {
 	}
 	
 	// Terminate line
-	state->copy_buffer[state->n_copied_lines].line[length] = '\0';
+	entry->line[length] = '\0';
 	
 	state->n_copied_lines++;
 
@@ -253,22 +950,23 @@ static CopyEntry *copy_line(TextEditorState *state, int line_number) {
 
 
 static void delete_line(TextEditorState *state, int line_number) {
+	textFinishIndex(state);
+
 	// Get current line
 	int line_start = state->offset_list[line_number];
-	char line[MAX_LINE_CHARACTERS];
-	int length = textReadLine(state->buffer, line_start, state->size, line);
+	int length = textGetLine(state, line_start, NULL);
+	int old_size = state->size;
 
 	// Remove line
-	memmove(&state->buffer[line_start], &state->buffer[line_start+length], state->size-line_start);	
-	state->size -= length;
-	state->n_lines -= 1;
+	pieceTableDelete(&state->table, line_start, length);
 
 	// Add empty line if resulting buffer is empty
-	if (state->size == 0) {
-		state->size = 1;
-		state->n_lines = 1;
-		state->buffer[0] = '\n';
-	} 
+	if (state->table.size == 0)
+		pieceTableInsert(&state->table, 0, "\n", 1);
+
+	state->size = state->table.size;
+
+	textUpdateIndex(state, line_number, line_start + length, state->size - old_size);
 
 	if (state->base_pos + state->rel_pos >= state->n_lines) {
 		state->rel_pos = state->n_lines - state->base_pos - 1;
@@ -287,24 +985,20 @@ static void delete_line(TextEditorState *state, int line_number) {
 }
 
 static void insert_line(TextEditorState *state, char *line, int pos) {
+	textFinishIndex(state);
+
 	int offset = state->offset_list[pos];
 
 	// calculated size of inserted line
 	int length = strlen(line);
 
-	// Make space for inserted line
-	memmove(&state->buffer[offset+length], &state->buffer[offset], state->size-offset);
-	state->size += length;
+	// Insert the line
+	if (pieceTableInsert(&state->table, offset, line, length) < 0)
+		return;
 
-	// Insert the lines
-	memcpy(&state->buffer[offset], line, length);
+	state->size = state->table.size;
 
-	int i;
-	for (i = 0; i < length; i++) {
-		if (line[i] == '\n') {
-			state->n_lines++;
-		}
-	}
+	textUpdateIndex(state, pos, offset, length);
 	
 	state->n_selections = 0;
 	state->changed = 1;
@@ -320,27 +1014,25 @@ static void cut_line(TextEditorState *state, int line_number) {
 }
 
 static void paste_lines(TextEditorState *state, int pos) {
-	int line_start = state->offset_list[pos];
+	textFinishIndex(state);
 
-	// calculated size of pasted content
-	int length = 0, i;
-	for (i = 0; i < state->n_copied_lines; i++) {
-		length += strlen(state->copy_buffer[i].line);
-	}
-
-	// Make space for pasted lines
-	memmove(&state->buffer[line_start+length], &state->buffer[line_start], state->size-line_start);
-	state->size += length;
+	int offset = state->offset_list[pos];
+	int line_start = offset;
 
-	// Paste the lines
+	// Paste the lines, they end up in one piece
+	int i;
 	for (i = 0; i < state->n_copied_lines; i++) {
 		int line_length = strlen(state->copy_buffer[i].line);
 
-		memcpy(&state->buffer[line_start], state->copy_buffer[i].line, line_length);
+		if (pieceTableInsert(&state->table, line_start, state->copy_buffer[i].line, line_length) < 0)
+			break;
+
 		line_start += line_length;
 	}
 
-	state->n_lines += state->n_copied_lines;
+	state->size = state->table.size;
+
+	textUpdateIndex(state, pos, offset, line_start - offset);
 	
 	state->changed = 1;
 	state->copy_reset = 1;
@@ -363,6 +1055,13 @@ static int contextMenuEnterCallback(int pos, void *context) {
 		case TEXT_MENU_ENTRY_SEARCH:
 			initImeDialog(language_container[ENTER_SEARCH_TERM], "", MAX_LINE_CHARACTERS, SCE_IME_TYPE_DEFAULT, 0);
 			state->search_term_input = 1;
+			state->search_regex = 0;
+			break;
+
+		case TEXT_MENU_ENTRY_SEARCH_REGEX:
+			initImeDialog(language_container[ENTER_REGEX], state->search_regex ? state->search_term : "", REGEX_MAX_PATTERN_LENGTH - 1, SCE_IME_TYPE_DEFAULT, 0);
+			state->search_term_input = 1;
+			state->search_regex = 1;
 			break;
 
 		case TEXT_MENU_ENTRY_HEX_EDITOR:
@@ -402,10 +1101,10 @@ static int contextMenuEnterCallback(int pos, void *context) {
 
 			// Reverse the order of the copied lines
 			int j;
-			for (i = 0, j = state->n_selections - 1; i < j; i++, j--) {
+			for (i = 0, j = state->n_copied_lines - 1; i < j; i++, j--) {
 				CopyEntry tmp = state->copy_buffer[i];
-				state->copy_buffer[j] = state->copy_buffer[i];
-				state->copy_buffer[i] = tmp;
+				state->copy_buffer[i] = state->copy_buffer[j];
+				state->copy_buffer[j] = tmp;
 			}
 
 			state->n_selections = 0;
@@ -459,50 +1158,134 @@ static void setContextMenuVisibilities(TextEditorState *state) {
 static int count_lines_thread(SceSize args, CountParams *params) {
 	TextEditorState *state = params->state;
 
-	state->count_lines_running = 1;
-	state->n_lines = 0;
+	textIndexLines(state, 0, &state->count_lines_running);
+
+	state->count_lines_running = 0;
+
+	return sceKernelExitDeleteThread(0);
+}
+
+#define SEARCH_SLICE_SIZE 64 * 1024
+
+// Results are kept in blocks that never move, so the search thread can add
+// more while they are drawn
+static int textGetSearchResult(TextEditorState *state, int i) {
+	return state->search_result_blocks[i / SEARCH_RESULTS_BLOCK_SIZE][i % SEARCH_RESULTS_BLOCK_SIZE];
+}
 
+static int textAddSearchResult(TextEditorState *state, int offset) {
+	int i = state->n_search_results;
+	if (i >= MAX_SEARCH_RESULTS)
+		return -1;
+
+	int **block = &state->search_result_blocks[i / SEARCH_RESULTS_BLOCK_SIZE];
+	if (!*block) {
+		*block = malloc(SEARCH_RESULTS_BLOCK_SIZE * sizeof(int));
+		if (!*block)
+			return -1;
+	}
+
+	(*block)[i % SEARCH_RESULTS_BLOCK_SIZE] = offset;
+	state->n_search_results++;
+
+	return 0;
+}
+
+// Index of the first search result at or after offset. Results are found in order
+static int textFindSearchResult(TextEditorState *state, int offset) {
+	int low = 0, high = state->n_search_results;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+
+		if (textGetSearchResult(state, mid) < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+// Regex matches don't overlap, so a greedy pattern can't rescan the same text
+static void regexSearch(TextEditorState *state, Regex *re) {
 	int offset = 0;
 
-	while (state->count_lines_running && offset < state->size && state->n_lines < MAX_LINES) {
-		offset += textReadLine(state->buffer, offset, state->size, NULL);
-		state->n_lines++;
+	YieldState yield;
+	initYield(&yield, 1);
 
-		sceKernelDelayThread(1000);
+	// One pass of the VM for each match. It checks search_running and yields
+	// itself, restarting it per slice would scan the rest again every time
+	while (state->search_running && offset < state->size && state->n_search_results < MAX_SEARCH_RESULTS) {
+		int start, end;
+
+		if (!regexFindStoppable(re, state->buffer, state->size, offset, state->size, &start, &end, &state->search_running))
+			break;
+
+		// Empty matches have nothing to highlight
+		if (end > start && textAddSearchResult(state, start) < 0)
+			break;
+
+		offset = MAX(end, start + 1);
+
+		yieldIfNeeded(&yield);
 	}
+}
 
-	return sceKernelExitDeleteThread(0);
+// Next part of a drawn line to highlight, regex results can have any length
+static char *textFindHighlight(TextEditorState *state, char *line, int *length) {
+	if (!state->regex) {
+		*length = state->search.length;
+		return string_search_find(&state->search, line, strlen(line));
+	}
+
+	int start, end, from = 0;
+	int size = strlen(line);
+	while (from < size && regexFind(state->regex, line, size, from, size, &start, &end)) {
+		if (end > start) {
+			*length = end - start;
+			return line + start;
+		}
+
+		from = start + 1;
+	}
+
+	return NULL;
 }
 
 static int search_thread(SceSize args, SearchParams *argp) {
 	TextEditorState *state = argp->state;
-	char *search_term = argp->search_term;
-	int search_term_length = strlen(search_term);
-	int *search_result_offsets = state->search_result_offsets; 
 
-	state->search_running = 1;
-	state->n_search_results = 0;
+	if (argp->regex) {
+		regexSearch(state, argp->regex);
+		state->search_running = 0;
+		return sceKernelExitDeleteThread(0);
+	}
 
+	StringSearch *search = &state->search;
 	int offset = 0;
 
-	// make sure buffer is null-terminated
-	state->buffer[state->size] = '\0';
+	YieldState yield;
+	initYield(&yield, 1);
 
-	char *r;
+	// Search in slices so it can be stopped, matches may overlap into the next slice
 	while (state->search_running && offset < state->size && state->n_search_results < MAX_SEARCH_RESULTS) {
-		r = strcasestr(state->buffer + offset, search_term);
+		int size = MIN(state->size - offset, SEARCH_SLICE_SIZE + (int)search->length - 1);
 
-		if (r == NULL) {
-			state->search_running = 0;
-			continue;
-		}
+		char *r = string_search_find(search, state->buffer + offset, size);
 
-		int index = r - state->buffer;
+		if (r) {
+			int index = r - state->buffer;
 
-		search_result_offsets[state->n_search_results++] = index;
-		offset = index + 1;
+			if (textAddSearchResult(state, index) < 0)
+				break;
+
+			offset = index + 1;
+		} else {
+			offset += SEARCH_SLICE_SIZE;
+		}
 
-		sceKernelDelayThread(1000);
+		yieldIfNeeded(&yield);
 	}
 
 	state->search_running = 0;
@@ -510,55 +1293,274 @@ static int search_thread(SceSize args, SearchParams *argp) {
 	return sceKernelExitDeleteThread(0);
 }
 
+static void textFreeState(TextEditorState *state) {
+	pieceTableFree(&state->table);
+	free(state->offset_list);
+
+	int i;
+	for (i = 0; i < state->max_copied_lines; i++)
+		free(state->copy_buffer[i].line);
+
+	free(state->copy_buffer);
+
+	for (i = 0; i < MAX_SEARCH_RESULTS / SEARCH_RESULTS_BLOCK_SIZE; i++)
+		free(state->search_result_blocks[i]);
+
+	string_search_free(&state->search);
+
+	free(state);
+}
+
+static int textWriteTable(SceUID fd, void *context) {
+	TextEditorState *state = (TextEditorState *)context;
+	char utf8_bom[3] = {0xEF, 0xBB, 0xBF};
+
+	if (state->has_utf8_bom) {
+		int res = sceIoWrite(fd, utf8_bom, sizeof(utf8_bom));
+		if (res < 0)
+			return res;
+	}
+
+	return pieceTableWrite(&state->table, fd);
+}
+
+// While the text keeps the size of the file and none of the original text has
+// moved, only the added pieces are written into it. Otherwise it is replaced
+static int textSave(TextEditorState *state, char *file, SceOff file_size) {
+	PieceTable *table = &state->table;
+	int bom_length = state->has_utf8_bom ? 3 : 0;
+
+	if (!vitashell_config.editor_backup && table->size + bom_length == file_size && pieceTableIsInPlace(table)) {
+		FileRange *ranges = malloc(MAX(table->n_pieces, 1) * sizeof(FileRange));
+		if (ranges) {
+			int n_ranges = 0;
+
+			int i;
+			for (i = 0; i < table->n_pieces; i++) {
+				Piece *piece = &table->pieces[i];
+				if (!piece->add)
+					continue;
+
+				ranges[n_ranges].offset = bom_length + piece->start;
+				ranges[n_ranges].data = table->add + piece->offset;
+				ranges[n_ranges].size = piece->length;
+				n_ranges++;
+			}
+
+			int res = writeFileRanges(file, ranges, n_ranges);
+			free(ranges);
+			return res;
+		}
+	}
+
+	return writeFileAtomic(file, textWriteTable, state, vitashell_config.editor_backup);
+}
+
+// Line index of the file last left for the hex editor, so switching back
+// doesn't index it again
+static char kept_path[MAX_PATH_LENGTH];
+static SceIoStat kept_stat;
+static int kept_size = 0;
+static int kept_font_generation = 0;
+static int *kept_offset_list = NULL;
+static int kept_max_lines = 0;
+static int kept_n_lines = 0;
+
+static void textKeepIndex(TextEditorState *state, char *file, SceIoStat *stat) {
+	free(kept_offset_list);
+
+	kept_offset_list = state->offset_list;
+	kept_max_lines = state->max_lines;
+	kept_n_lines = state->n_lines;
+	kept_size = state->size;
+	kept_font_generation = font_generation;
+	memcpy(&kept_stat, stat, sizeof(SceIoStat));
+	strncpy(kept_path, file, MAX_PATH_LENGTH - 1);
+	kept_path[MAX_PATH_LENGTH - 1] = '\0';
+
+	state->offset_list = NULL;
+	state->max_lines = 0;
+}
+
+// Take the kept index if it was made for the file as it is now
+static int textRestoreIndex(TextEditorState *state, char *file, SceIoStat *stat) {
+	int restored = 0;
+
+	if (kept_offset_list && strcmp(kept_path, file) == 0 && kept_size == state->size &&
+		kept_font_generation == font_generation && kept_stat.st_size == stat->st_size &&
+		memcmp(&kept_stat.st_mtime, &stat->st_mtime, sizeof(SceDateTime)) == 0) {
+		free(state->offset_list);
+		state->offset_list = kept_offset_list;
+		state->max_lines = kept_max_lines;
+		state->n_lines = kept_n_lines;
+
+		kept_offset_list = NULL;
+		restored = 1;
+	}
+
+	free(kept_offset_list);
+	kept_offset_list = NULL;
+
+	return restored;
+}
+
 int textViewer(char *file) {
 	TextEditorState *s = malloc(sizeof(TextEditorState));
 	if (!s) 
 		return -1;
 
-	char *buffer_base = malloc(BIG_BUFFER_SIZE);
-	if (!buffer_base)
+	// Lists and buffers grow with the file, clipboard and search results
+	memset(s, 0, sizeof(TextEditorState));
+
+	SceIoStat stat;
+	memset(&stat, 0, sizeof(SceIoStat));
+
+	int stat_res = isInArchive() ? archiveFileGetstat(file, &stat) : sceIoGetstat(file, &stat);
+
+	// Files too large for memory are shown through a window
+	int paged = stat_res >= 0 && stat.st_size >= BIG_BUFFER_SIZE;
+
+	// Sized to the file with room for a newline at its end
+	int buffer_size = BIG_BUFFER_SIZE;
+	if (paged)
+		buffer_size = TEXT_WINDOW_SIZE + 2;
+	else if (stat_res >= 0)
+		buffer_size = (int)MIN(stat.st_size, BIG_BUFFER_SIZE - 1) + 1;
+
+	char *buffer_base = malloc(buffer_size);
+	if (!buffer_base) {
+		free(s);
 		return -1;
+	}
 
     s->running = 1;
-	s->hex_viewer = 0; 
-	s->n_copied_lines = 0;
-	s->copy_reset = 0;
 	s->modify_allowed = 1;
-	s->offset_list[0] = 0;
-	s->count_lines_running = 0;
-	s->n_lines = 0;
-	s->search_running = 0;
 	s->edit_line = -1;
 
-	if (isInArchive()) {
-		s->size = ReadArchiveFile(file, buffer_base, BIG_BUFFER_SIZE);
-		s->modify_allowed = 0;
-	} else {
-		s->size = ReadFile(file, buffer_base, BIG_BUFFER_SIZE);
-	}
+	int encoding = ENCODING_UTF8;
+	int indexed = 0;
+	int save_res = 0;
 
-	if (s->size < 0) {
-		free(buffer_base);
-		return s->size;
-	}
+	if (!paged) {
+		if (isInArchive()) {
+			s->size = ReadArchiveFile(file, buffer_base, buffer_size - 1);
+			s->modify_allowed = 0;
+		} else {
+			s->size = ReadFile(file, buffer_base, buffer_size - 1);
+		}
 
-	s->buffer = buffer_base;
+		if (s->size < 0) {
+			int res = s->size;
+			free(buffer_base);
+			free(s);
+			return res;
+		}
 
-	int has_utf8_bom = 0;
-	char utf8_bom[3] = {0xEF, 0xBB, 0xBF};
-	if (s->size >= 3 && memcmp(buffer_base, utf8_bom, 3) == 0) {
-		s->buffer += 3;
-		has_utf8_bom = 1;
-		s->size -= 3;
-	}
+		s->buffer = buffer_base;
+
+		int bom_length = 0;
+		encoding = detectEncoding(buffer_base, s->size, &bom_length);
+
+		if (encoding == ENCODING_UTF8) {
+			if (bom_length > 0) {
+				s->buffer += 3;
+				s->has_utf8_bom = 1;
+				s->size -= 3;
+			}
+		} else {
+			// Shown as UTF-8, with room for a newline at its end
+			char *transcoded = malloc(TRANSCODE_MAX_SIZE(s->size - bom_length) + 1);
+			if (!transcoded) {
+				free(buffer_base);
+				free(s);
+				return -1;
+			}
+
+			s->size = transcodeToUtf8(encoding, buffer_base + bom_length, s->size - bom_length, transcoded);
+
+			free(buffer_base);
+			buffer_base = transcoded;
+			s->buffer = buffer_base;
+
+			// It couldn't be saved in its own encoding
+			s->modify_allowed = 0;
+		}
+
+		if (s->size == 0) {
+			s->size = 1;
+			s->buffer[0] = '\n';
+		}
+
+		if (s->buffer[s->size-1] != '\n') {
+			s->buffer[s->size++] = '\n';
+		}
+
+		// Wrapped lines hold at least textGetShortLineLength characters
+		int n_newlines = textCountNewlines(s->buffer, s->size);
+		int n_rows = n_newlines + s->size / MAX(textGetShortLineLength(), 1) + 1;
+
+		// The window shows the file as it is, so only UTF-8 files can be paged
+		int pageable = encoding == ENCODING_UTF8 && stat_res >= 0;
+		int overflow = n_newlines >= MAX_LINES - 1;
+
+		if (!(pageable && overflow)) {
+			int res = textReserveLines(s, n_rows);
+			if (res >= 0)
+				res = pieceTableInit(&s->table, s->buffer, s->size);
+
+			if (res < 0) {
+				free(buffer_base);
+				textFreeState(s);
+				return -1;
+			}
+
+			s->offset_list[0] = 0;
+
+			cacheGlyphWidths(s->buffer, s->size);
+
+			if (stat_res >= 0)
+				indexed = textRestoreIndex(s, file, &stat);
+
+			// Whether the wrapped lines fit into offset_list is only known once indexed
+			if (!indexed && pageable && n_rows >= MAX_LINES - 1) {
+				textIndexLines(s, 0, NULL);
+				overflow = s->offset_list[s->n_lines] < s->size;
+				indexed = 1;
+			}
+
+			if (pageable && overflow) {
+				pieceTableFree(&s->table);
+				s->n_lines = 0;
+			}
+		}
+
+		// More lines than offset_list can hold
+		if (pageable && overflow) {
+			free(buffer_base);
+
+			buffer_base = malloc(TEXT_WINDOW_SIZE + 2);
+			if (!buffer_base) {
+				textFreeState(s);
+				return -1;
+			}
 
-	if (s->size == 0) {
-		s->size = 1;
-		s->buffer[0] = '\n';
+			s->has_utf8_bom = 0;
+			paged = 1;
+		}
 	}
 
-	if (s->buffer[s->size-1] != '\n') {
-		s->buffer[s->size++] = '\n';
+	if (paged) {
+		s->buffer = buffer_base;
+
+		int res = textReserveLines(s, MAX_LINES - 1);
+		if (res >= 0)
+			res = textOpenPaged(s, file, stat.st_size);
+
+		if (res < 0) {
+			free(buffer_base);
+			textFreeState(s);
+			return res;
+		}
 	}
 
 	s->base_pos = 0;
@@ -581,18 +1583,26 @@ int textViewer(char *file) {
 		entry->line_number = i;
 		entry->selected = 0;
 
-		int length = textReadLine(s->buffer, s->offset_list[i], s->size, entry->line);
+		int length = textGetLine(s, s->offset_list[i], entry->line);
 		s->offset_list[i + 1] = s->offset_list[i] + length;
 		
 		textListAddEntry(&s->list, entry);
 	}
 
+	// The window is indexed as it is loaded
 	CountParams count_params;
 	count_params.state = s;
 
-	s->count_lines_thid = sceKernelCreateThread("count_lines_thread", (SceKernelThreadEntry)count_lines_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
-	if (s->count_lines_thid >= 0)
-		sceKernelStartThread(s->count_lines_thid, sizeof(CountParams), &count_params);
+	if (!s->paged && !indexed) {
+		s->count_lines_running = 1;
+		s->count_lines_thid = sceKernelCreateThread("count_lines_thread", (SceKernelThreadEntry)count_lines_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
+		if (s->count_lines_thid >= 0)
+			sceKernelStartThread(s->count_lines_thid, sizeof(CountParams), &count_params);
+		else {
+			textIndexLines(s, 0, NULL);
+			s->count_lines_running = 0;
+		}
+	}
 
 	s->edit_line = -1;
 	s->changed = 0;
@@ -606,7 +1616,7 @@ int textViewer(char *file) {
 	while (s->running) {
 		readPad();
 
-		if (!s->save_question) {
+		if (!s->save_question && !s->invalid_regex) {
 			if (getContextMenuMode() != CONTEXT_MENU_CLOSED) {
 				contextMenuCtrl(&s->context_menu);
 			} else {
@@ -637,13 +1647,7 @@ int textViewer(char *file) {
 							// No previous
 							s->list.head->previous = NULL;
 
-							// Update line_number
-							s->list.head->line_number = s->base_pos;
-
-							// Read
-							textReadLine(s->buffer, s->offset_list[s->base_pos], s->size, s->list.head->line);
-
-							// Update the entry
+							// Read and update the entry
 							updateTextEntry(s, s->list.head, 0);
 						}
 					}
@@ -669,14 +1673,7 @@ int textViewer(char *file) {
 								// No next
 								s->list.tail->next = NULL;
 
-								// Update line_number
-								s->list.tail->line_number = s->base_pos + MAX_ENTRIES - 1;
-
-								// Read
-								int length = textReadLine(s->buffer, s->offset_list[s->base_pos + MAX_ENTRIES - 1], s->size, s->list.tail->line);
-								s->offset_list[s->base_pos + MAX_ENTRIES] = s->offset_list[s->base_pos + MAX_ENTRIES - 1] + length;
-
-								// Update the entry
+								// Read and update the entry
 								updateTextEntry(s, s->list.tail, MAX_ENTRIES - 1);
 							}
 						}
@@ -695,51 +1692,26 @@ int textViewer(char *file) {
 					int entry_start_offset = s->offset_list[entry->line_number];
 					int entry_end_offset = s->offset_list[entry->line_number + 1]; 
 
-					int target_offset = 0;
+					int target_offset = -1;
 
 					// Skip to next search result
 					if (pressed_buttons & SCE_CTRL_RTRIGGER) {
-						for (i = 0; i < s->n_search_results; i++) {
-							if (s->search_result_offsets[i] > entry_end_offset) {
-								target_offset = s->search_result_offsets[i] - entry_start_offset;
-								break;
-							}
-						}
+						i = textFindSearchResult(s, entry_end_offset + 1);
+						if (i < s->n_search_results)
+							target_offset = textGetSearchResult(s, i);
 					} // Skip to next last result
 					else if (pressed_buttons & SCE_CTRL_LTRIGGER) {
-						for (i = s->n_search_results - 1; i >= 0; i--) {
-							if (s->search_result_offsets[i] < entry_start_offset) {
-								target_offset = s->search_result_offsets[i] - entry_start_offset;
-								break;
-							}
-						}
+						i = textFindSearchResult(s, entry_start_offset) - 1;
+						if (i >= 0)
+							target_offset = textGetSearchResult(s, i);
 					}
 
-					if (target_offset != 0) {
-						int dir = target_offset > 0 ? 1 : -1;
-						int line = s->base_pos + s->rel_pos;
-						int offset = s->offset_list[line];
-
-						while (offset < s->size && offset >= 0 && target_offset != 0) {
-							offset += dir;
-							target_offset -= dir;
-
-							if (s->buffer[offset] == '\n') {
-								line += dir;
-								if (dir > 0) {
-									s->offset_list[line] = offset + 1;
-								} else {
-									s->offset_list[line+1] = offset + 1;
-								}
-							}
-						}
+					// Only jump once the line index has reached the result
+					if (target_offset >= 0 && target_offset < s->offset_list[s->n_lines]) {
+						s->base_pos = textGetLineOfOffset(s, target_offset);
+						s->rel_pos = 0;
 
-						if (target_offset == 0) {
-							s->base_pos = line;
-							s->rel_pos = 0;
-
-							updateTextEntries(s);
-						}
+						updateTextEntries(s);
 					}
 				} else {
 					// Page skip
@@ -772,6 +1744,38 @@ int textViewer(char *file) {
 
 						int length = strlen(search_term);
 
+						Regex *regex = NULL;
+						if (s->search_regex && length >= MIN_SEARCH_TERM_LENGTH) {
+							// kill old search before the cache may replace its pattern
+							if (s->search_running) {
+								s->search_running = 0;
+								sceKernelWaitThreadEnd(s->search_thid, NULL, NULL);
+							}
+
+							regex = regexGetCached(search_term, REGEX_IGNORE_CASE);
+							if (!regex) {
+								s->n_search_results = 0;
+								initMessageDialog(SCE_MSG_DIALOG_BUTTON_TYPE_OK, language_container[INVALID_REGEX]);
+								s->invalid_regex = 1;
+								length = 0;
+							}
+						}
+
+						// Prepared once for the search thread and for highlighting every drawn line
+						if (!regex && length >= MIN_SEARCH_TERM_LENGTH) {
+							// kill old search before freeing the term it uses
+							if (s->search_running) {
+								s->search_running = 0;
+								sceKernelWaitThreadEnd(s->search_thid, NULL, NULL);
+							}
+
+							string_search_free(&s->search);
+							if (string_search_init(&s->search, search_term) < 0) {
+								s->n_search_results = 0;
+								length = 0;
+							}
+						}
+
 						if (length >= MIN_SEARCH_TERM_LENGTH) {
 
 							// kill old search if it is already running
@@ -782,13 +1786,25 @@ int textViewer(char *file) {
 							
 							SearchParams search_params;
 							search_params.state = s;
-							strcpy(search_params.search_term, search_term);
+							search_params.regex = regex;
 
 							strcpy(s->search_term, search_term);
+							s->regex = regex;
+
+							s->n_search_results = 0;
 
-							s->search_thid = sceKernelCreateThread("search_thread", (SceKernelThreadEntry)search_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
-							if (s->search_thid >= 0)
-								sceKernelStartThread(s->search_thid, sizeof(SearchParams), &search_params);
+							// Search a contiguous copy of the edited text
+							char *buffer = pieceTableFlatten(&s->table);
+							if (buffer) {
+								s->buffer = buffer;
+								s->search_running = 1;
+
+								s->search_thid = sceKernelCreateThread("search_thread", (SceKernelThreadEntry)search_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
+								if (s->search_thid >= 0)
+									sceKernelStartThread(s->search_thid, sizeof(SearchParams), &search_params);
+								else
+									s->search_running = 0;
+							}
 						}
 
 						s->search_term_input = 0;
@@ -804,7 +1820,7 @@ int textViewer(char *file) {
 						int line_start = s->offset_list[s->base_pos + s->rel_pos];
 						
 						char line[MAX_LINE_CHARACTERS];
-						textReadLine(s->buffer, line_start, s->size, line);
+						textGetLine(s, line_start, line);
 
 						initImeDialog(language_container[EDIT_LINE], line, MAX_LINE_CHARACTERS, SCE_IME_TYPE_DEFAULT, SCE_IME_OPTION_MULTILINE);
 
@@ -815,35 +1831,28 @@ int textViewer(char *file) {
 						int ime_result = updateImeDialog();
 
 						if (ime_result == IME_DIALOG_RESULT_FINISHED) {
+							textFinishIndex(s);
+
 							int line_start = s->offset_list[s->edit_line];
-							
-							char line[MAX_LINE_CHARACTERS];
-							int length = textReadLine(s->buffer, line_start, s->size, line);
+							int length = textGetLine(s, line_start, NULL);
 
 							// Don't count newline 
-							if (s->buffer[line_start + length - 1] == '\n') {
+							char last = '\0';
+							pieceTableRead(&s->table, line_start + length - 1, &last, 1);
+							if (last == '\n') {
 								length--;
 							}
 
 							char *new_line = (char *)getImeDialogInputTextUTF8();
 							int new_length = strlen(new_line);
+							cacheGlyphWidths(new_line, new_length);
 
-							// Move data if size has changed
-							if (new_length != length) {
-								memmove(&s->buffer[line_start+new_length], &s->buffer[line_start+length], s->size-line_start-length);
-								s->size += (new_length - length);
-							}
+							// Replace the line
+							pieceTableDelete(&s->table, line_start, length);
+							pieceTableInsert(&s->table, line_start, new_line, new_length);
+							s->size = s->table.size;
 
-							// Copy new line into buffer
-							memcpy(&s->buffer[line_start], new_line, new_length);
-
-							// Add new lines to n_lines
-							int i;
-							for (i = 0; i < new_length; i++) {
-								if (new_line[i] == '\n') {
-									s->n_lines++;
-								}
-							}
+							textUpdateIndex(s, s->edit_line, line_start + length, new_length - length);
 							
 							// Update entries
 							updateTextEntries(s);
@@ -911,21 +1920,23 @@ int textViewer(char *file) {
 					entry->selected = line_selected;
 				}
 			}
+		} else if (s->invalid_regex) {
+			int msg_result = updateMessageDialog();
+			if (msg_result == MESSAGE_DIALOG_RESULT_NONE || msg_result == MESSAGE_DIALOG_RESULT_FINISHED)
+				s->invalid_regex = 0;
 		} else {
 			int msg_result = updateMessageDialog();
 			if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
-				SceUID fd = sceIoOpen(file, SCE_O_WRONLY|SCE_O_TRUNC, 0777);
-				if (fd >= 0) {
-					sceIoWrite(fd, buffer_base, has_utf8_bom ? s->size + sizeof(utf8_bom) : s->size);
-					sceIoClose(fd);
-				}
-
+				save_res = textSave(s, file, stat_res >= 0 ? stat.st_size : -1);
 				break;
 			} else if (msg_result == MESSAGE_DIALOG_RESULT_NO) {
 				break;
 			}
 		}
 
+		if (s->paged)
+			textSlideWindow(s);
+
 		// Start drawing
 		startDrawing(bg_text_image);
 
@@ -933,7 +1944,10 @@ int textViewer(char *file) {
 		drawShellInfo(file);
 
 		// Draw scroll bar
-		drawScrollBar(s->base_pos, s->n_lines);
+		if (s->paged)
+			drawScrollBar(s->window_line + s->base_pos, MAX(s->total_lines, s->window_line + s->n_lines));
+		else
+			drawScrollBar(s->base_pos, s->n_lines);
 
 		// Text
 		TextListEntry *entry = s->list.head;
@@ -949,18 +1963,14 @@ int textViewer(char *file) {
 			int entry_end_offset = entry_start_offset + line_lenght; 
 
 			if (s->n_search_results > 0) {
-				int j; 
-				for (j = 0; j < s->n_search_results; j++) {
-					int search_offset = s->search_result_offsets[j];
-					if (entry_start_offset <= search_offset && entry_end_offset >= search_offset) {
-						search_result_on_line = 1;
-					}
-				}
+				int j = textFindSearchResult(s, entry_start_offset);
+				if (j < s->n_search_results && textGetSearchResult(s, j) <= entry_end_offset)
+					search_result_on_line = 1;
 			}
 
 			if (entry->line_number < s->n_lines) {
 				char line_str[5];
-				snprintf(line_str, 5, "%04i", entry->line_number);
+				snprintf(line_str, 5, "%04i", s->window_line + entry->line_number);
 
 				int color = (s->rel_pos == i) ? TEXT_LINE_NUMBER_COLOR_FOCUS : TEXT_LINE_NUMBER_COLOR;
 				pgf_draw_text(SHELL_MARGIN_X, START_Y + (i * FONT_Y_SPACE), color, FONT_SIZE, line_str);
@@ -979,8 +1989,9 @@ int textViewer(char *file) {
 					*p = '\0';
 
 				char *search_highlight = NULL;
+				int search_highlight_length = 0;
 				if (search_result_on_line) {
-					search_highlight = strcasestr(line, s->search_term);
+					search_highlight = textFindHighlight(s, line, &search_highlight_length);
 				}
 
 				char tmp = '\0';
@@ -1002,15 +2013,14 @@ int textViewer(char *file) {
 				if (search_highlight) {
 					*search_highlight = tmp;
 
-					int search_term_length = strlen(s->search_term);
-					tmp = search_highlight[search_term_length];
-					search_highlight[search_term_length] = '\0';
+					tmp = search_highlight[search_highlight_length];
+					search_highlight[search_highlight_length] = '\0';
 
 					x += width;
 					x += pgf_draw_text(x, START_Y + (i * FONT_Y_SPACE), TEXT_HIGHLIGHT_COLOR, FONT_SIZE, line);
 					
-					search_highlight[search_term_length] = tmp;
-					line += strlen(s->search_term); 
+					search_highlight[search_highlight_length] = tmp;
+					line += search_highlight_length; 
 				}
 			}
 
@@ -1025,22 +2035,35 @@ int textViewer(char *file) {
 		endDrawing();
 	}
 
-	s->count_lines_running = 0;
-	sceKernelWaitThreadEnd(s->count_lines_thid, NULL, NULL);
+	indexed = !s->count_lines_running;
+
+	if (s->count_lines_running) {
+		s->count_lines_running = 0;
+		sceKernelWaitThreadEnd(s->count_lines_thid, NULL, NULL);
+	}
 
 	if (s->search_running) {
 		s->search_running = 0;
 		sceKernelWaitThreadEnd(s->search_thid, NULL, NULL);
 	}
 
+	if (s->paged)
+		textClosePaged(s);
+
+	if (s->hex_viewer && indexed && !s->paged && !s->changed && stat_res >= 0)
+		textKeepIndex(s, file, &stat);
+
 	textListEmpty(&s->list);
 
 	int hex_viewer = s->hex_viewer;
 
-	free(s);
+	textFreeState(s);
 
 	free(buffer_base); 
 
+	if (save_res < 0)
+		return save_res;
+
 	if (hex_viewer)
 		hexViewer(file);
 
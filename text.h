@@ -28,8 +28,17 @@
 #define TEXT_START_X 97.0f
 
 #define MAX_SEARCH_RESULTS 1024 * 1024
+#define SEARCH_RESULTS_BLOCK_SIZE 4 * 1024
 #define MIN_SEARCH_TERM_LENGTH 1
 
+// Files that don't fit into memory are shown through a window of this size
+#define TEXT_WINDOW_SIZE 1 * 1024 * 1024
+#define TEXT_INDEX_CHUNK_SIZE 256 * 1024
+#define TEXT_CHECKPOINT_LINES 256
+
+// Laid out display lines kept around for scrolling back
+#define TEXT_ROW_CACHE_SIZE 64
+
 typedef struct TextListEntry {
 	struct TextListEntry *next;
 	struct TextListEntry *previous;
@@ -45,9 +54,16 @@ typedef struct {
 } TextList;
 
 typedef struct CopyEntry {
-	char line[MAX_LINE_CHARACTERS];
+	char *line;
 } CopyEntry;
 
+typedef struct TextRow {
+	int offset;
+	int length; // 0 if unused
+	int last_use;
+	char line[MAX_LINE_CHARACTERS];
+} TextRow;
+
 void initTextContextMenuWidth();
 
 int textViewer(char *file);
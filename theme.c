@@ -22,6 +22,7 @@
 #include "config.h"
 #include "theme.h"
 #include "utils.h"
+#include "encoding.h"
 
 INCLUDE_EXTERN_RESOURCE(colors_txt);
 INCLUDE_EXTERN_RESOURCE(colors_txt_size);
@@ -121,6 +122,12 @@ vita2d_texture *previous_wallpaper_image = NULL, *current_wallpaper_image = NULL
 vita2d_pgf *font = NULL;
 char font_size_cache[256];
 
+// Changes whenever the font is loaded again
+int font_generation = 0;
+
+// Widths of Unicode glyphs plus one, 0 if not measured yet
+static unsigned char *glyph_width_cache = NULL;
+
 typedef struct {
 	char *name;
 	void *default_buf;
@@ -333,4 +340,54 @@ void loadTheme() {
 
 		font_size_cache[i] = vita2d_pgf_text_width(font, FONT_SIZE, character);
 	}
+
+	// Glyphs are measured again with the new font
+	if (glyph_width_cache)
+		memset(glyph_width_cache, 0, GLYPH_WIDTH_CACHE_SIZE);
+
+	font_generation++;
+}
+
+// Width of a code point, 0 if the font has none or it wasn't measured. Only
+// reads the cache, so any thread can use it
+int getGlyphWidth(unsigned int code) {
+	if (code < 0x80)
+		return font_size_cache[code];
+
+	if (code >= GLYPH_WIDTH_CACHE_SIZE || !glyph_width_cache || glyph_width_cache[code] == 0)
+		return 0;
+
+	return glyph_width_cache[code] - 1;
+}
+
+// Measure the glyphs of UTF-8 text that aren't cached yet. This draws on the
+// font, so only the UI thread may call it
+void cacheGlyphWidths(const char *text, int size) {
+	if (!glyph_width_cache) {
+		glyph_width_cache = malloc(GLYPH_WIDTH_CACHE_SIZE);
+		if (!glyph_width_cache)
+			return;
+
+		memset(glyph_width_cache, 0, GLYPH_WIDTH_CACHE_SIZE);
+	}
+
+	int i = skipAscii(text, 0, size);
+	while (i < size) {
+		unsigned int code;
+		int length = utf8Decode(text + i, size - i, &code);
+		if (length == 0) {
+			i = skipAscii(text, i + 1, size);
+			continue;
+		}
+
+		if (code < GLYPH_WIDTH_CACHE_SIZE && glyph_width_cache[code] == 0) {
+			char character[5];
+			character[utf8Encode(code, character)] = '\0';
+
+			int width = vita2d_pgf_text_width(font, FONT_SIZE, character);
+			glyph_width_cache[code] = MIN(MAX(width, 0), 254) + 1;
+		}
+
+		i = skipAscii(text, i + length, size);
+	}
 }
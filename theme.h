@@ -19,6 +19,9 @@
 #ifndef __THEME_H__
 #define __THEME_H__
 
+// Basic Multilingual Plane
+#define GLYPH_WIDTH_CACHE_SIZE 0x10000
+
 // Shell colors
 extern int BACKGROUND_COLOR;
 extern int TITLE_COLOR;
@@ -90,6 +93,11 @@ extern vita2d_texture *folder_icon, *file_icon, *archive_icon, *image_icon, *aud
 extern vita2d_texture *wallpaper_image;
 extern vita2d_texture *previous_wallpaper_image, *current_wallpaper_image;
 
+extern int font_generation;
+
 void loadTheme();
 
+int getGlyphWidth(unsigned int code);
+void cacheGlyphWidths(const char *text, int size);
+
 #endif
@@ -34,6 +34,8 @@ static int net_init = -1;
 
 static int lock_power = 0;
 
+static SceUInt64 last_frame_time = 0;
+
 void startDrawing(vita2d_texture *bg) {
 	vita2d_start_drawing();
 	vita2d_set_clear_color(BACKGROUND_COLOR);
@@ -60,6 +62,31 @@ void endDrawing() {
 	vita2d_common_dialog_update();
 	vita2d_swap_buffers();
 	sceDisplayWaitVblankStart();
+
+	last_frame_time = sceKernelGetProcessTimeWide();
+}
+
+void initYield(YieldState *state, int interval) {
+	state->slice_start = sceKernelGetProcessTimeWide();
+	state->interval = interval > 0 ? interval : 1;
+	state->calls = 0;
+}
+
+// Give the CPU away once the time slice is used up or the UI has missed frames.
+// The clock is only read every interval calls to keep tight loops cheap
+void yieldIfNeeded(YieldState *state) {
+	if (++state->calls < state->interval)
+		return;
+
+	state->calls = 0;
+
+	SceUInt64 now = sceKernelGetProcessTimeWide();
+	SceUInt64 elapsed = now - state->slice_start;
+
+	if (elapsed >= YIELD_SLICE_TIME || (elapsed >= YIELD_MIN_SLICE_TIME && now - last_frame_time >= YIELD_FRAME_LATE_TIME)) {
+		sceKernelDelayThread(YIELD_DELAY_TIME);
+		state->slice_start = sceKernelGetProcessTimeWide();
+	}
 }
 
 void closeWaitDialog() {
@@ -337,5 +364,13 @@ int launchAppByUriExit(char *titleid) {
 
 
 char *strcasestr(const char *haystack, const char *needle) {
-	return boyer_moore(haystack, needle); 
+	StringSearch search;
+	if (string_search_init(&search, needle) < 0)
+		return NULL;
+
+	char *r = string_search_find(&search, haystack, strlen(haystack));
+
+	string_search_free(&search);
+
+	return r;
 }
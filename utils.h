@@ -28,6 +28,12 @@
 #define ANALOG_THRESHOLD 64
 #define ANALOG_SENSITIVITY 16
 
+// Cooperative yield of worker threads (microseconds)
+#define YIELD_SLICE_TIME (16 * 1000)
+#define YIELD_MIN_SLICE_TIME (2 * 1000)
+#define YIELD_FRAME_LATE_TIME (50 * 1000)
+#define YIELD_DELAY_TIME 1000
+
 enum {
 	SCE_CTRL_RIGHT_ANALOG_UP	= 0x0020000,
 	SCE_CTRL_RIGHT_ANALOG_RIGHT	= 0x0040000,
@@ -44,6 +50,12 @@ enum {
 */
 };
 
+typedef struct {
+	SceUInt64 slice_start;
+	int interval;
+	int calls;
+} YieldState;
+
 extern SceCtrlData pad;
 extern uint32_t old_buttons, current_buttons, pressed_buttons, hold_buttons, hold2_buttons, released_buttons;
 
@@ -51,6 +63,9 @@ void startDrawing(vita2d_texture *bg);
 void drawingWallpaperUI2(vita2d_texture *bg,float x, float y, float tex_x, float tex_y, float tex_w, float tex_h);
 void endDrawing();
 
+void initYield(YieldState *state, int interval);
+void yieldIfNeeded(YieldState *state);
+
 void closeWaitDialog();
 
 void errorDialog(int error);
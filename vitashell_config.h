@@ -21,6 +21,12 @@
 
 typedef struct {
 	int disable_autoupdate;
+	int compress_time_budget;
+	int hash_crc32;
+	int hash_md5;
+	int hash_sha256;
+	int hash_export;
+	int editor_backup;
 } VitaShellConfig;
 
 #endif
\ No newline at end of file